@@ -3,7 +3,7 @@ OCTOMQ_OPT_FLAGS=unset
 
 usage()
 {
-    echo "usage: build.sh [ -c | --clean ] [ -o | --optimize ] [ -s | --static ] [ -t | --tls ] [ --no-dds ]"
+    echo "usage: build.sh [ -c | --clean ] [ -o | --optimize ] [ -s | --static ] [ -t | --tls ] [ --no-dds ] [ --lz4 ] [ --zstd ]"
     exit 2
 }
 
@@ -28,6 +28,12 @@ do
         --no-dds)
             OCTOMQ_OPT_FLAGS="$OCTOMQ_OPT_FLAGS -D OCTOMQ_ENABLE_DDS=OFF"
             ;;
+        --lz4)
+            OCTOMQ_OPT_FLAGS="$OCTOMQ_OPT_FLAGS -D OCTOMQ_ENABLE_LZ4=ON"
+            ;;
+        --zstd)
+            OCTOMQ_OPT_FLAGS="$OCTOMQ_OPT_FLAGS -D OCTOMQ_ENABLE_ZSTD=ON"
+            ;;
         --help)
             usage
             ;;
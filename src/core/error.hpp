@@ -83,6 +83,24 @@ class invalid_topic_filter : public std::runtime_error {
         : std::runtime_error("invalid topic filter '" + topic + "'.") {}
 };
 
+class wal_error : public std::runtime_error {
+   public:
+    explicit wal_error(const std::string &path, const std::string &what_arg)
+        : std::runtime_error("write-ahead log '" + path + "': " + what_arg + '.') {}
+};
+
+class filter_syntax_error : public std::runtime_error {
+   public:
+    explicit filter_syntax_error(const std::string &expression, const std::string &what_arg)
+        : std::runtime_error("payload filter '" + expression + "': " + what_arg + '.') {}
+};
+
+class link_protocol_error : public std::runtime_error {
+   public:
+    explicit link_protocol_error(const std::string &what_arg)
+        : std::runtime_error("link protocol error: " + what_arg + '.') {}
+};
+
 }  // namespace octopus_mq
 
 #endif
@@ -0,0 +1,44 @@
+#include "core/memory_budget.hpp"
+
+#include <string>
+
+#include "core/log.hpp"
+#include "core/metrics.hpp"
+
+namespace octopus_mq {
+
+void memory_budget::exceed(const std::int64_t used) {
+    // Only the thread which switched the state reports it
+    if (_exceeded.exchange(true)) return;
+    metrics::add(metric::memory_budget_exceeded);
+    log::print(log_type::warning,
+               "memory budget exceeded (" + log::size_to_string(static_cast<std::size_t>(used)) +
+                   " used), pausing publishers.");
+}
+
+void memory_budget::recover(const std::int64_t used) {
+    if (not _exceeded.exchange(false)) return;
+    log::print(log_type::info,
+               "memory budget recovered (" + log::size_to_string(static_cast<std::size_t>(used)) +
+                   " used), resuming publishers.");
+}
+
+void memory_budget::configure(const memory_settings &settings) {
+    _high = static_cast<std::int64_t>(settings.budget * settings.high_watermark);
+    _low = static_cast<std::int64_t>(settings.budget * settings.low_watermark);
+    _shed_qos0 = settings.shed_qos0;
+    // State is re-evaluated with the new watermarks by the next acquire or release
+    if (settings.budget == 0 or _used < _low) _exceeded = false;
+}
+
+bool memory_budget::exceeded() { return _exceeded.load(std::memory_order_relaxed); }
+
+bool memory_budget::shed(const std::uint8_t qos) {
+    if (qos != 0 or not _shed_qos0.load(std::memory_order_relaxed) or not exceeded()) return false;
+    metrics::add(metric::memory_shed_qos0);
+    return true;
+}
+
+std::int64_t memory_budget::used() { return _used.load(std::memory_order_relaxed); }
+
+}  // namespace octopus_mq
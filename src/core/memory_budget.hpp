@@ -0,0 +1,81 @@
+#ifndef OCTOMQ_MEMORY_BUDGET_H_
+#define OCTOMQ_MEMORY_BUDGET_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace octopus_mq {
+
+namespace memory_config {
+
+    namespace field_name {
+
+        constexpr char memory[] = "memory";
+        constexpr char budget[] = "budget";
+        constexpr char high_watermark[] = "high_watermark";
+        constexpr char low_watermark[] = "low_watermark";
+        constexpr char shed_qos0[] = "shed_qos0";
+
+    }  // namespace field_name
+
+    namespace constants {
+
+        constexpr double default_high_watermark = 0.9;  // of the budget
+        constexpr double default_low_watermark = 0.7;
+        // How often paused readers check whether the budget recovered
+        constexpr std::chrono::milliseconds recheck_interval = std::chrono::milliseconds(10);
+
+    }  // namespace constants
+
+}  // namespace memory_config
+
+struct memory_settings {
+    std::uint64_t budget = 0;  // bytes, zero is unlimited
+    double high_watermark = memory_config::constants::default_high_watermark;
+    double low_watermark = memory_config::constants::default_low_watermark;
+    bool shed_qos0 = false;
+};
+
+// Process-wide accounting of memory held by messages. Every message charges its payload to
+// the budget for its lifetime, so messages waiting in the global queue, adapter egress lanes
+// and link inboxes are all accounted.
+// The budget becomes exceeded at the high watermark and recovers at the low watermark. While
+// exceeded, brokers stop reading from publishers and, in shedding mode, QoS 0 messages are
+// dropped.
+class memory_budget {
+    static inline std::atomic<std::int64_t> _used = 0;
+    static inline std::atomic<std::int64_t> _high = 0;  // Zero when unlimited
+    static inline std::atomic<std::int64_t> _low = 0;
+    static inline std::atomic<bool> _exceeded = false;
+    static inline std::atomic<bool> _shed_qos0 = false;
+
+    static void exceed(const std::int64_t used);
+    static void recover(const std::int64_t used);
+
+   public:
+    static void configure(const memory_settings &settings);
+
+    static inline void acquire(const std::size_t bytes) {
+        const std::int64_t used =
+            _used.fetch_add(bytes, std::memory_order_relaxed) + static_cast<std::int64_t>(bytes);
+        const std::int64_t high = _high.load(std::memory_order_relaxed);
+        if (high != 0 and used >= high and not _exceeded.load(std::memory_order_relaxed))
+            exceed(used);
+    }
+    static inline void release(const std::size_t bytes) {
+        const std::int64_t used =
+            _used.fetch_sub(bytes, std::memory_order_relaxed) - static_cast<std::int64_t>(bytes);
+        if (_exceeded.load(std::memory_order_relaxed) and
+            used <= _low.load(std::memory_order_relaxed))
+            recover(used);
+    }
+
+    static bool exceeded();
+    static bool shed(const std::uint8_t qos);  // True if message should be dropped
+    static std::int64_t used();
+};
+
+}  // namespace octopus_mq
+
+#endif
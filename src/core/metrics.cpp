@@ -0,0 +1,117 @@
+#include "core/metrics.hpp"
+
+#include <string>
+
+#include "core/log.hpp"
+
+namespace octopus_mq {
+
+const char *metrics::name(const metric metric) {
+    switch (metric) {
+        case metric::topic_alias_rx_saved:
+            return "topic alias bytes saved (received)";
+        case metric::topic_alias_tx_saved:
+            return "topic alias bytes saved (sent)";
+        case metric::route_cache_hits:
+            return "route cache hits";
+        case metric::route_cache_misses:
+            return "route cache misses";
+        case metric::route_cache_evictions:
+            return "route cache evictions";
+        case metric::rate_limit_delayed:
+            return "rate limited messages (delayed)";
+        case metric::rate_limit_rejected:
+            return "rate limited messages (rejected)";
+        case metric::memory_budget_exceeded:
+            return "memory budget exceeded";
+        case metric::memory_shed_qos0:
+            return "QoS 0 messages shed";
+        case metric::connections_refused:
+            return "connections refused (admission)";
+        case metric::connects_deferred:
+            return "CONNECT packets deferred";
+        case metric::keep_alive_expired:
+            return "keep alive expired";
+        case metric::publishes_shared:
+            return "PUBLISH packets sent pre-encoded";
+        case metric::wal_appends:
+            return "write-ahead log appends";
+        case metric::wal_syncs:
+            return "write-ahead log flushes";
+        case metric::history_replayed:
+            return "messages replayed from history";
+        case metric::payload_filter_passed:
+            return "payload filter passes";
+        case metric::payload_filter_dropped:
+            return "payload filter drops";
+        case metric::transcoded:
+            return "payloads transcoded";
+        case metric::transcoding_failed:
+            return "payloads not transcoded";
+        case metric::conflated:
+            return "messages conflated";
+        case metric::link_dropped:
+            return "messages dropped by links";
+        case metric::history_evicted:
+            return "topic histories evicted";
+        case metric::mesh_duplicates:
+            return "mesh duplicates dropped";
+        case metric::count:
+            break;
+    }
+    return "unknown";
+}
+
+std::uint64_t metrics::get(const metric metric) {
+    return _counters[static_cast<std::size_t>(metric)].load(std::memory_order_relaxed);
+}
+
+std::size_t metrics::named_counter(const std::string &name) {
+    std::lock_guard<std::mutex> named_lock(_named_mutex);
+    const std::size_t count = _named_count.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < count; ++i)
+        if (_names[i] == name) return i;
+    if (count == _max_named) return null_counter;
+    _names[count] = name;
+    // Name is published before the counter becomes visible to print()
+    _named_count.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+void metrics::interval(const std::chrono::seconds interval) { _interval = interval; }
+
+const std::chrono::seconds &metrics::interval() { return _interval; }
+
+void metrics::print() {
+    std::lock_guard<std::mutex> print_lock(_print_mutex);
+    bool header_printed = false;
+    auto print_counter = [&header_printed](const string &name, const std::uint64_t value,
+                                           std::uint64_t &printed) {
+        // Only counters changed since the last print are shown
+        if (value == printed) return;
+        if (not header_printed) {
+            log::print(log_type::info, "metrics:");
+            header_printed = true;
+        }
+        log::print(log_type::more, name + ": " + std::to_string(value) + " (+" +
+                                       std::to_string(value - printed) + ')');
+        printed = value;
+    };
+    for (std::size_t i = 0; i < _counters.size(); ++i)
+        print_counter(name(static_cast<metric>(i)), _counters[i].load(std::memory_order_relaxed),
+                      _printed[i]);
+    const std::size_t named_count = _named_count.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < named_count; ++i)
+        print_counter(_names[i], _named[i].load(std::memory_order_relaxed), _named_printed[i]);
+}
+
+void metrics::print_periodic() {
+    if (_interval.count() == 0) return;
+    const auto now = std::chrono::steady_clock::now();
+    if (_last_print.time_since_epoch().count() == 0) _last_print = now;
+    if (now - _last_print < _interval) return;
+    _last_print = now;
+    print();
+}
+
+}  // namespace octopus_mq
@@ -0,0 +1,103 @@
+#ifndef OCTOMQ_METRICS_H_
+#define OCTOMQ_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace octopus_mq {
+
+namespace metrics_config {
+
+    namespace field_name {
+
+        constexpr char metrics[] = "metrics";
+        constexpr char interval[] = "interval";
+
+    }  // namespace field_name
+
+    namespace constants {
+
+        constexpr std::chrono::seconds default_interval = std::chrono::seconds(60);
+
+    }  // namespace constants
+
+}  // namespace metrics_config
+
+// Counters are grouped by the subsystem they belong to.
+// 'count' must be the last element, it is used as the number of counters.
+enum class metric : std::size_t {
+    topic_alias_rx_saved,  // bytes of topic names not received thanks to inbound aliases
+    topic_alias_tx_saved,  // bytes of topic names not sent thanks to outbound aliases
+    route_cache_hits,      // messages routed without evaluating adapter scopes
+    route_cache_misses,
+    route_cache_evictions,
+    rate_limit_delayed,   // messages after which reading from the client was paused
+    rate_limit_rejected,  // messages dropped or refused with 'quota exceeded'
+    memory_budget_exceeded,  // times the high watermark was reached
+    memory_shed_qos0,        // QoS 0 messages dropped while memory budget was exceeded
+    connections_refused,  // accepted sockets closed by admission control
+    connects_deferred,    // CONNECT packets handled in a later batch
+    keep_alive_expired,   // clients disconnected after 1.5 keep alive intervals of silence
+    publishes_shared,     // PUBLISH packets written from an encoding shared by subscribers
+    wal_appends,          // messages appended to the write-ahead log
+    wal_syncs,            // flushes of the write-ahead log, each covers a group of appends
+    history_replayed,     // messages sent from topic history to new subscribers
+    payload_filter_passed,   // payload filter evaluations that let the message through
+    payload_filter_dropped,  // payload filter evaluations that withheld the message
+    transcoded,              // payloads converted between JSON and binary formats
+    transcoding_failed,      // payloads passed unchanged, not valid in the source format
+    conflated,               // queued messages replaced by a newer one of the same topic
+    link_dropped,  // messages not sent to a link, its queue was full or they exceed a frame
+    history_evicted,  // topic histories dropped to stay within limits or the memory budget
+    mesh_duplicates,  // messages dropped, already received through another mesh path
+    count
+};
+
+// Process-wide counters. Adding is lock-free and could be done from any thread,
+// counters are periodically printed to the log by the control thread.
+class metrics {
+    static constexpr std::size_t _max_named = 64;
+
+    static inline std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(metric::count)>
+        _counters;
+    static inline std::array<std::uint64_t, static_cast<std::size_t>(metric::count)> _printed;
+    // Counters named at run time, e.g. per configured priority lane. Slots are never released.
+    static inline std::array<std::atomic<std::uint64_t>, _max_named> _named;
+    static inline std::array<std::uint64_t, _max_named> _named_printed;
+    static inline std::array<std::string, _max_named> _names;
+    static inline std::atomic<std::size_t> _named_count = 0;
+    static inline std::mutex _named_mutex;
+    static inline std::chrono::seconds _interval = metrics_config::constants::default_interval;
+    static inline std::chrono::steady_clock::time_point _last_print;
+    static inline std::mutex _print_mutex;
+
+    static const char *name(const metric metric);
+
+   public:
+    static inline void add(const metric metric, const std::uint64_t value = 1) {
+        _counters[static_cast<std::size_t>(metric)].fetch_add(value, std::memory_order_relaxed);
+    }
+    static std::uint64_t get(const metric metric);
+
+    static constexpr std::size_t null_counter = _max_named;  // Adding to it does nothing
+    // Returns the counter with given name, creating it if needed.
+    // Returns null_counter when all slots are taken.
+    static std::size_t named_counter(const std::string &name);
+    static inline void add_named(const std::size_t counter, const std::uint64_t value = 1) {
+        if (counter < _max_named) _named[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static void interval(const std::chrono::seconds interval);  // 0 disables periodic printing
+    static const std::chrono::seconds &interval();
+
+    static void print();
+    static void print_periodic();  // Prints counters only when interval has passed
+};
+
+}  // namespace octopus_mq
+
+#endif
@@ -13,6 +13,8 @@
 
 namespace octopus_mq {
 
+settings settings::_current;
+
 void settings::check_bindings(adapter_pool &adapter_pool) {
     // Compare binding of the last element to bindings of all previous elements
     const adapter_pool::iterator back = adapter_pool.end() - 1;
@@ -23,15 +25,190 @@ void settings::check_bindings(adapter_pool &adapter_pool) {
                                         iter->first->name());
 }
 
+void settings::parse_mesh() {
+    // 'mesh' section is optional, defaults are used for all missing fields
+    _mesh = mesh_settings();
+    if (not _settings_json.contains(mesh::field_name::mesh)) return;
+    const nlohmann::json &mesh_json = _settings_json[mesh::field_name::mesh];
+    if (not mesh_json.is_object()) throw field_type_error(mesh::field_name::mesh);
+
+    if (auto item = mesh_json.find(mesh::field_name::node_id); item != mesh_json.end()) {
+        if (not item->is_number_unsigned()) throw field_type_error(mesh::field_name::node_id);
+        _mesh.id = item->get<node_id>();
+    }
+    if (auto item = mesh_json.find(mesh::field_name::filter_size); item != mesh_json.end()) {
+        if (not item->is_number_unsigned()) throw field_type_error(mesh::field_name::filter_size);
+        _mesh.filter_size = item->get<std::size_t>();
+        if (_mesh.filter_size == 0) throw field_range_error(mesh::field_name::filter_size);
+    }
+    if (auto item = mesh_json.find(mesh::field_name::filter_window); item != mesh_json.end()) {
+        if (not item->is_number_unsigned())
+            throw field_type_error(mesh::field_name::filter_window);
+        _mesh.filter_window = std::chrono::seconds(item->get<unsigned>());
+    }
+}
+
+void settings::parse_metrics() {
+    // 'metrics' section is optional, zero interval disables periodic printing
+    _metrics_interval = metrics_config::constants::default_interval;
+    if (not _settings_json.contains(metrics_config::field_name::metrics)) return;
+    const nlohmann::json &metrics_json = _settings_json[metrics_config::field_name::metrics];
+    if (not metrics_json.is_object()) throw field_type_error(metrics_config::field_name::metrics);
+
+    if (auto item = metrics_json.find(metrics_config::field_name::interval);
+        item != metrics_json.end()) {
+        if (not item->is_number_unsigned())
+            throw field_type_error(metrics_config::field_name::interval);
+        _metrics_interval = std::chrono::seconds(item->get<unsigned>());
+    }
+}
+
+void settings::parse_tuning() {
+    // 'tuning' section is optional, it applies to the control thread and all adapters
+    _tuning = tuning_settings();
+    if (auto item = _settings_json.find(tuning::field_name::tuning); item != _settings_json.end())
+        _tuning = tuning_settings(*item);
+}
+
+void settings::parse_route_cache() {
+    // 'route_cache' section is optional, zero size disables the cache
+    _route_cache_size = route_cache_config::constants::default_size;
+    if (not _settings_json.contains(route_cache_config::field_name::route_cache)) return;
+    const nlohmann::json &cache_json = _settings_json[route_cache_config::field_name::route_cache];
+    if (not cache_json.is_object())
+        throw field_type_error(route_cache_config::field_name::route_cache);
+
+    if (auto item = cache_json.find(route_cache_config::field_name::size);
+        item != cache_json.end()) {
+        if (not item->is_number_unsigned())
+            throw field_type_error(route_cache_config::field_name::size);
+        _route_cache_size = item->get<std::size_t>();
+    }
+}
+
+void settings::parse_priorities() {
+    // 'priorities' section is optional, without it all messages share the default class
+    if (auto item = _settings_json.find(priority::field_name::priorities);
+        item != _settings_json.end())
+        _priorities = std::make_shared<const priority_settings>(*item);
+    else
+        _priorities = std::make_shared<const priority_settings>();
+}
+
+void settings::parse_memory() {
+    // 'memory' section is optional, memory is not limited without it
+    _memory = memory_settings();
+    if (not _settings_json.contains(memory_config::field_name::memory)) return;
+    const nlohmann::json &memory_json = _settings_json[memory_config::field_name::memory];
+    if (not memory_json.is_object()) throw field_type_error(memory_config::field_name::memory);
+
+    if (auto item = memory_json.find(memory_config::field_name::budget);
+        item != memory_json.end()) {
+        if (not item->is_number_unsigned())
+            throw field_type_error(memory_config::field_name::budget);
+        _memory.budget = item->get<std::uint64_t>();
+    }
+    for (auto [field, value] :
+         { std::make_pair(memory_config::field_name::high_watermark, &_memory.high_watermark),
+           std::make_pair(memory_config::field_name::low_watermark, &_memory.low_watermark) }) {
+        if (auto item = memory_json.find(field); item != memory_json.end()) {
+            if (not item->is_number()) throw field_type_error(field);
+            *value = item->get<double>();
+            if (*value <= 0 or *value > 1) throw field_range_error(field);
+        }
+    }
+    if (_memory.low_watermark > _memory.high_watermark)
+        throw field_range_error(memory_config::field_name::low_watermark);
+    if (auto item = memory_json.find(memory_config::field_name::shed_qos0);
+        item != memory_json.end()) {
+        if (not item->is_boolean()) throw field_type_error(memory_config::field_name::shed_qos0);
+        _memory.shed_qos0 = item->get<bool>();
+    }
+}
+
+void settings::parse_chunk_store() {
+    // 'chunk_store' section is optional, large payloads use anonymous memory by default
+    _chunk_store = chunk_store_settings();
+    if (not _settings_json.contains(chunk_store_config::field_name::chunk_store)) return;
+    const nlohmann::json &store_json = _settings_json[chunk_store_config::field_name::chunk_store];
+    if (not store_json.is_object())
+        throw field_type_error(chunk_store_config::field_name::chunk_store);
+
+    if (auto item = store_json.find(chunk_store_config::field_name::threshold);
+        item != store_json.end()) {
+        if (not item->is_number_unsigned())
+            throw field_type_error(chunk_store_config::field_name::threshold);
+        _chunk_store.threshold = item->get<std::size_t>();
+    }
+    if (auto item = store_json.find(chunk_store_config::field_name::directory);
+        item != store_json.end()) {
+        if (not item->is_string())
+            throw field_type_error(chunk_store_config::field_name::directory);
+        _chunk_store.directory = item->get<string>();
+    }
+}
+
+void settings::parse_wal() {
+    // 'wal' section is optional, messages are kept only in memory without it
+    _wal = wal_settings();
+    if (not _settings_json.contains(wal_config::field_name::wal)) return;
+    const nlohmann::json &wal_json = _settings_json[wal_config::field_name::wal];
+    if (not wal_json.is_object()) throw field_type_error(wal_config::field_name::wal);
+
+    if (auto item = wal_json.find(wal_config::field_name::directory); item != wal_json.end()) {
+        if (not item->is_string()) throw field_type_error(wal_config::field_name::directory);
+        _wal.directory = item->get<string>();
+    }
+    if (auto item = wal_json.find(wal_config::field_name::segment_size);
+        item != wal_json.end()) {
+        if (not item->is_number_unsigned())
+            throw field_type_error(wal_config::field_name::segment_size);
+        _wal.segment_size = item->get<std::size_t>();
+        if (_wal.segment_size < wal_config::constants::min_segment_size)
+            throw field_range_error(wal_config::field_name::segment_size);
+    }
+    if (auto item = wal_json.find(wal_config::field_name::fsync); item != wal_json.end()) {
+        if (not item->is_string()) throw field_type_error(wal_config::field_name::fsync);
+        const string policy = item->get<string>();
+        if (policy == wal_config::fsync_name::always)
+            _wal.fsync = fsync_policy::always;
+        else if (policy == wal_config::fsync_name::interval)
+            _wal.fsync = fsync_policy::interval;
+        else if (policy == wal_config::fsync_name::never)
+            _wal.fsync = fsync_policy::never;
+        else
+            throw field_encapsulated_error(wal_config::field_name::fsync,
+                                           "unknown policy '" + policy + '\'');
+    }
+    if (auto item = wal_json.find(wal_config::field_name::interval); item != wal_json.end()) {
+        if (not item->is_number_unsigned())
+            throw field_type_error(wal_config::field_name::interval);
+        _wal.interval = std::chrono::milliseconds(item->get<unsigned>());
+        if (_wal.interval.count() == 0) throw field_range_error(wal_config::field_name::interval);
+    }
+}
+
 void settings::parse(adapter_pool &adapter_pool) {
     if ((not _settings_json.contains("adapters")) or (not _settings_json["adapters"].is_array()))
         throw std::runtime_error("configuration file does not contain 'adapters' list.");
     if (_settings_json["adapters"].empty())
         throw std::runtime_error("configuration file contains an empty 'adapters' list.");
+    parse_tuning();
     for (auto &adapter_json : _settings_json["adapters"]) {
-        adapter_pool.push_back({ adapter_settings_factory::from_json(adapter_json), nullptr });
+        adapter_settings_ptr adapter = adapter_settings_factory::from_json(adapter_json);
+        tuning_settings adapter_tuning = adapter->tuning();
+        adapter_tuning.inherit(_tuning);
+        adapter->tuning(adapter_tuning);
+        adapter_pool.push_back({ adapter, nullptr });
         if (adapter_pool.size() > 1) check_bindings(adapter_pool);
     }
+    parse_mesh();
+    parse_metrics();
+    parse_route_cache();
+    parse_priorities();
+    parse_memory();
+    parse_chunk_store();
+    parse_wal();
 }
 
 void settings::load(const string &file_name, adapter_pool &adapter_pool) {
@@ -40,15 +217,38 @@ void settings::load(const string &file_name, adapter_pool &adapter_pool) {
         throw std::runtime_error("cannot open configuration file: " + string(strerror(errno)) +
                                  ": " + file_name);
     else {
+        settings parsed;
+        octopus_mq::adapter_pool parsed_pool;
         try {
-            _settings_json = nlohmann::json::parse(ifs);
-            settings::parse(adapter_pool);
+            parsed._settings_json = nlohmann::json::parse(ifs);
+            parsed.parse(parsed_pool);
+        } catch (const nlohmann::json::exception &je) {
+            // Syntax errors and values of unexpected types reported by the JSON library
+            throw std::runtime_error("settings error: " + string(je.what()));
         } catch (const std::runtime_error &re) {
             throw std::runtime_error("settings error: " + string(re.what()));
         }
+        _current = std::move(parsed);
+        adapter_pool = std::move(parsed_pool);
     }
 }
 
-const nlohmann::json settings::json() { return _settings_json; }
+const nlohmann::json settings::json() { return _current._settings_json; }
+
+const mesh_settings &settings::mesh() { return _current._mesh; }
+
+const std::chrono::seconds &settings::metrics_interval() { return _current._metrics_interval; }
+
+const tuning_settings &settings::tuning() { return _current._tuning; }
+
+const std::size_t &settings::route_cache_size() { return _current._route_cache_size; }
+
+priority_settings_ptr settings::priorities() { return _current._priorities; }
+
+const memory_settings &settings::memory() { return _current._memory; }
+
+const chunk_store_settings &settings::chunk_store() { return _current._chunk_store; }
+
+const wal_settings &settings::wal() { return _current._wal; }
 
 }  // namespace octopus_mq
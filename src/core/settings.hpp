@@ -6,27 +6,59 @@
 #include <string>
 #include <vector>
 
+#include "core/memory_budget.hpp"
+#include "core/metrics.hpp"
 #include "json.hpp"
 #include "network/adapter.hpp"
+#include "network/mesh.hpp"
 #include "network/network.hpp"
+#include "network/tuning.hpp"
+#include "network/wal.hpp"
 #include "threads/control.hpp"
 
 namespace octopus_mq {
 
 using std::string;
 
+// Settings of the configuration file. A file is parsed into a separate instance, which
+// replaces the current one only when the whole file is valid, so a failed reload leaves
+// the current settings untouched. Accessed only by the control thread.
 class settings {
-    static inline nlohmann::json _settings_json;
+    nlohmann::json _settings_json;
+    mesh_settings _mesh;
+    std::chrono::seconds _metrics_interval;
+    tuning_settings _tuning;
+    std::size_t _route_cache_size;
+    priority_settings_ptr _priorities;
+    memory_settings _memory;
+    chunk_store_settings _chunk_store;
+    wal_settings _wal;
+
+    static settings _current;
 
-    static void parse_setting(const nlohmann::json &json);
     static void check_bindings(adapter_pool &adapter_pool);
-    static void check_transport();
-    static void parse(adapter_pool &adapter_pool);
+    void parse_mesh();
+    void parse_metrics();
+    void parse_tuning();
+    void parse_route_cache();
+    void parse_priorities();
+    void parse_memory();
+    void parse_chunk_store();
+    void parse_wal();
+    void parse(adapter_pool &adapter_pool);
 
    public:
     static void load(const string &file_name, adapter_pool &adapter_pool);
 
     static const nlohmann::json json();
+    static const mesh_settings &mesh();
+    static const std::chrono::seconds &metrics_interval();
+    static const tuning_settings &tuning();
+    static const std::size_t &route_cache_size();
+    static priority_settings_ptr priorities();
+    static const memory_settings &memory();
+    static const chunk_store_settings &chunk_store();
+    static const wal_settings &wal();
 };
 
 }  // namespace octopus_mq
@@ -0,0 +1,87 @@
+#include "core/timer_wheel.hpp"
+
+#include <algorithm>
+
+namespace octopus_mq {
+
+wheel_timer::wheel_timer() : _prev(this), _next(this), _deadline(0), _period(0) {}
+
+wheel_timer::wheel_timer(wheel_timer &&other) : wheel_timer() { other.cancel(); }
+
+wheel_timer::~wheel_timer() { unlink(); }
+
+wheel_timer &wheel_timer::operator=(wheel_timer &&other) {
+    cancel();
+    other.cancel();
+    return *this;
+}
+
+void wheel_timer::cancel() {
+    unlink();
+    _handler = nullptr;
+}
+
+timer_wheel::timer_wheel(const std::chrono::steady_clock::duration tick)
+    : _tick(tick), _start(std::chrono::steady_clock::now()), _now(0) {}
+
+void timer_wheel::insert(wheel_timer &timer) {
+    constexpr std::uint64_t span = std::uint64_t(1) << (_slot_bits * _levels);
+    // Deadlines beyond the span wait in the top level and are inserted again when reached.
+    // Timers cascaded at their deadline go to the current slot, which is expired next.
+    const std::uint64_t deadline = std::min(std::max(timer._deadline, _now), _now + span - 1);
+    const std::uint64_t delta = deadline - _now;
+    std::size_t level = 0;
+    while (delta >> (_slot_bits * (level + 1))) ++level;
+    timer.link(_wheel[level][(deadline >> (_slot_bits * level)) & (_slots - 1)]);
+}
+
+void timer_wheel::step() {
+    ++_now;
+    // Slots of upper levels reached by the wheel are cascaded, highest level first
+    std::size_t levels = 1;
+    while (levels < _levels and (_now & ((std::uint64_t(1) << (_slot_bits * levels)) - 1)) == 0)
+        ++levels;
+    for (std::size_t level = levels - 1; level > 0; --level) {
+        wheel_timer &head = _wheel[level][(_now >> (_slot_bits * level)) & (_slots - 1)];
+        while (head.armed()) {
+            wheel_timer &timer = *head._next;
+            timer.unlink();
+            insert(timer);
+        }
+    }
+
+    wheel_timer &head = _wheel[0][_now & (_slots - 1)];
+    while (head.armed()) {
+        wheel_timer &timer = *head._next;
+        timer.unlink();
+        if (timer._deadline > _now)
+            // Timer was touched after it had been inserted
+            insert(timer);
+        else {
+            std::function<void()> handler = std::move(timer._handler);
+            timer._handler = nullptr;
+            if (handler) handler();
+        }
+    }
+}
+
+void timer_wheel::schedule(wheel_timer &timer, const std::chrono::steady_clock::duration period,
+                           std::function<void()> handler) {
+    timer.unlink();
+    // Period is rounded up to whole ticks, so timers never expire early
+    const auto ticks = (period + _tick - std::chrono::steady_clock::duration(1)) / _tick;
+    timer._period = static_cast<std::uint64_t>(std::max<decltype(ticks)>(ticks, 1));
+    timer._deadline = _now + timer._period;
+    timer._handler = std::move(handler);
+    insert(timer);
+}
+
+void timer_wheel::advance(const std::chrono::steady_clock::time_point now) {
+    if (now <= _start) return;
+    const std::uint64_t target = static_cast<std::uint64_t>((now - _start) / _tick);
+    while (_now < target) step();
+}
+
+const std::chrono::steady_clock::duration &timer_wheel::tick() const { return _tick; }
+
+}  // namespace octopus_mq
@@ -0,0 +1,86 @@
+#ifndef OCTOMQ_TIMER_WHEEL_H_
+#define OCTOMQ_TIMER_WHEEL_H_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace octopus_mq {
+
+class timer_wheel;
+
+// One-shot timer owned by its user and linked into a timer wheel without allocation.
+// A timer unlinks itself when destroyed, moved-from and moved-to timers are disarmed.
+class wheel_timer {
+    friend class timer_wheel;
+
+    wheel_timer *_prev;
+    wheel_timer *_next;
+    std::uint64_t _deadline;  // Wheel ticks
+    std::uint64_t _period;    // Wheel ticks, deadline is moved by it on touch
+    std::function<void()> _handler;
+
+    inline void link(wheel_timer &head) {
+        _prev = head._prev;
+        _next = &head;
+        head._prev->_next = this;
+        head._prev = this;
+    }
+    inline void unlink() {
+        _prev->_next = _next;
+        _next->_prev = _prev;
+        _prev = _next = this;
+    }
+
+   public:
+    wheel_timer();
+    wheel_timer(const wheel_timer &) = delete;
+    wheel_timer(wheel_timer &&);
+    ~wheel_timer();
+
+    wheel_timer &operator=(const wheel_timer &) = delete;
+    wheel_timer &operator=(wheel_timer &&);
+
+    inline bool armed() const { return _next != this; }
+    void cancel();
+};
+
+// Hierarchical timing wheel for large numbers of coarse timers driven by a single clock,
+// e.g. keep-alive timers of all connections served by one io thread. Timers are inserted
+// into the level whose span covers their deadline and cascade to lower levels as the
+// wheel turns. Touching a timer only moves its deadline, so a timer reached before its
+// deadline is inserted again instead of expiring. Not thread safe.
+class timer_wheel {
+    static constexpr std::size_t _slot_bits = 6;
+    static constexpr std::size_t _slots = 1 << _slot_bits;
+    static constexpr std::size_t _levels = 4;  // 2^24 ticks
+
+    std::array<std::array<wheel_timer, _slots>, _levels> _wheel;  // List heads
+    std::chrono::steady_clock::duration _tick;
+    std::chrono::steady_clock::time_point _start;
+    std::uint64_t _now;  // Ticks since start
+
+    void insert(wheel_timer &timer);
+    void step();
+
+   public:
+    explicit timer_wheel(const std::chrono::steady_clock::duration tick);
+    timer_wheel(const timer_wheel &) = delete;
+    timer_wheel &operator=(const timer_wheel &) = delete;
+
+    // Arms the timer to expire after the period unless it is touched
+    void schedule(wheel_timer &timer, const std::chrono::steady_clock::duration period,
+                  std::function<void()> handler);
+    // Postpones expiry by the period of the timer. O(1), does not relink the timer.
+    inline void touch(wheel_timer &timer) const { timer._deadline = _now + timer._period; }
+    // Turns the wheel up to the time point and runs handlers of expired timers. Handlers are
+    // moved out before they are called, so they may destroy or rearm their timer.
+    void advance(const std::chrono::steady_clock::time_point now);
+
+    const std::chrono::steady_clock::duration &tick() const;
+};
+
+}  // namespace octopus_mq
+
+#endif
@@ -1,13 +1,22 @@
 #include "network/adapter.hpp"
 
+#include <algorithm>
+
 #include "core/error.hpp"
+#include "core/log.hpp"
+#include "core/memory_budget.hpp"
+#include "core/metrics.hpp"
 
 namespace octopus_mq {
 
 using std::string;
 
 adapter_settings::adapter_settings(const protocol_type &protocol, const nlohmann::json &json)
-    : _phy(), _port(network::constants::null_port), _protocol(protocol), _generated_name(false) {
+    : _phy(),
+      _port(network::constants::null_port),
+      _protocol(protocol),
+      _generated_name(false),
+      _json(json) {
     // Parsing protocol name
     // It exists and is string. That was already checked by adapter_factory
     _protocol_name = json[adapter::field_name::protocol].get<string>();
@@ -38,9 +47,9 @@ adapter_settings::adapter_settings(const protocol_type &protocol, const nlohmann
 
     const nlohmann::json &scope_field = json[adapter::field_name::scope];
     if (scope_field.is_string())
-        _scope = octopus_mq::scope(scope_field.get<string>());
+        _scope = std::make_shared<const octopus_mq::scope>(scope_field.get<string>());
     else if (scope_field.is_array())
-        _scope = octopus_mq::scope(scope_field.get<std::vector<string>>());
+        _scope = std::make_shared<const octopus_mq::scope>(scope_field.get<std::vector<string>>());
     else
         throw field_type_error(adapter::field_name::scope);
 
@@ -56,6 +65,10 @@ adapter_settings::adapter_settings(const protocol_type &protocol, const nlohmann
         _name = '[' + _phy.name() + ':' + std::to_string(_port) + "] " + _protocol_name;
         _generated_name = true;
     }
+
+    // Parsing optional 'tuning' field, unset fields are inherited from global settings
+    if (auto item = json.find(tuning::field_name::tuning); item != json.end())
+        _tuning = tuning_settings(*item);
 }
 
 void adapter_settings::phy(const class phy &phy) { _phy = phy; }
@@ -64,7 +77,13 @@ void adapter_settings::phy(const string &phy) { _phy = octopus_mq::phy(phy); }
 
 void adapter_settings::port(const port_int &port) { _port = port; }
 
-void adapter_settings::scope(const class scope &scope) { _scope = scope; }
+void adapter_settings::scope(const class scope &scope) {
+    std::atomic_store(&_scope, std::make_shared<const class scope>(scope));
+}
+
+void adapter_settings::scope(const std::shared_ptr<const class scope> scope) {
+    std::atomic_store(&_scope, scope);
+}
 
 void adapter_settings::name(const string &name) { _name = name; }
 
@@ -72,6 +91,8 @@ void adapter_settings::name_append(const string &appendix) {
     if (_generated_name) _name += ' ' + appendix;
 }
 
+void adapter_settings::tuning(const tuning_settings &tuning) { _tuning = tuning; }
+
 const class phy &adapter_settings::phy() const { return _phy; }
 
 const port_int &adapter_settings::port() const { return _port; }
@@ -80,10 +101,14 @@ const protocol_type &adapter_settings::protocol() const { return _protocol; }
 
 const string &adapter_settings::protocol_name() const { return _protocol_name; }
 
-const class scope &adapter_settings::scope() const { return _scope; }
+std::shared_ptr<const class scope> adapter_settings::scope() const {
+    return std::atomic_load(&_scope);
+}
 
 const string &adapter_settings::name() const { return _name; }
 
+const tuning_settings &adapter_settings::tuning() const { return _tuning; }
+
 bool adapter_settings::compare_binding(const ip_int ip, const port_int port) const {
     const ip_int phy_ip = _phy.ip();
     return ((ip == phy_ip) or (ip == network::constants::loopback_ip) or
@@ -91,6 +116,14 @@ bool adapter_settings::compare_binding(const ip_int ip, const port_int port) con
            (port == _port);
 }
 
+bool adapter_settings::same_except_scope(const adapter_settings &other) const {
+    nlohmann::json json = _json, other_json = other._json;
+    json.erase(adapter::field_name::scope);
+    other_json.erase(adapter::field_name::scope);
+    // Tuning is compared after inheriting global settings, which could change on their own
+    return json == other_json and _tuning == other._tuning;
+}
+
 const string adapter_settings::binging_name() const {
     const address adapter_address(_phy.ip(), _port);
     return adapter_address.to_string();
@@ -102,21 +135,104 @@ adapter_interface::adapter_interface(const adapter_settings_ptr adapter_settings
 
 adapter_settings_const_ptr adapter_interface::settings() const { return _adapter_settings; }
 
-void message_queue::push(const adapter_settings_ptr adapter, const message_ptr message) {
+message_queue::message_queue()
+    : _queue("dispatch"), _priorities(std::make_shared<const priority_settings>()) {}
+
+void message_queue::configure(const mesh_settings &mesh) {
+    std::lock_guard<std::mutex> queue_lock(_queue_mutex);
+    _duplicate_filter = duplicate_filter(mesh.filter_size, mesh.filter_window);
+}
+
+void message_queue::configure_routes(const std::size_t route_cache_size) {
+    std::lock_guard<std::mutex> queue_lock(_queue_mutex);
+    _route_cache.capacity(route_cache_size);
+}
+
+void message_queue::configure_priorities(const priority_settings_ptr priorities) {
+    std::lock_guard<std::mutex> queue_lock(_queue_mutex);
+    std::atomic_store(&_priorities, priorities);
+    _queue.configure(priorities);
+}
+
+priority_settings_ptr message_queue::priorities() const { return std::atomic_load(&_priorities); }
+
+void message_queue::configure_wal(const wal_settings &settings) {
+    std::lock_guard<std::mutex> queue_lock(_queue_mutex);
+    _recovered = _wal.open(settings);
+}
+
+void message_queue::close_wal() {
+    std::lock_guard<std::mutex> queue_lock(_queue_mutex);
+    _wal.close();
+}
+
+bool message_queue::durable() const { return _wal.enabled(); }
+
+void message_queue::replay(const adapter_pool &pool) {
+    std::unique_lock<std::mutex> queue_lock(_queue_mutex);
+    if (_recovered.empty()) return;
+    const priority_settings_ptr classes = priorities();
+    for (auto &[adapter_name, message] : _recovered) {
+        auto adapter = std::find_if(pool.begin(), pool.end(), [&adapter_name](auto &item) {
+            return item.first->name() == adapter_name;
+        });
+        message->priority(classes->classify(*message));
+        message->hold();
+        _queue.push(message->priority(),
+                    std::make_pair(adapter != pool.end() ? adapter->first : nullptr, message));
+    }
+    log::print(log_type::info, "replaying %lu %s from write-ahead log.", _recovered.size(),
+               (_recovered.size() > 1) ? "messages" : "message");
+    _recovered.clear();
+    queue_lock.unlock();
+    _queue_cv.notify_one();
+}
+
+bool message_queue::push(const adapter_settings_ptr adapter, const message_ptr message) {
+    if (memory_budget::shed(message->qos())) return false;
+    // Classification evaluates topic filters, so it is done before taking the lock
+    message->priority(priorities()->classify(*message));
     std::unique_lock<std::mutex> queue_lock(_queue_mutex);
-    _queue.push(std::make_pair(adapter, message));
+    const bool entering = not message->stamped();
+    if (entering)
+        // Message enters the mesh through this node
+        message->stamp(node::id(), node::next_hash());
+    else if (message->origin_node() == node::id())
+        // Message came back to its origin node
+        return false;
+    else if (_duplicate_filter.contains(message->hash())) {
+        // Message was already received via another path
+        metrics::add(metric::mesh_duplicates);
+        return false;
+    }
+    wal_sequence sequence = 0;
+    if (message->qos() != 0 and _wal.enabled()) {
+        sequence = _wal.append(adapter->name(), *message);
+        if (sequence == 0) {
+            // Message would not survive a crash, so the publisher has to send it again.
+            // Stamp is taken back, so the same message could be pushed again.
+            if (entering) message->stamp(mesh::constants::null_node, mesh::constants::null_hash);
+            return false;
+        }
+        message->wal_sequence(sequence);
+        message->hold();  // Released once the message leaves the queue
+    }
+    // Hash is remembered only once the message is taken, a refused one could come again
+    if (not entering) _duplicate_filter.insert(message->hash());
+    _queue.push(message->priority(), std::make_pair(adapter, message));
     queue_lock.unlock();
     _queue_cv.notify_one();
+    // Publisher is acknowledged after push returns, so it waits for the flush here
+    _wal.commit(sequence);
+    return true;
 }
 
 bool message_queue::wait_and_pop(std::chrono::milliseconds timeout,
                                  adapter_message_pair &destination) {
     std::unique_lock<std::mutex> queue_lock(_queue_mutex);
-    if (_queue_cv.wait_for(queue_lock, timeout, [this] { return not _queue.empty(); })) {
-        destination = _queue.front();
-        _queue.pop();
-        return true;
-    } else
+    if (_queue_cv.wait_for(queue_lock, timeout, [this] { return not _queue.empty(); }))
+        return _queue.pop(destination);
+    else
         return false;
 }
 
@@ -125,16 +241,37 @@ size_t message_queue::wait_and_pop_all(std::chrono::milliseconds timeout, adapte
     size_t popped = 0;
     if (_queue_cv.wait_for(queue_lock, timeout, [this] { return not _queue.empty(); })) {
         popped = _queue.size();
-        while (not _queue.empty()) {
-            adapter_message_pair item = _queue.front();
-            for (auto &adapter : pool)
-                if (adapter.first != item.first and
-                    adapter.second->settings()->scope().includes(item.second->topic()))
-                    adapter.second->inject_publish(item.second);
-            _queue.pop();
+        // Scopes are taken once per batch, a scope swapped on reload clears the route cache
+        scope_list scopes;
+        scopes.reserve(pool.size());
+        for (auto &adapter : pool) scopes.push_back(adapter.first->scope());
+        _route_cache.validate(scopes);
+
+        adapter_message_pair item;
+        while (_queue.pop(item)) {
+            const route_mask &routes = _route_cache.routes(item.second->interned_topic());
+            const bool logged = item.second->wal_sequence() != 0;
+            for (std::size_t i = 0; i < pool.size(); ++i)
+                if (routes[i] and pool[i].first != item.first) {
+                    // Adapter takes this hold over with its receipt
+                    if (logged) item.second->hold();
+                    pool[i].second->inject_publish(item.second);
+                }
+            handed_off(*item.second);
         }
     }
+    // Entries handed off since the last batch are checkpointed even if the queue is idle
+    _wal.checkpoint();
     return popped;
 }
 
+void message_queue::handed_off(message &message) {
+    if (message.wal_sequence() != 0 and message.release()) _wal.release(message.wal_sequence());
+}
+
+handoff_receipt message_queue::receipt(const message_ptr message) {
+    if (message->wal_sequence() == 0) return nullptr;
+    return handoff_receipt(message.get(), [this, message](const void *) { handed_off(*message); });
+}
+
 }  // namespace octopus_mq
@@ -11,8 +11,13 @@
 #include <thread>
 
 #include "json.hpp"
+#include "network/mesh.hpp"
 #include "network/message.hpp"
 #include "network/network.hpp"
+#include "network/priority.hpp"
+#include "network/route_cache.hpp"
+#include "network/tuning.hpp"
+#include "network/wal.hpp"
 
 namespace octopus_mq {
 
@@ -31,6 +36,13 @@ namespace adapter {
         constexpr char name[] = "name";
         constexpr char security[] = "security";
         constexpr char certificate[] = "certificate";
+        constexpr char predefined_topics[] = "predefined_topics";
+        constexpr char remote[] = "remote";
+        constexpr char compression[] = "compression";
+        constexpr char window[] = "window";
+        constexpr char max_packet_size[] = "max_packet_size";
+        constexpr char deliver_once[] = "deliver_once";
+        constexpr char conflation[] = "conflation";
 
     }  // namespace field_name
 
@@ -48,6 +60,7 @@ namespace adapter {
 
         constexpr char mqtt[] = "mqtt";
         constexpr char dds[] = "dds";
+        constexpr char link[] = "link";
 
     }  // namespace protocol_name
 
@@ -58,6 +71,14 @@ namespace adapter {
 
     }  // namespace role_name
 
+    namespace compression_name {
+
+        constexpr char none[] = "none";
+        constexpr char lz4[] = "lz4";
+        constexpr char zstd[] = "zstd";
+
+    }  // namespace compression_name
+
 }  // namespace adapter
 
 using std::string, std::shared_ptr;
@@ -72,9 +93,11 @@ class adapter_settings {
     port_int _port;
     protocol_type _protocol;
     string _protocol_name;
-    scope _scope;
+    std::shared_ptr<const class scope> _scope;  // Accessed atomically, is replaced on reload
     string _name;
     bool _generated_name;
+    nlohmann::json _json;  // Adapter section of the configuration file
+    tuning_settings _tuning;
 
    public:
     adapter_settings(const protocol_type &protocol, const nlohmann::json &json);
@@ -83,17 +106,24 @@ class adapter_settings {
     void phy(const string &phy);
     void port(const port_int &port);
     void scope(const class scope &scope);
+    void scope(const std::shared_ptr<const class scope> scope);
     void name(const string &name);
     void name_append(const string &appendix);  // Only works with generated names
+    void tuning(const tuning_settings &tuning);
 
     const class phy &phy() const;
     const port_int &port() const;
     const protocol_type &protocol() const;
     const string &protocol_name() const;
-    const class scope &scope() const;
+    std::shared_ptr<const class scope> scope() const;
     const string &name() const;
+    const tuning_settings &tuning() const;
 
     bool compare_binding(const ip_int ip, const port_int port) const;
+    // True if both settings describe the same adapter and could differ only in scope,
+    // so running adapter could be kept on configuration reload. Tuning inherited from
+    // global settings is compared too.
+    bool same_except_scope(const adapter_settings &other) const;
     const string binging_name() const;
 };
 
@@ -114,6 +144,9 @@ class adapter_interface {
 
     virtual void run() = 0;
     virtual void stop() = 0;
+    // Implementation takes message_queue::receipt() of the message right away and keeps it
+    // with the message until the message is sent or dropped, so queued work destroyed with
+    // the adapter releases its messages as well
     virtual void inject_publish(const message_ptr message) = 0;
     adapter_settings_const_ptr settings() const;
 };
@@ -121,16 +154,56 @@ class adapter_interface {
 using adapter_iface_ptr = std::shared_ptr<adapter_interface>;
 using adapter_pool = std::vector<std::pair<adapter_settings_ptr, adapter_iface_ptr>>;
 using adapter_message_pair = std::pair<adapter_settings_ptr, message_ptr>;
-
+using handoff_receipt = std::shared_ptr<const void>;
+// Message passed to inject_publish() with its receipt, as adapters queue it
+using injected_message = std::pair<message_ptr, handoff_receipt>;
+
+// Global queue of messages received by adapters. Messages are classified on push and wait in
+// the lane of their priority class, so bulk traffic does not delay urgent topics.
+// In durable mode, QoS 1 and 2 messages are appended to the write-ahead log in the order of
+// the queue. A logged message is checkpointed once the receipts of all adapters it was
+// dispatched to are destroyed, as they sent it, dropped it or were stopped, so a crash while
+// it waits in an adapter replays it.
 class message_queue {
-    std::queue<adapter_message_pair> _queue;
+    priority_lanes<adapter_message_pair> _queue;
+    priority_settings_ptr _priorities;  // Accessed atomically, is replaced on reload
     std::mutex _queue_mutex;
     std::condition_variable _queue_cv;
+    duplicate_filter _duplicate_filter;  // Guarded by _queue_mutex
+    route_cache _route_cache;            // Guarded by _queue_mutex
+    write_ahead_log _wal;                // Appended and checkpointed under _queue_mutex
+    std::vector<wal_entry> _recovered;   // Replayed once adapters are running
 
    public:
-    void push(const adapter_settings_ptr adapter, const message_ptr message);
+    message_queue();
+
+    void configure(const mesh_settings &mesh);
+    void configure_routes(const std::size_t route_cache_size);
+    void configure_priorities(const priority_settings_ptr priorities);
+    priority_settings_ptr priorities() const;
+    // Opens the write-ahead log, entries left from the previous run are kept for replay()
+    void configure_wal(const wal_settings &settings);
+    void close_wal();
+    // Returns true if messages are logged, so publishers are acknowledged after push()
+    bool durable() const;
+    // Queues recovered entries for the adapters they were received by. Entries of adapters
+    // which are not configured anymore are dispatched to all adapters.
+    void replay(const adapter_pool &pool);
+    // Returns false if message was dropped as a duplicate, as a looped back one, was shed
+    // because memory budget is exceeded or could not be appended to the write-ahead log.
+    // Publisher of a refused message must not be acknowledged.
+    bool push(const adapter_settings_ptr adapter, const message_ptr message);
     bool wait_and_pop(std::chrono::milliseconds timeout, adapter_message_pair &destination);
     size_t wait_and_pop_all(std::chrono::milliseconds timeout, adapter_pool &pool);
+
+    // Takes over the hold of a message passed to inject_publish(), the message is handed off
+    // when the last copy of the receipt is destroyed. Could be called from any thread.
+    // Empty if the message is not logged.
+    handoff_receipt receipt(const message_ptr message);
+
+   private:
+    // Releases a hold of the message, does nothing if it is not logged
+    void handed_off(message &message);
 };
 
 }  // namespace octopus_mq
@@ -1,7 +1,9 @@
 #include "network/adapter_factory.hpp"
 
 #include "core/error.hpp"
+#include "threads/link/bridge.hpp"
 #include "threads/mqtt/broker.hpp"
+#include "threads/mqtt/sn_gateway.hpp"
 #ifdef OCTOMQ_ENABLE_DDS
 #include "threads/dds/peer.hpp"
 #endif
@@ -10,7 +12,8 @@ namespace octopus_mq {
 
 static inline const std::map<string, protocol_type> _protocol_from_name = {
     { adapter::protocol_name::mqtt, protocol_type::mqtt },
-    { adapter::protocol_name::dds, protocol_type::dds }
+    { adapter::protocol_name::dds, protocol_type::dds },
+    { adapter::protocol_name::link, protocol_type::link }
 };
 
 adapter_settings_ptr adapter_settings_factory::from_json(const nlohmann::json &json) {
@@ -33,6 +36,8 @@ adapter_settings_ptr adapter_settings_factory::from_json(const nlohmann::json &j
 #else
                     throw unknown_protocol_error(protocol_name);
 #endif
+                case protocol_type::link:
+                    return std::make_shared<link::adapter_settings>(json);
             }
         } else
             throw unknown_protocol_error(protocol_name);
@@ -52,6 +57,9 @@ adapter_iface_ptr adapter_interface_factory::from_settings(adapter_settings_ptr
                 std::static_pointer_cast<mqtt::adapter_settings>(settings);
 
             switch (mqtt_settings->transport()) {
+                case transport_type::udp:
+                    // MQTT over UDP is served by MQTT-SN gateway
+                    return std::make_shared<mqtt::sn_gateway>(settings, message_queue);
                 case transport_type::tcp:
                     return std::make_shared<mqtt::broker<mqtt_cpp::server<>>>(settings,
                                                                               message_queue);
@@ -68,9 +76,8 @@ adapter_iface_ptr adapter_interface_factory::from_settings(adapter_settings_ptr
 #else
                 case transport_type::tls:
                 case transport_type::tls_websocket:
-#endif
-                case transport_type::udp:
                     throw adapter_transport_error(settings->name(), settings->protocol_name());
+#endif
             }
         };
         case protocol_type::dds:
@@ -88,6 +95,8 @@ adapter_iface_ptr adapter_interface_factory::from_settings(adapter_settings_ptr
 #else
             return nullptr;
 #endif
+        case protocol_type::link:
+            return std::make_shared<link::bridge>(settings, message_queue);
     }
 }
 
@@ -0,0 +1,62 @@
+#include "network/chunk_store.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "core/log.hpp"
+
+namespace octopus_mq {
+
+payload_chunk::payload_chunk(char *data, const std::size_t size, const bool file_backed)
+    : _data(data), _size(size), _file_backed(file_backed) {}
+
+payload_chunk::~payload_chunk() { munmap(_data, _size); }
+
+std::string_view payload_chunk::view() const { return std::string_view(_data, _size); }
+
+const std::size_t &payload_chunk::size() const { return _size; }
+
+const bool &payload_chunk::file_backed() const { return _file_backed; }
+
+void chunk_store::configure(const chunk_store_settings &settings) {
+    std::atomic_store(&_settings, std::make_shared<const chunk_store_settings>(settings));
+    _threshold.store(settings.threshold, std::memory_order_relaxed);
+}
+
+bool chunk_store::large(const std::size_t size) {
+    const std::size_t threshold = _threshold.load(std::memory_order_relaxed);
+    return threshold != 0 and size >= threshold;
+}
+
+payload_chunk_ptr chunk_store::store(const char *data, const std::size_t size) {
+    const chunk_store_settings_ptr settings = std::atomic_load(&_settings);
+    void *mapping = MAP_FAILED;
+    bool file_backed = false;
+    if (not settings->directory.empty()) {
+        // File has no name and disappears with its last mapping
+        const int fd = open(settings->directory.c_str(), O_TMPFILE | O_RDWR, 0600);
+        if (fd >= 0 and ftruncate(fd, size) == 0) {
+            mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            file_backed = (mapping != MAP_FAILED);
+        }
+        if (fd >= 0) close(fd);
+        if (not file_backed)
+            log::print(log_type::warning, "chunk store: cannot map file in '" +
+                                              settings->directory + "': " + strerror(errno) + '.');
+    }
+    if (mapping == MAP_FAILED)
+        mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) return nullptr;
+
+    std::memcpy(mapping, data, size);
+    // Payload is only read from now on, sequentially, by each adapter
+    mprotect(mapping, size, PROT_READ);
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    return std::make_shared<const payload_chunk>(static_cast<char *>(mapping), size, file_backed);
+}
+
+}  // namespace octopus_mq
@@ -0,0 +1,80 @@
+#ifndef OCTOMQ_CHUNK_STORE_H_
+#define OCTOMQ_CHUNK_STORE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace octopus_mq {
+
+using std::string;
+
+namespace chunk_store_config {
+
+    namespace field_name {
+
+        constexpr char chunk_store[] = "chunk_store";
+        constexpr char threshold[] = "threshold";
+        constexpr char directory[] = "directory";
+
+    }  // namespace field_name
+
+    namespace constants {
+
+        constexpr std::size_t default_threshold = 0x100000;  // 1 MB
+
+    }  // namespace constants
+
+}  // namespace chunk_store_config
+
+struct chunk_store_settings {
+    std::size_t threshold = chunk_store_config::constants::default_threshold;  // Zero disables
+    string directory;  // Anonymous memory is mapped when empty
+};
+
+using chunk_store_settings_ptr = std::shared_ptr<const chunk_store_settings>;
+
+// Immutable payload in a memory mapping of its own. File-backed chunks live in an unlinked
+// temporary file, so the kernel could write their pages out under memory pressure instead
+// of keeping them resident.
+class payload_chunk {
+    char *_data;
+    std::size_t _size;
+    bool _file_backed;
+
+   public:
+    payload_chunk(char *data, const std::size_t size, const bool file_backed);
+    payload_chunk(const payload_chunk &) = delete;
+    payload_chunk &operator=(const payload_chunk &) = delete;
+    ~payload_chunk();
+
+    std::string_view view() const;
+    const std::size_t &size() const;
+    const bool &file_backed() const;
+};
+
+using payload_chunk_ptr = std::shared_ptr<const payload_chunk>;
+
+// Storage for large payloads. A payload is copied into the store once, after that all
+// adapters reference the same chunk and send directly from the mapping.
+// Settings are replaced by the control thread on reload while adapters store payloads.
+class chunk_store {
+    static inline chunk_store_settings_ptr _settings =
+        std::make_shared<const chunk_store_settings>();
+    // Copy of the threshold, checked for every message without loading the settings
+    static inline std::atomic<std::size_t> _threshold =
+        chunk_store_config::constants::default_threshold;
+
+   public:
+    static void configure(const chunk_store_settings &settings);
+
+    static bool large(const std::size_t size);  // True if payload should go to the store
+    // Returns nullptr if mapping failed, the payload should be kept in the heap then
+    static payload_chunk_ptr store(const char *data, const std::size_t size);
+};
+
+}  // namespace octopus_mq
+
+#endif
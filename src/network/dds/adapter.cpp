@@ -16,13 +16,21 @@ static octopus_mq::adapter_settings_parser adapter_settings_parser = {
 };
 
 adapter_settings::adapter_settings(const nlohmann::json &json)
-    : octopus_mq::adapter_settings(protocol_type::dds, json) {
+    : octopus_mq::adapter_settings(protocol_type::dds, json), _domain(0) {
     // Parse protocol-specific fields from JSON
     for (auto item_parser : adapter_settings_parser)
         if (auto json_item = json.find(item_parser.first); json_item != json.end())
             item_parser.second(this, json_item);
         else
             throw missing_field_error(item_parser.first);
+
+    // Parsing optional 'domain' field, peers join domain 0 by default
+    if (auto item = json.find(adapter::field_name::domain); item != json.end()) {
+        if (not item->is_number_unsigned()) throw field_type_error(adapter::field_name::domain);
+        if (item->get<std::uint64_t>() > constants::max_domain)
+            throw field_range_error(adapter::field_name::domain);
+        domain(item->get<domain_id>());
+    }
 }
 
 void adapter_settings::transport(const transport_type &transport) { _transport = transport; }
@@ -34,6 +42,10 @@ void adapter_settings::transport(const string &transport) {
         throw std::runtime_error("unsupported transport for dds adapter: " + transport);
 }
 
+void adapter_settings::domain(const domain_id domain) { _domain = domain; }
+
 const transport_type &adapter_settings::transport() const { return _transport; }
 
+const domain_id &adapter_settings::domain() const { return _domain; }
+
 }  // namespace octopus_mq::dds
\ No newline at end of file
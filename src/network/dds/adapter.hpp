@@ -13,8 +13,18 @@ namespace octopus_mq::dds {
 
 using std::string;
 
+using domain_id = uint32_t;
+
+namespace constants {
+
+    // RTPS maps domains to UDP ports, which leaves room for domains 0 to 232
+    constexpr domain_id max_domain = 232;
+
+}  // namespace constants
+
 class adapter_settings : public octopus_mq::adapter_settings {
     transport_type _transport;
+    domain_id _domain;
 
     static inline const std::map<string, transport_type> _transport_from_name = {
         { adapter::transport_name::udp, transport_type::udp },
@@ -26,8 +36,10 @@ class adapter_settings : public octopus_mq::adapter_settings {
 
     void transport(const transport_type &transport);
     void transport(const string &transport);
+    void domain(const domain_id domain);
 
     const transport_type &transport() const;
+    const domain_id &domain() const;
 };
 
 using adapter_settings_ptr = std::shared_ptr<dds::adapter_settings>;
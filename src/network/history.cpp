@@ -0,0 +1,145 @@
+#include "network/history.hpp"
+
+#include <algorithm>
+
+#include "core/error.hpp"
+#include "core/memory_budget.hpp"
+#include "core/metrics.hpp"
+
+namespace octopus_mq {
+
+history_settings::history_settings(const nlohmann::json &json) {
+    if (not json.is_array()) throw field_type_error(history_config::field_name::history);
+    for (auto &filter_json : json) {
+        if (not filter_json.is_object())
+            throw field_type_error(history_config::field_name::history);
+        auto filter = filter_json.find(history_config::field_name::filter);
+        if (filter == filter_json.end())
+            throw missing_field_error(history_config::field_name::filter);
+        if (not filter->is_string() or not scope::valid_topic_filter(filter->get<string>()))
+            throw field_type_error(history_config::field_name::filter);
+
+        history_spec spec;
+        spec.filter = topic_table::intern(filter->get<string>());
+        if (auto item = filter_json.find(history_config::field_name::messages);
+            item != filter_json.end()) {
+            if (not item->is_number_unsigned())
+                throw field_type_error(history_config::field_name::messages);
+            spec.messages = item->get<std::size_t>();
+        }
+        if (auto item = filter_json.find(history_config::field_name::seconds);
+            item != filter_json.end()) {
+            if (not item->is_number_unsigned())
+                throw field_type_error(history_config::field_name::seconds);
+            spec.age = std::chrono::seconds(item->get<unsigned>());
+        }
+        // History without any limit would grow forever
+        if (spec.messages == 0 and spec.age.count() == 0)
+            throw field_range_error(history_config::field_name::messages);
+        _filters.push_back(spec);
+    }
+}
+
+const std::vector<history_spec> &history_settings::filters() const { return _filters; }
+
+bool history_settings::empty() const { return _filters.empty(); }
+
+history::history(const history_settings &settings)
+    : _filters(settings.filters()), _last_sweep(clock::now()) {}
+
+bool history::empty() const { return _filters.empty(); }
+
+void history::trim(ring &ring, const clock::time_point now) {
+    const history_spec &spec = _filters[ring.spec];
+    auto pop = [this, &ring] {
+        _bytes -= ring.entries.front().size;
+        ring.entries.pop_front();
+    };
+    if (spec.messages != 0)
+        while (ring.entries.size() > spec.messages) pop();
+    if (spec.age.count() != 0)
+        while (not ring.entries.empty() and now - ring.entries.front().time > spec.age) pop();
+}
+
+void history::erase(const ring_iterator ring) {
+    auto range = _index.equal_range(ring->topic.hash());
+    _index.erase(std::find_if(range.first, range.second,
+                              [&ring](auto &item) { return item.second == ring; }));
+    for (auto &entry : ring->entries) _bytes -= entry.size;
+    _rings.erase(ring);
+}
+
+void history::evict() {
+    while (not _rings.empty() and
+           (_rings.size() > history_config::constants::max_topics or
+            _bytes > history_config::constants::max_bytes or memory_budget::exceeded())) {
+        erase(_rings.begin());
+        metrics::add(metric::history_evicted);
+    }
+}
+
+void history::record(const message_ptr &message) {
+    if (_filters.empty()) return;
+    const topic_handle &topic = message->interned_topic();
+    auto range = _index.equal_range(topic.hash());
+    auto iter = std::find_if(range.first, range.second,
+                             [&topic](auto &item) { return item.second->topic == topic; });
+    ring_iterator ring;
+    if (iter == range.second) {
+        auto spec = std::find_if(_filters.begin(), _filters.end(), [&topic](auto &filter) {
+            return scope::matches_filter(filter.filter, topic);
+        });
+        if (spec == _filters.end()) return;
+        ring = _rings.insert(_rings.end(), { topic,
+                                             static_cast<std::size_t>(spec - _filters.begin()),
+                                             {} });
+        _index.emplace(topic.hash(), ring);
+    } else {
+        ring = iter->second;
+        _rings.splice(_rings.end(), _rings, ring);
+    }
+    const clock::time_point now = clock::now();
+    const std::size_t size = message->payload().size();
+    ring->entries.push_back({ message, now, size });
+    _bytes += size;
+    trim(*ring, now);
+    evict();
+}
+
+std::vector<message_ptr> history::replay(const topic_handle &filter, const std::size_t count) {
+    std::vector<const entry *> entries;
+    const clock::time_point now = clock::now();
+    for (auto &ring : _rings) {
+        if (not scope::matches_filter(filter, ring.topic)) continue;
+        trim(ring, now);
+        const std::size_t skipped =
+            (count != 0 and ring.entries.size() > count) ? ring.entries.size() - count : 0;
+        for (auto iter = ring.entries.begin() + skipped; iter != ring.entries.end(); ++iter)
+            entries.push_back(&*iter);
+    }
+    // Each ring is in order already, stable sort keeps it for messages with equal times
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const entry *a, const entry *b) { return a->time < b->time; });
+
+    std::vector<message_ptr> messages;
+    messages.reserve(entries.size());
+    for (auto item : entries) messages.push_back(item->message);
+    return messages;
+}
+
+void history::sweep() {
+    evict();
+    const clock::time_point now = clock::now();
+    if (_filters.empty() or now - _last_sweep < history_config::constants::sweep_interval) return;
+    _last_sweep = now;
+    for (auto iter = _rings.begin(); iter != _rings.end();) {
+        trim(*iter, now);
+        // Topic gets its ring back with the next message
+        if (iter->entries.empty())
+            erase(iter++);
+        else
+            ++iter;
+    }
+}
+
+}  // namespace octopus_mq
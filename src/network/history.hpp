@@ -0,0 +1,112 @@
+#ifndef OCTOMQ_HISTORY_H_
+#define OCTOMQ_HISTORY_H_
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "json.hpp"
+#include "network/message.hpp"
+#include "network/topic.hpp"
+
+namespace octopus_mq {
+
+using std::string;
+
+namespace history_config {
+
+    namespace field_name {
+
+        constexpr char history[] = "history";
+        constexpr char filter[] = "filter";
+        constexpr char messages[] = "messages";
+        constexpr char seconds[] = "seconds";
+
+    }  // namespace field_name
+
+    namespace constants {
+
+        // MQTT v5 user property of SUBSCRIBE requesting replay, its value is the number of
+        // messages per topic, empty value replays all of them
+        constexpr char user_property[] = "history";
+        constexpr std::chrono::seconds sweep_interval = std::chrono::seconds(1);
+        // Limits of all history kept by an adapter, as topics are not known in advance
+        constexpr std::size_t max_topics = 0x10000;
+        constexpr std::size_t max_bytes = 0x4000000;  // 64 MB of payloads
+
+    }  // namespace constants
+
+}  // namespace history_config
+
+// Length of history kept for each topic matching the filter, zero is unlimited
+struct history_spec {
+    topic_handle filter;
+    std::size_t messages = 0;
+    std::chrono::seconds age = std::chrono::seconds(0);
+};
+
+// Optional 'history' field of an MQTT broker adapter, a list of topic filters.
+// A topic uses the first filter it matches.
+class history_settings {
+    std::vector<history_spec> _filters;
+
+   public:
+    history_settings() = default;
+    explicit history_settings(const nlohmann::json &json);
+
+    const std::vector<history_spec> &filters() const;
+    bool empty() const;
+};
+
+// Last messages of each topic matching a configured filter, so late joiners could catch up.
+// Rings hold references to messages shared with the rest of the node, payloads are not
+// copied and stay charged to the memory budget while they are kept. Rings of the least
+// recently recorded topics are evicted when history exceeds its limits and while the memory
+// budget is exceeded, so kept messages never hold publishers back. Not thread safe.
+class history {
+    using clock = std::chrono::steady_clock;
+
+    struct entry {
+        message_ptr message;
+        clock::time_point time;
+        std::size_t size;  // Payload size counted in _bytes
+    };
+    struct ring {
+        topic_handle topic;
+        std::size_t spec;           // Index of the filter
+        std::deque<entry> entries;  // Oldest first
+    };
+
+    using ring_iterator = std::list<ring>::iterator;
+
+    std::vector<history_spec> _filters;
+    std::list<ring> _rings;  // Least recently recorded first
+    std::unordered_multimap<std::uint64_t, ring_iterator> _index;  // Topic hash -> ring
+    std::size_t _bytes = 0;  // Payloads of all entries
+    clock::time_point _last_sweep;
+
+    void trim(ring &ring, const clock::time_point now);
+    void erase(const ring_iterator ring);
+    void evict();
+
+   public:
+    explicit history(const history_settings &settings = history_settings());
+
+    bool empty() const;
+    // Appends the message to the ring of its topic if the topic matches a filter
+    void record(const message_ptr &message);
+    // Returns last 'count' messages of each topic matching the filter, zero returns all.
+    // Messages of different topics are merged in the order they were recorded.
+    std::vector<message_ptr> replay(const topic_handle &filter, const std::size_t count);
+    // Drops expired messages of idle topics, at most once per sweep interval. Rings are
+    // evicted right away while the memory budget is exceeded.
+    void sweep();
+};
+
+}  // namespace octopus_mq
+
+#endif
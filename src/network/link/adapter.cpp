@@ -0,0 +1,88 @@
+#include "network/link/adapter.hpp"
+
+#include "core/error.hpp"
+#include "core/log.hpp"
+
+namespace octopus_mq::link {
+
+static octopus_mq::adapter_settings_parser adapter_settings_parser = {
+    { adapter::field_name::role,
+      [](octopus_mq::adapter_settings *self, const adapter_settings_parser_item &item) {
+          if (item->is_string()) {
+              std::string role_str = item->get<string>();
+              static_cast<adapter_settings *>(self)->role(role_str);
+              static_cast<adapter_settings *>(self)->name_append(role_str);
+          } else
+              throw field_type_error(adapter::field_name::role);
+      } }
+};
+
+adapter_settings::adapter_settings(const nlohmann::json &json)
+    : octopus_mq::adapter_settings(protocol_type::link, json),
+      _role(mqtt::adapter_role::broker),
+      _compression(compression::none),
+      _window(constants::default_window) {
+    // Parse protocol-specific fields from JSON
+    for (auto item_parser : adapter_settings_parser)
+        if (auto json_item = json.find(item_parser.first); json_item != json.end())
+            item_parser.second(this, json_item);
+        else
+            throw missing_field_error(item_parser.first);
+
+    // Parsing 'remote' field, which is mandatory for clients only
+    if (auto item = json.find(adapter::field_name::remote); item != json.end()) {
+        if (not item->is_string()) throw field_type_error(adapter::field_name::remote);
+        _remote_address = address(item->get<string>());
+        if (_remote_address.ip() == network::constants::null_ip or
+            _remote_address.port() == network::constants::null_port)
+            throw field_range_error(adapter::field_name::remote);
+    } else if (_role == mqtt::adapter_role::client)
+        throw missing_field_error(adapter::field_name::remote);
+
+    // Parsing optional 'compression' and 'window' fields
+    if (auto item = json.find(adapter::field_name::compression); item != json.end()) {
+        if (not item->is_string()) throw field_type_error(adapter::field_name::compression);
+        compression(item->get<string>());
+    }
+    if (auto item = json.find(adapter::field_name::window); item != json.end()) {
+        if (not item->is_number_unsigned()) throw field_type_error(adapter::field_name::window);
+        _window = item->get<std::uint32_t>();
+        if (_window == 0) throw field_range_error(adapter::field_name::window);
+    }
+}
+
+void adapter_settings::role(const mqtt::adapter_role &role) { _role = role; }
+
+void adapter_settings::role(const string &role) {
+    if (auto iter = _role_from_name.find(role); iter != _role_from_name.end())
+        _role = iter->second;
+    else
+        throw std::runtime_error("unknown link adapter role: " + role);
+}
+
+void adapter_settings::remote_address(const address &remote_address) {
+    _remote_address = remote_address;
+}
+
+void adapter_settings::compression(const link::compression &compression) {
+    _compression = compression;
+}
+
+void adapter_settings::compression(const string &compression) {
+    if (auto iter = _compression_from_name.find(compression); iter != _compression_from_name.end())
+        _compression = iter->second;
+    else
+        throw std::runtime_error("unsupported compression for link adapter: " + compression);
+}
+
+void adapter_settings::window(const std::uint32_t window) { _window = window; }
+
+const mqtt::adapter_role &adapter_settings::role() const { return _role; }
+
+const address &adapter_settings::remote_address() const { return _remote_address; }
+
+const link::compression &adapter_settings::compression() const { return _compression; }
+
+const std::uint32_t &adapter_settings::window() const { return _window; }
+
+}  // namespace octopus_mq::link
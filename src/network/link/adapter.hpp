@@ -0,0 +1,66 @@
+#ifndef OCTOMQ_LINK_ADAPTER_H_
+#define OCTOMQ_LINK_ADAPTER_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "network/adapter.hpp"
+#include "network/network.hpp"
+
+namespace octopus_mq::link {
+
+using std::string;
+
+enum class compression { none, lz4, zstd };
+
+namespace constants {
+
+    constexpr std::uint32_t default_window = 1024;  // messages in flight without a credit grant
+
+}  // namespace constants
+
+// Settings of octopusMQ-to-octopusMQ link adapter.
+// In broker role adapter accepts links from other nodes, in client role it connects to 'remote'.
+class adapter_settings : public octopus_mq::adapter_settings {
+    mqtt::adapter_role _role;
+    address _remote_address;  // is used only when adapter is in client mode
+    link::compression _compression;
+    std::uint32_t _window;
+
+    static inline const std::map<string, mqtt::adapter_role> _role_from_name = {
+        { adapter::role_name::broker, mqtt::adapter_role::broker },
+        { adapter::role_name::client, mqtt::adapter_role::client }
+    };
+
+    static inline const std::map<string, link::compression> _compression_from_name = {
+        { adapter::compression_name::none, compression::none },
+#ifdef OCTOMQ_ENABLE_LZ4
+        { adapter::compression_name::lz4, compression::lz4 },
+#endif
+#ifdef OCTOMQ_ENABLE_ZSTD
+        { adapter::compression_name::zstd, compression::zstd },
+#endif
+    };
+
+   public:
+    adapter_settings(const nlohmann::json &json);
+
+    void role(const mqtt::adapter_role &role);
+    void role(const string &role);
+    void remote_address(const address &remote_address);
+    void compression(const link::compression &compression);
+    void compression(const string &compression);
+    void window(const std::uint32_t window);
+
+    const mqtt::adapter_role &role() const;
+    const address &remote_address() const;
+    const link::compression &compression() const;
+    const std::uint32_t &window() const;
+};
+
+using adapter_settings_ptr = std::shared_ptr<adapter_settings>;
+
+}  // namespace octopus_mq::link
+
+#endif
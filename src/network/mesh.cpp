@@ -0,0 +1,96 @@
+#include "network/mesh.hpp"
+
+#include <algorithm>
+#include <random>
+
+namespace octopus_mq {
+
+// splitmix64 finalizer, a cheap bijective 64-bit mixer
+static inline std::uint64_t mix(std::uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+void node::id(const node_id id) {
+    if (id != mesh::constants::null_node)
+        _id = id;
+    else {
+        std::random_device random_device;
+        std::uniform_int_distribution<node_id> distribution(1);
+        _id = distribution(random_device);
+    }
+}
+
+const node_id &node::id() {
+    if (_id == mesh::constants::null_node) id(mesh::constants::null_node);
+    return _id;
+}
+
+message_hash node::next_hash() {
+    // Mixing node id with a local sequence number gives hashes unique across the mesh
+    // with overwhelming probability. Zero is reserved for "not stamped".
+    message_hash hash = mix(id() ^ mix(++_sequence));
+    return hash == mesh::constants::null_hash ? 1 : hash;
+}
+
+duplicate_filter::duplicate_filter(const std::size_t size, const std::chrono::seconds window)
+    : _capacity(std::max<std::size_t>(size, 1)),
+      _inserted(0),
+      _window(window),
+      _rotated(std::chrono::steady_clock::now()) {
+    // Tables have a power of two slots to index them with a mask, at least twice the capacity
+    // so that probe sequences stay short
+    std::size_t slots = 2;
+    while (slots < 2 * _capacity) slots <<= 1;
+    _mask = slots - 1;
+    _current.assign(slots, mesh::constants::null_hash);
+    _previous.assign(slots, mesh::constants::null_hash);
+}
+
+void duplicate_filter::rotate() {
+    std::swap(_current, _previous);
+    std::fill(_current.begin(), _current.end(), mesh::constants::null_hash);
+    _inserted = 0;
+    _rotated = std::chrono::steady_clock::now();
+}
+
+bool duplicate_filter::find(const generation &table, const message_hash hash) const {
+    // Linear probing ends at the first free slot, entries are never removed from a generation
+    for (std::size_t index = mix(hash) & _mask;; index = (index + 1) & _mask) {
+        if (table[index] == hash) return true;
+        if (table[index] == mesh::constants::null_hash) return false;
+    }
+}
+
+void duplicate_filter::put(generation &table, const message_hash hash) {
+    std::size_t index = mix(hash) & _mask;
+    while (table[index] != mesh::constants::null_hash) index = (index + 1) & _mask;
+    table[index] = hash;
+}
+
+void duplicate_filter::expire() {
+    const auto elapsed = std::chrono::steady_clock::now() - _rotated;
+    if (elapsed < _window) return;
+    // After two windows without messages the previous generation is outdated as well
+    if (elapsed >= 2 * _window) rotate();
+    rotate();
+}
+
+bool duplicate_filter::contains(const message_hash hash) {
+    // Null hash is not a stamp, so it cannot be told apart from other messages
+    if (hash == mesh::constants::null_hash) return false;
+    expire();
+    return find(_current, hash) or find(_previous, hash);
+}
+
+void duplicate_filter::insert(const message_hash hash) {
+    if (hash == mesh::constants::null_hash) return;
+    expire();
+    if (_inserted >= _capacity) rotate();
+    put(_current, hash);
+    ++_inserted;
+}
+
+}  // namespace octopus_mq
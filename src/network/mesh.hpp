@@ -0,0 +1,90 @@
+#ifndef OCTOMQ_MESH_H_
+#define OCTOMQ_MESH_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace octopus_mq {
+
+using node_id = std::uint64_t;
+using message_hash = std::uint64_t;
+
+namespace mesh {
+
+    namespace field_name {
+
+        constexpr char mesh[] = "mesh";
+        constexpr char node_id[] = "node_id";
+        constexpr char filter_size[] = "filter_size";
+        constexpr char filter_window[] = "filter_window";
+
+    }  // namespace field_name
+
+    namespace constants {
+
+        constexpr node_id null_node = 0;
+        constexpr message_hash null_hash = 0;
+        constexpr std::size_t default_filter_size = 0x40000;  // hashes per generation (4 MB)
+        constexpr std::chrono::seconds default_filter_window = std::chrono::seconds(30);
+
+    }  // namespace constants
+
+}  // namespace mesh
+
+struct mesh_settings {
+    node_id id = mesh::constants::null_node;
+    std::size_t filter_size = mesh::constants::default_filter_size;
+    std::chrono::seconds filter_window = mesh::constants::default_filter_window;
+};
+
+// Identity of this octopusMQ instance within the mesh.
+// Every message entering the mesh through this node is stamped with the node id and a hash,
+// which is unique across the mesh and is preserved by all node-to-node adapters.
+class node {
+    static inline node_id _id = mesh::constants::null_node;
+    static inline std::atomic<std::uint64_t> _sequence = 0;
+
+   public:
+    static void id(const node_id id);
+    static const node_id &id();
+
+    static message_hash next_hash();
+};
+
+// Exact set of message hashes seen during the last time window, so a message is never taken
+// for a duplicate it is not. Two generations of fixed size open addressing tables are kept:
+// lookups check both, insertions go to the current one. Current generation becomes the
+// previous one when the window expires or when it is full, so memory stays bounded regardless
+// of message rate. Not thread-safe.
+class duplicate_filter {
+    using generation = std::vector<message_hash>;  // Null hash marks a free slot
+
+    generation _current;
+    generation _previous;
+    std::size_t _mask;
+    std::size_t _capacity;  // Hashes per generation, tables are kept at most half full
+    std::size_t _inserted;
+    std::chrono::steady_clock::duration _window;
+    std::chrono::steady_clock::time_point _rotated;
+
+    void rotate();
+    // Rotates if the window of the current generation expired, twice if the previous one did
+    void expire();
+    bool find(const generation &table, const message_hash hash) const;
+    void put(generation &table, const message_hash hash);
+
+   public:
+    duplicate_filter(const std::size_t size = mesh::constants::default_filter_size,
+                     const std::chrono::seconds window = mesh::constants::default_filter_window);
+
+    // Returns true if hash was inserted during the last one or two windows
+    bool contains(const message_hash hash);
+    // Remembers the hash, it must not be contained already
+    void insert(const message_hash hash);
+};
+
+}  // namespace octopus_mq
+
+#endif
@@ -1,59 +1,251 @@
 #include "network/message.hpp"
 
 #include "core/error.hpp"
+#include "core/memory_budget.hpp"
+
+#include <algorithm>
 
 namespace octopus_mq {
 
-message::message(message_payload &&payload) : _payload(move(payload)) {}
+static_assert(sizeof(message) <= 64, "message header should fit one cache line");
 
-message::message(message_payload &&payload, const string &origin_client_id)
-    : _payload(move(payload)), _origin_client_id(origin_client_id), _origin_pubopts(0) {}
+message::message(message_payload &&payload) {
+    this->payload(payload.data(), payload.size());
+}
 
-message::message(message_payload &&payload, const string &topic, const uint8_t pubopts,
+message::message(message_payload &&payload, const string &origin_client_id) {
+    origin(origin_client_id);
+    this->payload(payload.data(), payload.size());
+}
+
+message::message(message_payload &&payload, const topic_handle &topic, const uint8_t pubopts,
                  const mqtt::version &version, const mqtt_cpp::v5::properties &props)
-    : _payload(move(payload)),
-      _topic(topic),
-      _mqtt_version(version),
-      _origin_pubopts(pubopts),
-      _origin_props(props) {}
+    : _topic(topic), _origin_pubopts(pubopts), _mqtt_version(version) {
+    this->props(props);
+    this->payload(payload.data(), payload.size());
+}
+
+message::message(message_payload &&payload, const uint8_t pubopts) : _origin_pubopts(pubopts) {
+    this->payload(payload.data(), payload.size());
+}
+
+transcoded_payload::transcoded_payload(const payload_format format,
+                                       std::optional<message_payload> &&payload,
+                                       std::shared_ptr<const transcoded_payload> next)
+    : format(format), payload(move(payload)), next(move(next)) {
+    if (this->payload) memory_budget::acquire(this->payload->capacity());
+}
+
+transcoded_payload::~transcoded_payload() {
+    if (payload) memory_budget::release(payload->capacity());
+}
+
+message::~message() {
+    memory_budget::release(_accounted);
+    delete _details.load(std::memory_order_acquire);
+}
+
+void message::account() {
+    // File-backed chunks are paged by the kernel and are not charged
+    const message_details *details = existing_details();
+    const bool charged = details and details->chunk and not details->chunk->file_backed();
+    const std::size_t size =
+        sizeof(message) + _payload_size + (charged ? details->chunk->size() : 0);
+    if (size == _accounted) return;
+    memory_budget::acquire(size);
+    memory_budget::release(_accounted);
+    _accounted = static_cast<std::uint32_t>(size);
+}
 
-message::message(message_payload &&payload, const uint8_t pubopts)
-    : _payload(move(payload)), _origin_pubopts(pubopts) {}
+const message_details *message::existing_details() const {
+    return _details.load(std::memory_order_acquire);
+}
 
-void message::payload(const message_payload &payload) { _payload = payload; }
+message_details &message::details() {
+    message_details *details = _details.load(std::memory_order_acquire);
+    if (details) return *details;
+    auto created = std::make_unique<message_details>();
+    // Another thread could have allocated them meanwhile, its details are used then
+    if (_details.compare_exchange_strong(details, created.get(), std::memory_order_acq_rel))
+        return *created.release();
+    return *details;
+}
 
-void message::payload(message_payload &&payload) { _payload = move(payload); }
+void message::payload(const message_payload &payload) {
+    this->payload(payload.data(), payload.size());
+}
 
-void message::topic(const string &topic) { _topic = topic; }
+void message::payload(message_payload &&payload) { this->payload(payload.data(), payload.size()); }
+
+void message::payload(const char *data, const std::size_t size) {
+    payload_chunk_ptr chunk = chunk_store::large(size) ? chunk_store::store(data, size) : nullptr;
+    if (chunk) {
+        _payload.reset();
+        _payload_size = 0;
+    } else {
+        _payload.reset(size != 0 ? new char[size] : nullptr);
+        std::copy_n(data, size, _payload.get());
+        _payload_size = static_cast<std::uint32_t>(size);
+    }
+    if (chunk or existing_details()) details().chunk = move(chunk);
+    account();
+}
 
-void message::origin(const string &origin_client_id) { _origin_client_id = origin_client_id; }
+void message::topic(const string &topic) { _topic = topic_table::intern(topic); }
+
+void message::topic(const topic_handle &topic) { _topic = topic; }
+
+void message::origin(const string &origin_client_id) {
+    if (not origin_client_id.empty())
+        details().origin_client_id = std::make_shared<const string>(origin_client_id);
+    else if (existing_details())
+        details().origin_client_id.reset();
+}
 
 void message::pubopts(const uint8_t pubopts) { _origin_pubopts = pubopts; }
 
-void message::props(const mqtt_cpp::v5::properties &props) { _origin_props = props; }
+void message::props(const mqtt_cpp::v5::properties &props) { this->props(encode_props(props)); }
+
+void message::props(const property_block &props) {
+    const bool empty = not props or props->empty();
+    if (empty and not existing_details()) return;
+    message_details &details = this->details();
+    details.origin_props = empty ? nullptr : props;
+    std::atomic_store(&details.decoded_props, decoded_properties());
+}
 
 void message::mqtt_version(const mqtt::version version) { _mqtt_version = version; }
 
-const message_payload &message::payload() const { return _payload; }
+void message::stamp(const node_id origin_node, const message_hash hash) {
+    _origin_node = origin_node;
+    _hash = hash;
+}
+
+void message::priority(const priority_lane priority) { _priority = priority; }
 
-const string &message::topic() const { return _topic; }
+void message::wal_sequence(const std::uint64_t sequence) {
+    if (sequence != 0 or existing_details()) details().wal_sequence = sequence;
+}
 
-const string &message::origin() const { return _origin_client_id; }
+void message::hold() { details().holds.fetch_add(1, std::memory_order_relaxed); }
+
+bool message::release() {
+    message_details *details = _details.load(std::memory_order_acquire);
+    return details and details->holds.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+
+std::string_view message::payload() const {
+    if (_payload_size != 0) return std::string_view(_payload.get(), _payload_size);
+    const message_details *details = existing_details();
+    return (details and details->chunk) ? details->chunk->view() : std::string_view();
+}
+
+const string &message::topic() const { return _topic.name(); }
+
+const topic_handle &message::interned_topic() const { return _topic; }
+
+const string &message::origin() const {
+    static const string empty;
+    const message_details *details = existing_details();
+    return (details and details->origin_client_id) ? *details->origin_client_id : empty;
+}
 
 const uint8_t &message::pubopts() const { return _origin_pubopts; }
 
-const mqtt_cpp::v5::properties &message::props() const { return _origin_props; }
+const mqtt_cpp::v5::properties &message::props() const {
+    static const mqtt_cpp::v5::properties empty;
+    const message_details *details = existing_details();
+    if (not details or not details->origin_props) return empty;
+    decoded_properties decoded = std::atomic_load(&details->decoded_props);
+    if (decoded) return *decoded;
+    // Adapters could decode concurrently, the first decoded properties are kept
+    decoded_properties cached;
+    decoded = std::make_shared<const mqtt_cpp::v5::properties>(
+        decode_props(details->origin_props));
+    if (std::atomic_compare_exchange_strong(&details->decoded_props, &cached, decoded))
+        return *decoded;
+    return *cached;
+}
+
+const property_block &message::raw_props() const {
+    static const property_block none;
+    const message_details *details = existing_details();
+    return details ? details->origin_props : none;
+}
 
 const mqtt::version &message::mqtt_version() const { return _mqtt_version; }
 
+const node_id &message::origin_node() const { return _origin_node; }
+
+const message_hash &message::hash() const { return _hash; }
+
+uint8_t message::qos() const {
+    // QoS occupies bits 1-2 of publish options
+    return (_origin_pubopts >> 1) & 0x03;
+}
+
+const priority_lane &message::priority() const { return _priority; }
+
+const std::uint64_t &message::wal_sequence() const {
+    static const std::uint64_t none = 0;
+    const message_details *details = existing_details();
+    return details ? details->wal_sequence : none;
+}
+
+bool message::stamped() const { return _hash != mesh::constants::null_hash; }
+
+transcoded_ptr message::transcoded(const payload_format format) const {
+    const message_details *details = existing_details();
+    if (not details) return nullptr;
+    for (transcoded_ptr item = std::atomic_load(&details->transcoded); item; item = item->next)
+        if (item->format == format) return item;
+    return nullptr;
+}
+
+transcoded_ptr message::transcoded(const payload_format format,
+                                   std::optional<message_payload> &&payload) {
+    message_details &details = this->details();
+    auto item = std::make_shared<transcoded_payload>(format, move(payload),
+                                                     std::atomic_load(&details.transcoded));
+    transcoded_ptr head = item->next;
+    while (
+        not std::atomic_compare_exchange_weak(&details.transcoded, &head, transcoded_ptr(item))) {
+        // Conversions added meanwhile could include one to the same format
+        for (transcoded_ptr other = head; other != item->next; other = other->next)
+            if (other->format == format) return other;
+        item->next = head;
+    }
+    return item;
+}
+
+property_block message::encode_props(const mqtt_cpp::v5::properties &props) {
+    if (props.empty()) return nullptr;
+    std::vector<boost::asio::const_buffer> buffers;
+    std::size_t size = 0;
+    for (auto const &prop : props) {
+        size += mqtt_cpp::v5::size(prop);
+        mqtt_cpp::v5::add_const_buffer_sequence(buffers, prop);
+    }
+    auto block = std::make_shared<string>();
+    block->reserve(size);
+    for (auto const &buffer : buffers)
+        block->append(static_cast<const char *>(buffer.data()), buffer.size());
+    return block;
+}
+
+mqtt_cpp::v5::properties message::decode_props(const property_block &props) {
+    if (not props) return mqtt_cpp::v5::properties();
+    return mqtt_cpp::v5::property::parse(mqtt_cpp::buffer(std::string_view(*props), props));
+}
+
 scope::scope() : _is_global_wildcard(true) {}
 
 scope::scope(const string &scope_string) : _is_global_wildcard(false) {
     if (scope_string == hash_sign)
         _is_global_wildcard = true;
     else {
-        if (topic_tokens tokens = tokenize_topic_filter(scope_string); not tokens.empty())
-            _scope.push_back(tokens);
+        if (valid_topic_filter(scope_string))
+            _scope.push_back(topic_table::intern(scope_string));
         else
             throw invalid_topic_filter(scope_string);
     }
@@ -65,8 +257,8 @@ scope::scope(const std::vector<string> &scope_vector) : _is_global_wildcard(fals
             _is_global_wildcard = true;
             break;
         }
-        if (topic_tokens tokens = tokenize_topic_filter(scope_string); not tokens.empty())
-            _scope.push_back(tokens);
+        if (valid_topic_filter(scope_string))
+            _scope.push_back(topic_table::intern(scope_string));
         else
             throw invalid_topic_filter(scope_string);
     }
@@ -107,33 +299,7 @@ scope::topic_tokens scope::tokenize_topic_filter(const string &topic_filter) {
     return tokens;
 }
 
-scope::topic_tokens scope::tokenize_topic(const string &topic) {
-    const topic_tokens empty;
-    topic_tokens tokens;
-
-    // If topic is empty, return empty vector
-    if (topic.empty()) return empty;
-
-    // If topic contains "#" or "+" it may be a topic filter, but not a topic.
-    // Return empty vector
-    if (topic.find_first_of(hash_sign[0]) != string::npos or
-        topic.find_first_of(plus_sign[0]) != string::npos)
-        return empty;
-
-    for (size_t first = 0; first <= topic.size();) {
-        size_t second = topic.find_first_of(slash_sign[0], first);
-        // first has index of start of token
-        // second has index of end of token + 1;
-        if (second == string::npos) second = topic.size();
-        string token = topic.substr(first, second - first);
-        tokens.push_back(token);
-        first = second + 1;
-    }
-
-    return tokens;
-}
-
-bool scope::compare_topics(const topic_tokens &filter, const topic_tokens &topic) {
+bool scope::compare_topics(const topic_tokens_view &filter, const topic_tokens_view &topic) {
     if (filter.size() == 1 and filter.front() == hash_sign) return true;
     if (filter.size() > topic.size()) return false;
 
@@ -144,24 +310,27 @@ bool scope::compare_topics(const topic_tokens &filter, const topic_tokens &topic
         else
             break;
     }
-    if (i < topic.size() and filter[i] != hash_sign) return false;
+    if (i < topic.size() and (i >= filter.size() or filter[i] != hash_sign)) return false;
     return true;
 }
 
 bool scope::includes(const string &topic) const {
     if (_is_global_wildcard) return true;
+    for (auto &filter : _scope)
+        if (matches_filter(filter.name(), topic)) return true;
+    return false;
+}
 
-    topic_tokens topic_tokens = tokenize_topic(topic);
-    if (topic_tokens.empty()) return false;
+bool scope::includes(const topic_handle &topic) const {
+    if (_is_global_wildcard) return true;
+    // Topic containing "#" or "+" may be a topic filter, but not a topic
+    if (topic.empty() or topic.wildcard()) return false;
 
-    bool match = false;
     // Loop over all topic filters and find matching
-    for (auto &filter_tokens : _scope) {
-        match = compare_topics(filter_tokens, topic_tokens);
-        if (match) break;
-    }
+    for (auto &filter : _scope)
+        if (compare_topics(filter.tokens(), topic.tokens())) return true;
 
-    return match;
+    return false;
 }
 
 bool scope::valid_topic_filter(const std::string_view &topic_filter) {
@@ -174,12 +343,32 @@ bool scope::valid_topic_filter(const std::string_view &topic_filter) {
 
 bool scope::matches_filter(const std::string_view &filter, const std::string_view &topic) {
     if (filter == hash_sign) return true;
+    // Same rules as compare_topics(), levels are compared in place so nothing is interned
+    if (filter.empty() or topic.empty() or topic.find_first_of("#+") != std::string_view::npos)
+        return false;
+    if (std::count(filter.begin(), filter.end(), slash_sign[0]) >
+        std::count(topic.begin(), topic.end(), slash_sign[0]))
+        return false;
+
+    for (std::size_t filter_first = 0, topic_first = 0;;) {
+        const std::size_t filter_second =
+            std::min(filter.find(slash_sign[0], filter_first), filter.size());
+        const std::size_t topic_second =
+            std::min(topic.find(slash_sign[0], topic_first), topic.size());
+        const std::string_view filter_level =
+            filter.substr(filter_first, filter_second - filter_first);
+        if (filter_level != topic.substr(topic_first, topic_second - topic_first) and
+            filter_level != plus_sign)
+            return filter_level == hash_sign;
+        if (filter_second == filter.size()) return topic_second == topic.size();
+        filter_first = filter_second + 1;
+        topic_first = topic_second + 1;
+    }
+}
 
-    topic_tokens filter_tokens = tokenize_topic_filter(std::string(filter));
-    topic_tokens topic_tokens = tokenize_topic(std::string(topic));
-
-    if (filter_tokens.empty() or topic_tokens.empty()) return false;
-    return compare_topics(filter_tokens, topic_tokens);
+bool scope::matches_filter(const topic_handle &filter, const topic_handle &topic) {
+    if (filter.empty() or topic.empty() or topic.wildcard()) return false;
+    return compare_topics(filter.tokens(), topic.tokens());
 }
 
 }  // namespace octopus_mq
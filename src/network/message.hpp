@@ -1,8 +1,13 @@
 #ifndef OCTOMQ_MESSAGE_H_
 #define OCTOMQ_MESSAGE_H_
 
+#include <atomic>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #define MQTT_STD_OPTIONAL
@@ -11,7 +16,11 @@
 #define MQTT_STD_ANY
 #define MQTT_NS mqtt_cpp
 
+#include "network/chunk_store.hpp"
+#include "network/mesh.hpp"
 #include "network/network.hpp"
+#include "network/topic.hpp"
+#include "mqtt/property_parse.hpp"
 #include "mqtt/property_variant.hpp"
 
 namespace octopus_mq {
@@ -19,46 +28,123 @@ namespace octopus_mq {
 using std::string;
 
 using message_payload = std::vector<char>;
+using priority_lane = std::uint8_t;  // 0 is the highest priority, see priority.hpp
+// Encoded MQTT v5 property block without its length, immutable once shared by messages
+using property_block = std::shared_ptr<const string>;
+
+// Payload of a message converted to another format, see message::transcoded().
+// Converted payloads are charged to the memory budget while they are cached.
+struct transcoded_payload {
+    payload_format format;
+    std::optional<message_payload> payload;  // Empty if the message could not be converted
+    std::shared_ptr<const transcoded_payload> next;  // Conversion to another format
+
+    transcoded_payload(const payload_format format, std::optional<message_payload> &&payload,
+                       std::shared_ptr<const transcoded_payload> next);
+    transcoded_payload(const transcoded_payload &) = delete;
+    transcoded_payload &operator=(const transcoded_payload &) = delete;
+    ~transcoded_payload();
+};
+
+using transcoded_ptr = std::shared_ptr<const transcoded_payload>;
+using decoded_properties = std::shared_ptr<const mqtt_cpp::v5::properties>;
+
+// Fields of a message which most messages don't have, see message
+struct message_details {
+    payload_chunk_ptr chunk;  // Large payloads are kept in the chunk store instead of inline
+    property_block origin_props;  // Copy-on-write, decoded only by adapters that need it
+    mutable decoded_properties decoded_props;  // Accessed atomically, decoded on first use
+    std::shared_ptr<const string> origin_client_id;
+    transcoded_ptr transcoded;  // Accessed atomically, adapters convert the payload concurrently
+    std::uint64_t wal_sequence = 0;  // Entry in the write-ahead log, zero if it is not logged
+    // The queue and adapters which have not handed the logged message off yet
+    std::atomic<std::uint32_t> holds = 0;
+};
 
+// Header of a message fits one cache line with the fields read while routing. Rarely used ones
+// are kept in details allocated on first use, messages without properties, origin client id,
+// conversions or log entry don't pay for them.
 class message {
-    message_payload
-        _payload;  // Only the actual message without flags and properties of any protocol
-    string _topic;
-    string _origin_client_id;
-    mqtt::version _mqtt_version;
-    uint8_t _origin_pubopts;
-    mqtt_cpp::v5::properties _origin_props;
+    topic_handle _topic;
+    // Only the actual message without flags and properties of any protocol
+    std::unique_ptr<char[]> _payload;
+    node_id _origin_node = mesh::constants::null_node;  // Node where message entered the mesh
+    message_hash _hash = mesh::constants::null_hash;    // Mesh-wide unique message hash
+    // Created once, adapters could add conversions to a message without details concurrently
+    std::atomic<message_details *> _details = nullptr;
+    std::uint32_t _payload_size = 0;
+    std::uint32_t _accounted = 0;  // Bytes charged to the memory budget
+    uint8_t _origin_pubopts = 0;
+    mqtt::version _mqtt_version = mqtt::version::v3;
+    // Assigned by the global queue, the lowest one until then
+    priority_lane _priority = std::numeric_limits<priority_lane>::max();
+
+    void account();
+    const message_details *existing_details() const;  // Null if no details were set
+    message_details &details();                         // Allocates them if needed
 
    public:
     explicit message(message_payload &&payload);
     message(const message_payload &payload) = delete;
     message(message_payload &&payload, const string &origin_client_id);
-    message(message_payload &&payload, const string &topic, const uint8_t pubopts,
+    message(message_payload &&payload, const topic_handle &topic, const uint8_t pubopts,
             const mqtt::version &version = mqtt::version::v3,
             const mqtt_cpp::v5::properties &props = mqtt_cpp::v5::properties());
     message(message_payload &&payload, const uint8_t pubopts);
+    message(const message &) = delete;
+    message &operator=(const message &) = delete;
+    ~message();
 
     void payload(const message_payload &payload);
     void payload(message_payload &&payload);
+    void payload(const char *data, const std::size_t size);  // Large ones go to chunk store
     void topic(const string &topic);
+    void topic(const topic_handle &topic);
     void origin(const string &origin_client_id);
     void pubopts(const uint8_t pubopts);
-    void props(const mqtt_cpp::v5::properties &props);
+    void props(const mqtt_cpp::v5::properties &props);  // Encodes the properties
+    void props(const property_block &props);            // Shares the encoded ones
     void mqtt_version(const mqtt::version version);
+    void stamp(const node_id origin_node, const message_hash hash);
+    void priority(const priority_lane priority);
+    void wal_sequence(const std::uint64_t sequence);
+    void hold();
+    bool release();  // Returns true if the last hold was released
 
-    const message_payload &payload() const;
+    std::string_view payload() const;
     const string &topic() const;
+    const topic_handle &interned_topic() const;
     const string &origin() const;
     const uint8_t &pubopts() const;
+    uint8_t qos() const;
+    // Decoded on first call and kept with the message, prefer raw_props() to pass them on
     const mqtt_cpp::v5::properties &props() const;
+    const property_block &raw_props() const;
     const mqtt::version &mqtt_version() const;
+    const node_id &origin_node() const;
+    const message_hash &hash() const;
+    const priority_lane &priority() const;
+    const std::uint64_t &wal_sequence() const;
+    bool stamped() const;
+
+    // Returns conversion of the payload to the format, null if it was not converted yet.
+    // Conversions are cached, so adapters sending the same format convert a message once.
+    transcoded_ptr transcoded(const payload_format format) const;
+    // Caches the conversion, returns the cached one if another thread was first
+    transcoded_ptr transcoded(const payload_format format,
+                              std::optional<message_payload> &&payload);
+
+    // Returns null for empty properties
+    static property_block encode_props(const mqtt_cpp::v5::properties &props);
+    // Decoded binary and string properties keep the block alive
+    static mqtt_cpp::v5::properties decode_props(const property_block &props);
 };
 
 using message_ptr = std::shared_ptr<message>;
 
 class scope {
     using topic_tokens = std::vector<string>;
-    std::vector<topic_tokens> _scope;
+    std::vector<topic_handle> _scope;
     bool _is_global_wildcard;
 
     static inline const char hash_sign[2] = { '#', 0 };
@@ -66,8 +152,7 @@ class scope {
     static inline const char slash_sign[2] = { '/', 0 };
 
     static topic_tokens tokenize_topic_filter(const string &topic_filter);
-    static topic_tokens tokenize_topic(const string &topic);
-    static bool compare_topics(const topic_tokens &filter, const topic_tokens &topic);
+    static bool compare_topics(const topic_tokens_view &filter, const topic_tokens_view &topic);
 
    public:
     scope();
@@ -75,9 +160,12 @@ class scope {
     scope(const std::vector<string> &scope_vector);
 
     bool includes(const string &topic) const;
+    bool includes(const topic_handle &topic) const;
 
     static bool valid_topic_filter(const std::string_view &topic_filter);
     static bool matches_filter(const std::string_view &filter, const std::string_view &topic);
+    // Filter must be a valid topic filter, see valid_topic_filter()
+    static bool matches_filter(const topic_handle &filter, const topic_handle &topic);
 };
 
 }  // namespace octopus_mq
@@ -27,13 +27,84 @@ static octopus_mq::adapter_settings_parser adapter_settings_parser = {
 };
 
 adapter_settings::adapter_settings(const nlohmann::json &json)
-    : octopus_mq::adapter_settings(protocol_type::mqtt, json) {
+    : octopus_mq::adapter_settings(protocol_type::mqtt, json), _max_packet_size(0),
+      _deliver_once(false),
+      _conflation(0) {
     // Parse protocol-specific fields from JSON
     for (auto item_parser : adapter_settings_parser)
         if (auto json_item = json.find(item_parser.first); json_item != json.end())
             item_parser.second(this, json_item);
         else
             throw missing_field_error(item_parser.first);
+
+    // Parsing optional 'predefined_topics' field
+    if (json.contains(adapter::field_name::predefined_topics)) {
+        if (_transport != transport_type::udp)
+            throw field_encapsulated_error(adapter::field_name::predefined_topics,
+                                           "predefined topics require udp transport");
+        predefined_topics(json[adapter::field_name::predefined_topics]);
+    }
+
+    // Parsing optional 'rate_limits' field
+    if (auto item = json.find(rate_limit_config::field_name::rate_limits); item != json.end()) {
+        if (_transport == transport_type::udp or _role != adapter_role::broker)
+            throw field_encapsulated_error(rate_limit_config::field_name::rate_limits,
+                                           "rate limits require broker role and tcp transport");
+        rate_limits(*item);
+    }
+
+    // Parsing optional 'max_packet_size' field
+    if (auto item = json.find(adapter::field_name::max_packet_size); item != json.end()) {
+        if (not item->is_number_unsigned())
+            throw field_type_error(adapter::field_name::max_packet_size);
+        if (item->get<std::uint64_t>() > 0xffffffff)
+            throw field_range_error(adapter::field_name::max_packet_size);
+        max_packet_size(item->get<std::uint32_t>());
+    }
+
+    // Parsing optional 'admission' field
+    if (auto item = json.find(admission_config::field_name::admission); item != json.end()) {
+        if (_transport == transport_type::udp or _role != adapter_role::broker)
+            throw field_encapsulated_error(admission_config::field_name::admission,
+                                           "admission control requires broker role and tcp "
+                                           "transport");
+        admission(*item);
+    }
+
+    // Parsing optional 'deliver_once' field
+    if (auto item = json.find(adapter::field_name::deliver_once); item != json.end()) {
+        if (_transport == transport_type::udp or _role != adapter_role::broker)
+            throw field_encapsulated_error(adapter::field_name::deliver_once,
+                                           "deliver once requires broker role and tcp transport");
+        if (not item->is_boolean()) throw field_type_error(adapter::field_name::deliver_once);
+        deliver_once(item->get<bool>());
+    }
+
+    // Parsing optional 'conflation' field
+    if (auto item = json.find(adapter::field_name::conflation); item != json.end()) {
+        if (_transport == transport_type::udp or _role != adapter_role::broker)
+            throw field_encapsulated_error(adapter::field_name::conflation,
+                                           "conflation requires broker role and tcp transport");
+        if (not item->is_number_unsigned())
+            throw field_type_error(adapter::field_name::conflation);
+        conflation(std::chrono::milliseconds(item->get<std::uint32_t>()));
+    }
+
+    // Parsing optional 'history' field
+    if (auto item = json.find(history_config::field_name::history); item != json.end()) {
+        if (_transport == transport_type::udp or _role != adapter_role::broker)
+            throw field_encapsulated_error(history_config::field_name::history,
+                                           "history requires broker role and tcp transport");
+        history(*item);
+    }
+
+    // Parsing optional 'transcoding' field
+    if (auto item = json.find(transcoding_config::field_name::transcoding); item != json.end()) {
+        if (_transport == transport_type::udp or _role != adapter_role::broker)
+            throw field_encapsulated_error(transcoding_config::field_name::transcoding,
+                                           "transcoding requires broker role and tcp transport");
+        transcoding(*item);
+    }
 }
 
 void adapter_settings::transport(const transport_type &transport) { _transport = transport; }
@@ -54,8 +125,91 @@ void adapter_settings::role(const string &role) {
         throw std::runtime_error("unknown mqtt adapter role: " + role);
 }
 
+void adapter_settings::predefined_topics(const nlohmann::json &json) {
+    // Expected format: { "1": "topic/name", "2": "other/topic/name" }
+    if (not json.is_object()) throw field_type_error(adapter::field_name::predefined_topics);
+    _predefined_topics.clear();
+    for (auto &item : json.items()) {
+        unsigned long id = 0;
+        try {
+            id = std::stoul(item.key());
+        } catch (const std::exception &) {
+            throw field_type_error(adapter::field_name::predefined_topics);
+        }
+        if (id == 0 or id >= 0xffff)
+            throw field_range_error(adapter::field_name::predefined_topics);
+        if (not item.value().is_string() or
+            not scope::valid_topic_filter(item.value().get<string>()) or
+            item.value().get<string>().find_first_of("#+") != string::npos)
+            throw field_type_error(adapter::field_name::predefined_topics);
+        _predefined_topics[static_cast<topic_id>(id)] = item.value().get<string>();
+    }
+}
+
+void adapter_settings::max_packet_size(const std::uint32_t max_packet_size) {
+    _max_packet_size = max_packet_size;
+}
+
+void adapter_settings::admission(const nlohmann::json &json) {
+    if (not json.is_object()) throw field_type_error(admission_config::field_name::admission);
+    _admission = admission_settings();
+    using namespace admission_config;
+    for (auto [field, value] :
+         { std::make_pair(field_name::max_connections, &_admission.max_connections),
+           std::make_pair(field_name::connect_batch, &_admission.connect_batch) }) {
+        if (auto item = json.find(field); item != json.end()) {
+            if (not item->is_number_unsigned()) throw field_type_error(field);
+            *value = item->get<std::size_t>();
+        }
+    }
+    for (auto [field, value] :
+         { std::make_pair(field_name::accept_rate, &_admission.accept_rate),
+           std::make_pair(field_name::accept_burst, &_admission.accept_burst) }) {
+        if (auto item = json.find(field); item != json.end()) {
+            if (not item->is_number()) throw field_type_error(field);
+            *value = item->get<double>();
+            if (*value < 0) throw field_range_error(field);
+        }
+    }
+    if (_admission.accept_burst <= 0) throw field_range_error(field_name::accept_burst);
+}
+
+void adapter_settings::deliver_once(const bool deliver_once) { _deliver_once = deliver_once; }
+
+void adapter_settings::conflation(const std::chrono::milliseconds conflation) {
+    _conflation = conflation;
+}
+
+void adapter_settings::history(const nlohmann::json &json) { _history = history_settings(json); }
+
+void adapter_settings::transcoding(const nlohmann::json &json) {
+    _transcoding = transcoding_settings(json);
+}
+
+void adapter_settings::rate_limits(const nlohmann::json &json) {
+    _rate_limits = rate_limit_settings(json);
+}
+
 const transport_type &adapter_settings::transport() const { return _transport; }
 
 const adapter_role &adapter_settings::role() const { return _role; }
 
+const mqtt::predefined_topics &adapter_settings::predefined_topics() const {
+    return _predefined_topics;
+}
+
+const rate_limit_settings &adapter_settings::rate_limits() const { return _rate_limits; }
+
+const std::uint32_t &adapter_settings::max_packet_size() const { return _max_packet_size; }
+
+const admission_settings &adapter_settings::admission() const { return _admission; }
+
+const bool &adapter_settings::deliver_once() const { return _deliver_once; }
+
+const std::chrono::milliseconds &adapter_settings::conflation() const { return _conflation; }
+
+const history_settings &adapter_settings::history() const { return _history; }
+
+const transcoding_settings &adapter_settings::transcoding() const { return _transcoding; }
+
 }  // namespace octopus_mq::mqtt
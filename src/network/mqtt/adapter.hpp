@@ -1,22 +1,105 @@
 #ifndef OCTOMQ_MQTT_ADAPTER_H_
 #define OCTOMQ_MQTT_ADAPTER_H_
 
+#include <chrono>
 #include <list>
 #include <map>
 #include <memory>
 #include <string>
 
 #include "network/adapter.hpp"
+#include "network/history.hpp"
 #include "network/network.hpp"
+#include "network/rate_limit.hpp"
+#include "network/transcoding.hpp"
 
 namespace octopus_mq::mqtt {
 
 using std::string;
 
+namespace packet_names {
+
+    constexpr char connect[] = "connect";
+    constexpr char connack[] = "connack";
+    constexpr char publish[] = "publish";
+    constexpr char puback[] = "puback";
+    constexpr char pubrec[] = "pubrec";
+    constexpr char pubrel[] = "pubrel";
+    constexpr char pubcomp[] = "pubcomp";
+    constexpr char subscribe[] = "subscribe";
+    constexpr char suback[] = "suback";
+    constexpr char unsubscribe[] = "unsubscribe";
+    constexpr char unsuback[] = "unsuback";
+    constexpr char pingreq[] = "pingreq";
+    constexpr char pingresp[] = "pingresp";
+    constexpr char disconnect[] = "disconnect";
+    // MQTT-SN only
+    constexpr char searchgw[] = "searchgw";
+    constexpr char gwinfo[] = "gwinfo";
+    constexpr char reg[] = "register";
+    constexpr char regack[] = "regack";
+
+}  // namespace packet_names
+
+namespace admission_config {
+
+    namespace field_name {
+
+        constexpr char admission[] = "admission";
+        constexpr char max_connections[] = "max_connections";
+        constexpr char accept_rate[] = "accept_rate";
+        constexpr char accept_burst[] = "accept_burst";
+        constexpr char connect_batch[] = "connect_batch";
+
+    }  // namespace field_name
+
+    namespace constants {
+
+        constexpr std::size_t default_connect_batch = 16;  // CONNECTs per io_context handler
+        constexpr std::size_t default_preallocated = 256;  // Contexts without max_connections
+        constexpr std::size_t max_preallocated = 4096;
+
+    }  // namespace constants
+
+}  // namespace admission_config
+
+namespace conflation_config {
+
+    namespace constants {
+
+        // MQTT v5 user property of SUBSCRIBE setting the conflation interval of its topic
+        // filters in milliseconds, zero delivers every message
+        constexpr char user_property[] = "conflate";
+
+    }  // namespace constants
+
+}  // namespace conflation_config
+
+// Limits for accepting new connections of an MQTT broker
+struct admission_settings {
+    std::size_t max_connections = 0;  // Zero is unlimited
+    double accept_rate = 0;           // Connections per second, zero is unlimited
+    double accept_burst = 1.0;        // Seconds of accept rate
+    // CONNECT packets handled per io_context handler, zero handles them inline
+    std::size_t connect_batch = admission_config::constants::default_connect_batch;
+};
+
+using topic_id = std::uint16_t;
+using predefined_topics = std::map<topic_id, string>;
+
 class adapter_settings : public octopus_mq::adapter_settings {
     transport_type _transport;
     address _remote_address;  // is used only when adapter is in client mode
     adapter_role _role;
+    mqtt::predefined_topics _predefined_topics;  // is used only by MQTT-SN gateway (udp transport)
+    rate_limit_settings _rate_limits;            // is used only by MQTT broker (tcp transports)
+    std::uint32_t _max_packet_size;              // Zero is unlimited
+    admission_settings _admission;
+    bool _deliver_once;  // One copy per connection when its subscriptions overlap
+    // Subscriptions get the latest message per topic at most once per interval, zero is off
+    std::chrono::milliseconds _conflation;
+    history_settings _history;  // Topics whose last messages are kept for late subscribers
+    transcoding_settings _transcoding;  // Payload formats of clients
 
     static inline const std::map<string, adapter_role> _role_from_name = {
         { adapter::role_name::broker, adapter_role::broker },
@@ -24,6 +107,7 @@ class adapter_settings : public octopus_mq::adapter_settings {
     };
 
     static inline const std::map<string, transport_type> _transport_from_name = {
+        { adapter::transport_name::udp, transport_type::udp },
         { adapter::transport_name::tcp, transport_type::tcp },
         { adapter::transport_name::websocket, transport_type::websocket },
 #ifdef OCTOMQ_ENABLE_TLS
@@ -39,9 +123,25 @@ class adapter_settings : public octopus_mq::adapter_settings {
     void transport(const string &transport);
     void role(const adapter_role &role);
     void role(const string &role);
+    void predefined_topics(const nlohmann::json &json);
+    void rate_limits(const nlohmann::json &json);
+    void max_packet_size(const std::uint32_t max_packet_size);
+    void admission(const nlohmann::json &json);
+    void deliver_once(const bool deliver_once);
+    void conflation(const std::chrono::milliseconds conflation);
+    void history(const nlohmann::json &json);
+    void transcoding(const nlohmann::json &json);
 
     const transport_type &transport() const;
     const adapter_role &role() const;
+    const mqtt::predefined_topics &predefined_topics() const;
+    const rate_limit_settings &rate_limits() const;
+    const std::uint32_t &max_packet_size() const;
+    const admission_settings &admission() const;
+    const bool &deliver_once() const;
+    const std::chrono::milliseconds &conflation() const;
+    const history_settings &history() const;
+    const transcoding_settings &transcoding() const;
 };
 
 using adapter_settings_ptr = std::shared_ptr<adapter_settings>;
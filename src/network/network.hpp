@@ -9,7 +9,7 @@ namespace octopus_mq {
 
 using std::string;
 
-enum class protocol_type { mqtt, dds };
+enum class protocol_type { mqtt, dds, link };
 
 enum class tx_type { unicast, multicast, broadcast };
 
@@ -17,6 +17,8 @@ enum class transport_type { udp, tcp, tls, websocket, tls_websocket };
 
 enum class network_event_type { send, receive };
 
+enum class payload_format : std::uint8_t { json, cbor, msgpack };
+
 using port_int = uint32_t;
 
 using ip_int = uint32_t;
@@ -44,7 +46,7 @@ namespace mqtt {
 
     enum class adapter_role { broker, client };
 
-    enum class version { v3, v5 };
+    enum class version : std::uint8_t { v3, v5 };
 
 }  // namespace mqtt
 
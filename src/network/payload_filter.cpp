@@ -0,0 +1,455 @@
+#include "network/payload_filter.hpp"
+
+#include <array>
+#include <charconv>
+#include <cstring>
+
+#include "core/error.hpp"
+
+namespace octopus_mq {
+
+namespace {
+
+    using value = payload_filter::value;
+    using field_mask = std::uint32_t;  // Bit per field of the filter
+
+    static_assert(payload_filter_config::constants::max_fields <= sizeof(field_mask) * 8,
+                  "field mask is too narrow");
+
+    inline bool is_space(const char c) {
+        return c == ' ' or c == '\t' or c == '\r' or c == '\n';
+    }
+
+    inline bool is_name(const char c) {
+        return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9') or
+               c == '_' or c == '-' or c == '$';
+    }
+
+    // Parses a number of the payload or the expression, returns position past it or nullptr
+    const char *parse_number(const char *first, const char *last, double &number) {
+        auto [end, ec] = std::from_chars(first, last, number);
+        return (ec == std::errc() and end != first) ? end : nullptr;
+    }
+
+    // Finds values of the filter fields in a JSON payload. Only objects on the paths of the
+    // fields are parsed, anything else is skipped. Scanning stops once all fields are found.
+    class scanner {
+        const char *_pos;
+        const char *const _end;
+        const std::vector<std::vector<string>> &_fields;
+        value *const _values;
+        field_mask _missing;  // Fields not found yet
+
+        void skip_space() {
+            while (_pos != _end and is_space(*_pos)) ++_pos;
+        }
+
+        bool consume(const char c) {
+            skip_space();
+            if (_pos == _end or *_pos != c) return false;
+            ++_pos;
+            return true;
+        }
+
+        // Moves past the closing quote of the string starting at the current position.
+        // Quotes are found with memchr, which is vectorized by the C library.
+        bool skip_string() {
+            const char *first = ++_pos;
+            for (;;) {
+                auto quote = static_cast<const char *>(std::memchr(_pos, '"', _end - _pos));
+                if (quote == nullptr) return false;
+                _pos = quote + 1;
+                // Quote is escaped if an odd number of backslashes precedes it
+                std::size_t backslashes = 0;
+                for (; quote != first and *(quote - 1) == '\\'; --quote) ++backslashes;
+                if (backslashes % 2 == 0) return true;
+            }
+        }
+
+        // Moves past the object or the array starting at the current position, only brackets
+        // and strings are looked at
+        bool skip_container() {
+            std::size_t depth = 0;
+            while (_pos != _end) {
+                switch (*_pos) {
+                    case '"':
+                        if (not skip_string()) return false;
+                        continue;
+                    case '{':
+                    case '[':
+                        ++depth;
+                        break;
+                    case '}':
+                    case ']':
+                        if (--depth == 0) {
+                            ++_pos;
+                            return true;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+                ++_pos;
+            }
+            return false;
+        }
+
+        bool parse_value(value &result) {
+            skip_space();
+            if (_pos == _end) return false;
+            switch (*_pos) {
+                case '"': {
+                    const char *first = _pos + 1;
+                    if (not skip_string()) return false;
+                    result.type = value::kind::string;
+                    result.text = std::string_view(first, _pos - 1 - first);
+                    return true;
+                }
+                case '{':
+                case '[':
+                    result.type = value::kind::structured;
+                    return skip_container();
+                case 't':
+                case 'f':
+                case 'n': {
+                    const char *first = _pos;
+                    while (_pos != _end and is_name(*_pos)) ++_pos;
+                    const std::string_view word(first, _pos - first);
+                    if (word == "null")
+                        result.type = value::kind::null;
+                    else if (word == "true" or word == "false") {
+                        result.type = value::kind::boolean;
+                        result.boolean = word == "true";
+                    } else
+                        return false;
+                    return true;
+                }
+                default:
+                    _pos = parse_number(_pos, _end, result.number);
+                    result.type = value::kind::number;
+                    return _pos != nullptr;
+            }
+        }
+
+        // Candidates are fields whose first 'depth' names lead to the object
+        bool scan_object(const field_mask candidates, const std::size_t depth) {
+            if (depth > payload_filter_config::constants::max_depth or not consume('{'))
+                return false;
+            if (consume('}')) return true;
+            do {
+                skip_space();
+                if (_pos == _end or *_pos != '"') return false;
+                const char *first = _pos + 1;
+                if (not skip_string()) return false;
+                const std::string_view key(first, _pos - 1 - first);
+                if (not consume(':')) return false;
+
+                field_mask next = 0, targets = 0;
+                for (std::size_t i = 0; i < _fields.size(); ++i)
+                    if ((candidates >> i & 1) and _fields[i].size() > depth and
+                        _fields[i][depth] == key) {
+                        next |= field_mask(1) << i;
+                        if (_fields[i].size() == depth + 1) targets |= field_mask(1) << i;
+                    }
+                skip_space();
+                if (_pos == _end) return false;
+                if (next == 0) {
+                    value skipped;
+                    if (not parse_value(skipped)) return false;
+                } else if (next != targets and *_pos == '{') {
+                    // Object is a field itself and leads to other fields
+                    value structured;
+                    structured.type = value::kind::structured;
+                    found(targets, structured);
+                    if (not scan_object(next & ~targets, depth + 1)) return false;
+                } else {
+                    value result;
+                    if (not parse_value(result)) return false;
+                    found(targets, result);
+                }
+                if (_missing == 0) return true;
+            } while (consume(','));
+            return consume('}');
+        }
+
+        void found(const field_mask targets, const value &result) {
+            for (std::size_t i = 0; i < _fields.size(); ++i)
+                if (targets >> i & 1) _values[i] = result;
+            _missing &= ~targets;
+        }
+
+       public:
+        scanner(const std::string_view &payload, const std::vector<std::vector<string>> &fields,
+                value *values)
+            : _pos(payload.data()),
+              _end(payload.data() + payload.size()),
+              _fields(fields),
+              _values(values),
+              _missing(fields.size() == sizeof(field_mask) * 8
+                           ? ~field_mask(0)
+                           : (field_mask(1) << fields.size()) - 1) {}
+
+        // Payloads which are not JSON objects leave all fields missing
+        void scan() {
+            if (not scan_object(_missing, 0))
+                for (std::size_t i = 0; i < _fields.size(); ++i) _values[i] = value();
+        }
+    };
+
+}  // namespace
+
+// Recursive descent parser emitting the postfix program
+class payload_filter::compiler {
+    payload_filter &_filter;
+    const char *_pos;
+    const char *const _end;
+    std::size_t _depth = 0;  // Evaluation stack depth at the current instruction
+
+    [[noreturn]] void fail(const string &what) const {
+        const std::size_t position = _pos - _filter._expression.data();
+        throw filter_syntax_error(_filter._expression,
+                                  what + " at position " + std::to_string(position));
+    }
+
+    void skip_space() {
+        while (_pos != _end and is_space(*_pos)) ++_pos;
+    }
+
+    bool accept(const std::string_view &token) {
+        skip_space();
+        if (std::string_view(_pos, _end - _pos).substr(0, token.size()) != token) return false;
+        _pos += token.size();
+        return true;
+    }
+
+    void emit(const opcode op, const std::size_t field = 0, const std::size_t literal = 0) {
+        switch (op) {
+            case opcode::logical_and:
+            case opcode::logical_or:
+                --_depth;
+                break;
+            case opcode::logical_not:
+                break;
+            default:
+                if (++_depth > payload_filter_config::constants::max_stack)
+                    fail("expression is too complex");
+        }
+        _filter._program.push_back(
+            { op, static_cast<std::uint8_t>(field), static_cast<std::uint16_t>(literal) });
+    }
+
+    void expression() {
+        conjunction();
+        while (accept("||")) {
+            conjunction();
+            emit(opcode::logical_or);
+        }
+    }
+
+    void conjunction() {
+        unary();
+        while (accept("&&")) {
+            unary();
+            emit(opcode::logical_and);
+        }
+    }
+
+    void unary() {
+        if (accept("!")) {
+            unary();
+            emit(opcode::logical_not);
+        } else if (accept("(")) {
+            expression();
+            if (not accept(")")) fail("expected ')'");
+        } else
+            comparison();
+    }
+
+    void comparison() {
+        const std::size_t field = path();
+        opcode op;
+        if (accept("=="))
+            op = opcode::eq;
+        else if (accept("!="))
+            op = opcode::ne;
+        else if (accept("<="))
+            op = opcode::le;
+        else if (accept(">="))
+            op = opcode::ge;
+        else if (accept("<"))
+            op = opcode::lt;
+        else if (accept(">"))
+            op = opcode::gt;
+        else {
+            emit(opcode::test, field);
+            return;
+        }
+        emit(op, field, literal());
+    }
+
+    std::size_t path() {
+        std::vector<string> names;
+        skip_space();
+        for (;;) {
+            const char *first = _pos;
+            while (_pos != _end and is_name(*_pos)) ++_pos;
+            if (_pos == first) fail("expected field name");
+            names.emplace_back(first, _pos - first);
+            if (_pos == _end or *_pos != '.') break;
+            ++_pos;
+        }
+
+        auto &fields = _filter._fields;
+        for (std::size_t i = 0; i < fields.size(); ++i)
+            if (fields[i] == names) return i;
+        if (fields.size() == payload_filter_config::constants::max_fields)
+            fail("too many fields");
+        fields.push_back(std::move(names));
+        return fields.size() - 1;
+    }
+
+    std::size_t literal() {
+        skip_space();
+        if (_pos == _end) fail("expected value");
+        value result;
+        if (*_pos == '"') {
+            const char *first = ++_pos;
+            for (; _pos != _end and *_pos != '"'; ++_pos)
+                if (*_pos == '\\' and _pos + 1 != _end) ++_pos;
+            if (_pos == _end) fail("unterminated string");
+            result.type = value::kind::string;
+            result.text = _filter._strings.emplace_back(first, _pos - first);
+            ++_pos;
+        } else if (accept("true")) {
+            result.type = value::kind::boolean;
+            result.boolean = true;
+        } else if (accept("false"))
+            result.type = value::kind::boolean;
+        else if (accept("null"))
+            result.type = value::kind::null;
+        else {
+            result.type = value::kind::number;
+            const char *end = parse_number(_pos, _end, result.number);
+            if (end == nullptr) fail("expected value");
+            _pos = end;
+        }
+        _filter._literals.push_back(result);
+        return _filter._literals.size() - 1;
+    }
+
+   public:
+    explicit compiler(payload_filter &filter)
+        : _filter(filter),
+          _pos(filter._expression.data()),
+          _end(filter._expression.data() + filter._expression.size()) {}
+
+    void compile() {
+        if (_filter._expression.size() > payload_filter_config::constants::max_length)
+            fail("expression is too long");
+        expression();
+        skip_space();
+        if (_pos != _end) fail("unexpected '" + string(1, *_pos) + '\'');
+    }
+};
+
+payload_filter::payload_filter(const std::string_view &expression) : _expression(expression) {
+    compiler(*this).compile();
+}
+
+const string &payload_filter::expression() const { return _expression; }
+
+bool payload_filter::compare(const opcode op, const value &field, const value &literal) {
+    if (field.type != literal.type) return op == opcode::ne;
+    switch (field.type) {
+        case value::kind::number:
+            switch (op) {
+                case opcode::eq:
+                    return field.number == literal.number;
+                case opcode::ne:
+                    return field.number != literal.number;
+                case opcode::lt:
+                    return field.number < literal.number;
+                case opcode::le:
+                    return field.number <= literal.number;
+                case opcode::gt:
+                    return field.number > literal.number;
+                case opcode::ge:
+                    return field.number >= literal.number;
+                default:
+                    return false;
+            }
+        case value::kind::string:
+            switch (op) {
+                case opcode::eq:
+                    return field.text == literal.text;
+                case opcode::ne:
+                    return field.text != literal.text;
+                case opcode::lt:
+                    return field.text < literal.text;
+                case opcode::le:
+                    return field.text <= literal.text;
+                case opcode::gt:
+                    return field.text > literal.text;
+                case opcode::ge:
+                    return field.text >= literal.text;
+                default:
+                    return false;
+            }
+        case value::kind::boolean:
+            if (op == opcode::eq) return field.boolean == literal.boolean;
+            return op == opcode::ne and field.boolean != literal.boolean;
+        default:  // Null, only equality is defined
+            return op == opcode::eq;
+    }
+}
+
+bool payload_filter::evaluate(const std::string_view &payload) const {
+    std::array<value, payload_filter_config::constants::max_fields> values;
+    scanner(payload, _fields, values.data()).scan();
+
+    std::uint64_t stack = 0;  // Bit per stack entry, top is the lowest bit
+    for (const instruction &item : _program) {
+        switch (item.op) {
+            case opcode::logical_and: {
+                const std::uint64_t top = stack & 1;
+                stack = (stack >> 1) & (top | ~std::uint64_t(1));
+                break;
+            }
+            case opcode::logical_or:
+                stack = (stack >> 1) | (stack & 1);
+                break;
+            case opcode::logical_not:
+                stack ^= 1;
+                break;
+            case opcode::test: {
+                const value &field = values[item.field];
+                const bool present = field.type != value::kind::missing and
+                                     field.type != value::kind::null and
+                                     not(field.type == value::kind::boolean and not field.boolean);
+                stack = stack << 1 | present;
+                break;
+            }
+            default:
+                stack = stack << 1 | compare(item.op, values[item.field], _literals[item.literal]);
+        }
+    }
+    return stack & 1;
+}
+
+payload_filter_ptr payload_filter_cache::get(const std::string_view &expression) {
+    auto &cached = _filters[string(expression)];
+    if (payload_filter_ptr filter = cached.lock()) return filter;
+    auto filter = std::make_shared<const payload_filter>(expression);
+    cached = filter;
+    return filter;
+}
+
+void payload_filter_cache::collect() {
+    for (auto iter = _filters.begin(); iter != _filters.end();)
+        if (iter->second.expired())
+            iter = _filters.erase(iter);
+        else
+            ++iter;
+}
+
+}  // namespace octopus_mq
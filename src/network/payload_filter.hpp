@@ -0,0 +1,102 @@
+#ifndef OCTOMQ_PAYLOAD_FILTER_H_
+#define OCTOMQ_PAYLOAD_FILTER_H_
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace octopus_mq {
+
+using std::string;
+
+namespace payload_filter_config {
+
+    namespace constants {
+
+        // MQTT v5 user property of SUBSCRIBE carrying the predicate of its topic filters
+        constexpr char user_property[] = "filter";
+        constexpr std::size_t max_length = 1024;  // Characters of an expression
+        constexpr std::size_t max_fields = 32;    // Distinct field paths of an expression
+        constexpr std::size_t max_stack = 64;     // Evaluation stack depth
+        constexpr std::size_t max_depth = 64;     // Nesting of scanned payloads
+
+    }  // namespace constants
+
+}  // namespace payload_filter_config
+
+// Predicate on JSON payloads, compiled once into a postfix program. Grammar:
+//   expression := and { '||' and }
+//   and        := unary { '&&' unary }
+//   unary      := '!' unary | '(' expression ')' | path [ operator literal ]
+//   path       := name { '.' name }
+//   operator   := '==' | '!=' | '<' | '<=' | '>' | '>='
+//   literal    := number | "string" | true | false | null
+// A path alone is true if the field is present and is neither false nor null. Comparing
+// values of different types is false, except for '!=', so messages which are not JSON or lack
+// the field do not pass 'temperature > 80'. Strings are compared without unescaping.
+//
+// Evaluation scans the payload once without building a document. Objects and arrays which
+// contain none of the referenced fields are skipped by looking only for brackets and quotes.
+class payload_filter {
+   public:
+    // Scalar of a payload or a literal, views point into the payload or the filter
+    struct value {
+        enum class kind : std::uint8_t { missing, null, boolean, number, string, structured };
+
+        kind type = kind::missing;
+        bool boolean = false;
+        double number = 0;
+        std::string_view text;
+    };
+
+   private:
+    enum class opcode : std::uint8_t { test, eq, ne, lt, le, gt, ge, logical_and, logical_or,
+                                       logical_not };
+
+    struct instruction {
+        opcode op;
+        std::uint8_t field;     // Index into _fields, unused by logical operators
+        std::uint16_t literal;  // Index into _literals, used by comparisons only
+    };
+
+    string _expression;
+    std::vector<instruction> _program;
+    std::vector<std::vector<string>> _fields;  // Path of each field split into names
+    std::vector<value> _literals;
+    std::deque<string> _strings;  // Storage of string literals, stable under growth
+
+    class compiler;
+
+    static bool compare(const opcode op, const value &field, const value &literal);
+
+   public:
+    // Throws filter_syntax_error if the expression is not valid
+    explicit payload_filter(const std::string_view &expression);
+    payload_filter(const payload_filter &) = delete;
+    payload_filter &operator=(const payload_filter &) = delete;
+
+    const string &expression() const;
+    bool evaluate(const std::string_view &payload) const;
+};
+
+using payload_filter_ptr = std::shared_ptr<const payload_filter>;
+
+// Compiled filters by expression, so subscribers using the same predicate share one program
+// and a message is evaluated once per distinct predicate. Unused filters are dropped by
+// collect(). Not thread safe.
+class payload_filter_cache {
+    std::unordered_map<string, std::weak_ptr<const payload_filter>> _filters;
+
+   public:
+    // Throws filter_syntax_error if the expression is not valid
+    payload_filter_ptr get(const std::string_view &expression);
+    void collect();
+};
+
+}  // namespace octopus_mq
+
+#endif
@@ -0,0 +1,80 @@
+#include "network/priority.hpp"
+
+#include "core/error.hpp"
+
+namespace octopus_mq {
+
+priority_class::priority_class(const string &name) : _name(name) {}
+
+priority_class::priority_class(const nlohmann::json &json) {
+    if (not json.is_object()) throw field_type_error(priority::field_name::classes);
+
+    if (auto item = json.find(priority::field_name::name); item == json.end())
+        throw missing_field_error(priority::field_name::name);
+    else if (not item->is_string())
+        throw field_type_error(priority::field_name::name);
+    else
+        _name = item->get<string>();
+
+    if (auto item = json.find(priority::field_name::topics); item != json.end()) {
+        if (item->is_string())
+            _topics = std::make_shared<const scope>(item->get<string>());
+        else if (item->is_array())
+            _topics = std::make_shared<const scope>(item->get<std::vector<string>>());
+        else
+            throw field_type_error(priority::field_name::topics);
+    }
+    if (auto item = json.find(priority::field_name::qos); item != json.end()) {
+        if (not item->is_number_unsigned()) throw field_type_error(priority::field_name::qos);
+        if (item->get<unsigned>() > 2) throw field_range_error(priority::field_name::qos);
+        _min_qos = item->get<std::uint8_t>();
+    }
+    if (not _topics and not _min_qos) throw missing_field_error(priority::field_name::topics);
+}
+
+const string &priority_class::name() const { return _name; }
+
+bool priority_class::matches(const message &message) const {
+    if (_min_qos and message.qos() < *_min_qos) return false;
+    return not _topics or _topics->includes(message.interned_topic());
+}
+
+priority_settings::priority_settings()
+    : _classes({ priority_class(string(priority::constants::default_class_name)) }),
+      _starvation_limit(priority::constants::default_starvation_limit) {}
+
+priority_settings::priority_settings(const nlohmann::json &json)
+    : _starvation_limit(priority::constants::default_starvation_limit) {
+    if (not json.is_object()) throw field_type_error(priority::field_name::priorities);
+
+    if (auto item = json.find(priority::field_name::classes); item != json.end()) {
+        if (not item->is_array()) throw field_type_error(priority::field_name::classes);
+        if (item->size() > priority::constants::max_classes)
+            throw field_range_error(priority::field_name::classes);
+        for (auto &class_json : *item) _classes.emplace_back(class_json);
+    }
+    _classes.emplace_back(string(priority::constants::default_class_name));
+
+    if (auto item = json.find(priority::field_name::starvation_limit); item != json.end()) {
+        if (not item->is_number_unsigned())
+            throw field_type_error(priority::field_name::starvation_limit);
+        _starvation_limit = item->get<std::size_t>();
+    }
+}
+
+priority_lane priority_settings::classify(const message &message) const {
+    // Default class is the last one and matches any message
+    priority_lane lane = 0;
+    while (lane + 1u < _classes.size() and not _classes[lane].matches(message)) ++lane;
+    return lane;
+}
+
+std::size_t priority_settings::lane_count() const { return _classes.size(); }
+
+const string &priority_settings::lane_name(const priority_lane lane) const {
+    return _classes[std::min<std::size_t>(lane, _classes.size() - 1)].name();
+}
+
+const std::size_t &priority_settings::starvation_limit() const { return _starvation_limit; }
+
+}  // namespace octopus_mq
@@ -0,0 +1,177 @@
+#ifndef OCTOMQ_PRIORITY_H_
+#define OCTOMQ_PRIORITY_H_
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "core/metrics.hpp"
+#include "json.hpp"
+#include "network/message.hpp"
+
+namespace octopus_mq {
+
+using std::string;
+
+namespace priority {
+
+    namespace field_name {
+
+        constexpr char priorities[] = "priorities";
+        constexpr char classes[] = "classes";
+        constexpr char name[] = "name";
+        constexpr char topics[] = "topics";
+        constexpr char qos[] = "qos";
+        constexpr char starvation_limit[] = "starvation_limit";
+
+    }  // namespace field_name
+
+    namespace constants {
+
+        constexpr std::size_t max_classes = 7;  // Configured classes, default class is added
+        constexpr std::size_t default_starvation_limit = 64;
+        constexpr char default_class_name[] = "default";
+
+    }  // namespace constants
+
+}  // namespace priority
+
+// Messages of a class are selected by topic, by QoS or by both
+class priority_class {
+    string _name;
+    std::shared_ptr<const scope> _topics;   // Any topic if not set
+    std::optional<std::uint8_t> _min_qos;  // Any QoS if not set
+
+   public:
+    explicit priority_class(const string &name);  // Default class, matches any message
+    explicit priority_class(const nlohmann::json &json);
+
+    const string &name() const;
+    bool matches(const message &message) const;
+};
+
+// Priority classes from the optional 'priorities' section, highest priority first.
+// Messages matching no configured class belong to the default class, which is always the last.
+class priority_settings {
+    std::vector<priority_class> _classes;
+    std::size_t _starvation_limit;
+
+   public:
+    priority_settings();
+    explicit priority_settings(const nlohmann::json &json);
+
+    priority_lane classify(const message &message) const;
+    std::size_t lane_count() const;
+    const string &lane_name(const priority_lane lane) const;
+    const std::size_t &starvation_limit() const;
+};
+
+using priority_settings_ptr = std::shared_ptr<const priority_settings>;
+
+// Queue with a lane per priority class. Lanes are drained by strict priority, except that a
+// non-empty lane passed over 'starvation_limit' times in a row is served next.
+// Time spent in the queue is counted per lane in the metrics. Not thread-safe.
+template <typename T>
+class priority_lanes {
+    using clock = std::chrono::steady_clock;
+
+    struct lane {
+        std::queue<std::pair<clock::time_point, T>> items;
+        std::size_t passed = 0;  // Pops from higher lanes since this lane was served
+        std::size_t messages_counter = metrics::null_counter;
+        std::size_t wait_counter = metrics::null_counter;
+    };
+
+    string _stage;  // Prefix of metric names
+    priority_settings_ptr _settings;
+    std::vector<lane> _lanes;
+    std::size_t _size = 0;
+
+   public:
+    explicit priority_lanes(const string &stage);
+
+    // Lanes removed by the new settings are merged into the last one, queued items are kept
+    void configure(const priority_settings_ptr settings);
+    void push(const priority_lane lane, T item);  // Lanes out of range go to the last one
+    bool pop(T &destination);
+    bool empty() const;
+    const std::size_t &size() const;
+};
+
+template <typename T>
+priority_lanes<T>::priority_lanes(const string &stage) : _stage(stage) {
+    configure(std::make_shared<const priority_settings>());
+}
+
+template <typename T>
+void priority_lanes<T>::configure(const priority_settings_ptr settings) {
+    if (settings == _settings) return;
+    _settings = settings;
+
+    const std::size_t count = _settings->lane_count();
+    for (std::size_t i = count; i < _lanes.size(); ++i)
+        while (not _lanes[i].items.empty()) {
+            _lanes[count - 1].items.push(std::move(_lanes[i].items.front()));
+            _lanes[i].items.pop();
+        }
+    _lanes.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const string lane_name = _stage + " lane '" + _settings->lane_name(i) + '\'';
+        _lanes[i].passed = 0;
+        _lanes[i].messages_counter = metrics::named_counter(lane_name + " messages");
+        _lanes[i].wait_counter = metrics::named_counter(lane_name + " wait (us)");
+    }
+}
+
+template <typename T>
+void priority_lanes<T>::push(const priority_lane lane, T item) {
+    const std::size_t index = std::min<std::size_t>(lane, _lanes.size() - 1);
+    _lanes[index].items.emplace(clock::now(), std::move(item));
+    ++_size;
+}
+
+template <typename T>
+bool priority_lanes<T>::pop(T &destination) {
+    if (_size == 0) return false;
+
+    // Starving lanes are served first, then the highest non-empty one
+    const std::size_t limit = _settings->starvation_limit();
+    std::size_t chosen = _lanes.size();
+    for (std::size_t i = 0; i < _lanes.size() and chosen == _lanes.size(); ++i)
+        if (not _lanes[i].items.empty() and limit != 0 and _lanes[i].passed >= limit) chosen = i;
+    for (std::size_t i = 0; i < _lanes.size() and chosen == _lanes.size(); ++i)
+        if (not _lanes[i].items.empty()) chosen = i;
+    for (std::size_t i = chosen + 1; i < _lanes.size(); ++i)
+        if (not _lanes[i].items.empty()) ++_lanes[i].passed;
+
+    lane &served = _lanes[chosen];
+    served.passed = 0;
+    const auto wait = clock::now() - served.items.front().first;
+    destination = std::move(served.items.front().second);
+    served.items.pop();
+    --_size;
+
+    metrics::add_named(served.messages_counter);
+    metrics::add_named(served.wait_counter,
+                       std::chrono::duration_cast<std::chrono::microseconds>(wait).count());
+    return true;
+}
+
+template <typename T>
+bool priority_lanes<T>::empty() const {
+    return _size == 0;
+}
+
+template <typename T>
+const std::size_t &priority_lanes<T>::size() const {
+    return _size;
+}
+
+}  // namespace octopus_mq
+
+#endif
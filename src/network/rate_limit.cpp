@@ -0,0 +1,173 @@
+#include "network/rate_limit.hpp"
+
+#include <algorithm>
+
+#include "core/error.hpp"
+#include "core/metrics.hpp"
+#include "network/message.hpp"
+
+namespace octopus_mq {
+
+token_bucket::token_bucket(const double rate, const double burst)
+    : _full_at(0),
+      _interval(static_cast<std::int64_t>(1e9 / rate)),
+      _tolerance(static_cast<std::int64_t>(burst * 1e9)) {}
+
+bool token_bucket::try_take(const std::uint64_t tokens, const std::int64_t now) {
+    std::int64_t full_at = _full_at.load(std::memory_order_relaxed);
+    std::int64_t next;
+    do {
+        next = std::max(full_at, now) + static_cast<std::int64_t>(tokens) * _interval;
+        // Full bucket takes any number of tokens, so a message larger than the burst puts it
+        // into debt instead of being refused forever
+        if (full_at > now and next - now > _tolerance) return false;
+    } while (not _full_at.compare_exchange_weak(full_at, next, std::memory_order_relaxed));
+    return true;
+}
+
+std::chrono::nanoseconds token_bucket::take(const std::uint64_t tokens, const std::int64_t now) {
+    std::int64_t full_at = _full_at.load(std::memory_order_relaxed);
+    std::int64_t next;
+    do next = std::max(full_at, now) + static_cast<std::int64_t>(tokens) * _interval;
+    while (not _full_at.compare_exchange_weak(full_at, next, std::memory_order_relaxed));
+    return std::chrono::nanoseconds(std::max<std::int64_t>(next - now - _tolerance, 0));
+}
+
+void token_bucket::give_back(const std::uint64_t tokens) {
+    _full_at.fetch_sub(static_cast<std::int64_t>(tokens) * _interval, std::memory_order_relaxed);
+}
+
+rate_limit::rate_limit(const rate_limit_spec &spec) {
+    if (spec.messages > 0) _messages = std::make_unique<token_bucket>(spec.messages, spec.burst);
+    if (spec.bytes > 0) _bytes = std::make_unique<token_bucket>(spec.bytes, spec.burst);
+}
+
+bool rate_limit::try_take(const std::size_t bytes, const std::int64_t now) {
+    if (_messages and not _messages->try_take(1, now)) return false;
+    if (_bytes and not _bytes->try_take(bytes, now)) {
+        if (_messages) _messages->give_back(1);
+        return false;
+    }
+    return true;
+}
+
+std::chrono::nanoseconds rate_limit::take(const std::size_t bytes, const std::int64_t now) {
+    std::chrono::nanoseconds delay(0);
+    if (_messages) delay = std::max(delay, _messages->take(1, now));
+    if (_bytes) delay = std::max(delay, _bytes->take(bytes, now));
+    return delay;
+}
+
+void rate_limit::give_back(const std::size_t bytes) {
+    if (_messages) _messages->give_back(1);
+    if (_bytes) _bytes->give_back(bytes);
+}
+
+rate_limit_spec rate_limit_settings::parse_spec(const nlohmann::json &json, const string &field) {
+    if (not json.is_object()) throw field_type_error(field);
+    rate_limit_spec spec;
+    for (auto [name, value] : { std::make_pair(rate_limit_config::field_name::messages,
+                                               &spec.messages),
+                                std::make_pair(rate_limit_config::field_name::bytes, &spec.bytes),
+                                std::make_pair(rate_limit_config::field_name::burst,
+                                               &spec.burst) }) {
+        if (auto item = json.find(name); item != json.end()) {
+            if (not item->is_number()) throw field_type_error(name);
+            *value = item->get<double>();
+            if (*value < 0) throw field_range_error(name);
+        }
+    }
+    if (spec.burst <= 0) throw field_range_error(rate_limit_config::field_name::burst);
+    return spec;
+}
+
+rate_limit_settings::rate_limit_settings() : _action(rate_limit_action::delay) {}
+
+rate_limit_settings::rate_limit_settings(const nlohmann::json &json)
+    : _action(rate_limit_action::delay) {
+    if (not json.is_object()) throw field_type_error(rate_limit_config::field_name::rate_limits);
+
+    if (auto item = json.find(rate_limit_config::field_name::action); item != json.end()) {
+        if (not item->is_string()) throw field_type_error(rate_limit_config::field_name::action);
+        if (item->get<string>() == rate_limit_config::action_name::delay)
+            _action = rate_limit_action::delay;
+        else if (item->get<string>() == rate_limit_config::action_name::reject)
+            _action = rate_limit_action::reject;
+        else
+            throw field_range_error(rate_limit_config::field_name::action);
+    }
+    if (auto item = json.find(rate_limit_config::field_name::adapter); item != json.end())
+        _adapter = parse_spec(*item, rate_limit_config::field_name::adapter);
+    if (auto item = json.find(rate_limit_config::field_name::client); item != json.end())
+        _client = parse_spec(*item, rate_limit_config::field_name::client);
+    if (auto item = json.find(rate_limit_config::field_name::topics); item != json.end()) {
+        if (not item->is_array()) throw field_type_error(rate_limit_config::field_name::topics);
+        for (auto &topic_json : *item) {
+            auto filter = topic_json.find(rate_limit_config::field_name::filter);
+            if (filter == topic_json.end())
+                throw missing_field_error(rate_limit_config::field_name::filter);
+            if (not filter->is_string() or not scope::valid_topic_filter(filter->get<string>()))
+                throw field_type_error(rate_limit_config::field_name::filter);
+            _topics.emplace_back(topic_table::intern(filter->get<string>()),
+                                 parse_spec(topic_json, rate_limit_config::field_name::topics));
+        }
+    }
+}
+
+const rate_limit_action &rate_limit_settings::action() const { return _action; }
+
+const std::optional<rate_limit_spec> &rate_limit_settings::adapter() const { return _adapter; }
+
+const std::optional<rate_limit_spec> &rate_limit_settings::client() const { return _client; }
+
+const std::vector<std::pair<topic_handle, rate_limit_spec>> &rate_limit_settings::topics() const {
+    return _topics;
+}
+
+bool rate_limit_settings::empty() const { return not _adapter and not _client and _topics.empty(); }
+
+rate_limiter::rate_limiter(const rate_limit_settings &settings)
+    : _action(settings.action()), _empty(settings.empty()), _client(settings.client()) {
+    if (settings.adapter()) _adapter = rate_limit(*settings.adapter());
+    for (auto &topic : settings.topics()) _topics.emplace_back(topic.first, topic.second);
+}
+
+rate_limit rate_limiter::client_limit() const {
+    return _client ? rate_limit(*_client) : rate_limit();
+}
+
+const rate_limit_action &rate_limiter::action() const { return _action; }
+
+bool rate_limiter::empty() const { return _empty; }
+
+bool rate_limiter::admit(rate_limit &client, const topic_handle &topic, const std::size_t bytes,
+                         std::chrono::nanoseconds &delay) {
+    delay = std::chrono::nanoseconds(0);
+    if (_empty) return true;
+
+    const std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch())
+                                 .count();
+    // Reused between calls, so checking a message does not allocate
+    thread_local std::vector<rate_limit *> limits;
+    limits.assign({ &_adapter, &client });
+    for (auto &filter : _topics)
+        if (scope::matches_filter(filter.first, topic)) limits.push_back(&filter.second);
+
+    if (_action == rate_limit_action::reject) {
+        for (std::size_t i = 0; i < limits.size(); ++i)
+            if (not limits[i]->try_take(bytes, now)) {
+                // Tokens already taken from other limits are returned
+                for (std::size_t j = 0; j < i; ++j) limits[j]->give_back(bytes);
+                metrics::add(metric::rate_limit_rejected);
+                return false;
+            }
+        return true;
+    }
+
+    for (auto limit : limits) delay = std::max(delay, limit->take(bytes, now));
+    if (delay.count() > 0) metrics::add(metric::rate_limit_delayed);
+    return true;
+}
+
+}  // namespace octopus_mq
@@ -0,0 +1,137 @@
+#ifndef OCTOMQ_RATE_LIMIT_H_
+#define OCTOMQ_RATE_LIMIT_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "json.hpp"
+#include "network/topic.hpp"
+
+namespace octopus_mq {
+
+using std::string;
+
+namespace rate_limit_config {
+
+    namespace field_name {
+
+        constexpr char rate_limits[] = "rate_limits";
+        constexpr char action[] = "action";
+        constexpr char adapter[] = "adapter";
+        constexpr char client[] = "client";
+        constexpr char topics[] = "topics";
+        constexpr char filter[] = "filter";
+        constexpr char messages[] = "messages";
+        constexpr char bytes[] = "bytes";
+        constexpr char burst[] = "burst";
+
+    }  // namespace field_name
+
+    namespace action_name {
+
+        constexpr char delay[] = "delay";
+        constexpr char reject[] = "reject";
+
+    }  // namespace action_name
+
+    namespace constants {
+
+        constexpr double default_burst = 1.0;  // seconds of sustained rate
+
+    }  // namespace constants
+
+}  // namespace rate_limit_config
+
+// Token bucket implemented as GCRA (generic cell rate algorithm): instead of a token count
+// the bucket keeps the time when it becomes full again, so taking tokens is a single
+// compare-and-swap and needs no refill timer.
+class token_bucket {
+    std::atomic<std::int64_t> _full_at;  // Steady clock, nanoseconds
+    const std::int64_t _interval;        // Nanoseconds per token
+    const std::int64_t _tolerance;       // Nanoseconds of burst
+
+   public:
+    token_bucket(const double rate, const double burst);  // tokens per second, seconds
+
+    // Takes tokens only if they are available or the bucket is full
+    bool try_take(const std::uint64_t tokens, const std::int64_t now);
+    // Takes tokens even if the bucket goes into debt, returns how long to wait until it is
+    // out of debt
+    std::chrono::nanoseconds take(const std::uint64_t tokens, const std::int64_t now);
+    void give_back(const std::uint64_t tokens);
+};
+
+// Sustained rates of a limit, zero rate is unlimited
+struct rate_limit_spec {
+    double messages = 0;  // per second
+    double bytes = 0;     // per second
+    double burst = rate_limit_config::constants::default_burst;
+};
+
+// Pair of buckets limiting messages and bytes. Default constructed limit is unlimited.
+class rate_limit {
+    std::unique_ptr<token_bucket> _messages;
+    std::unique_ptr<token_bucket> _bytes;
+
+   public:
+    rate_limit() = default;
+    explicit rate_limit(const rate_limit_spec &spec);
+
+    bool try_take(const std::size_t bytes, const std::int64_t now);  // Both buckets or none
+    std::chrono::nanoseconds take(const std::size_t bytes, const std::int64_t now);
+    void give_back(const std::size_t bytes);
+};
+
+enum class rate_limit_action { delay, reject };
+
+// Optional 'rate_limits' field of an MQTT broker adapter
+class rate_limit_settings {
+    rate_limit_action _action;
+    std::optional<rate_limit_spec> _adapter;  // All clients of the adapter together
+    std::optional<rate_limit_spec> _client;   // Each client separately
+    std::vector<std::pair<topic_handle, rate_limit_spec>> _topics;  // Each filter separately
+
+    static rate_limit_spec parse_spec(const nlohmann::json &json, const string &field);
+
+   public:
+    rate_limit_settings();
+    explicit rate_limit_settings(const nlohmann::json &json);
+
+    const rate_limit_action &action() const;
+    const std::optional<rate_limit_spec> &adapter() const;
+    const std::optional<rate_limit_spec> &client() const;
+    const std::vector<std::pair<topic_handle, rate_limit_spec>> &topics() const;
+    bool empty() const;
+};
+
+// Limits of a broker adapter. Buckets are shared by the broker thread and need no lock,
+// per client buckets are owned by the connection.
+class rate_limiter {
+    rate_limit_action _action;
+    bool _empty;
+    rate_limit _adapter;
+    std::vector<std::pair<topic_handle, rate_limit>> _topics;
+    std::optional<rate_limit_spec> _client;
+
+   public:
+    explicit rate_limiter(const rate_limit_settings &settings);
+
+    rate_limit client_limit() const;  // New limit for a connected client
+    const rate_limit_action &action() const;
+    bool empty() const;
+
+    // Takes message from all limits applying to it. Returns false if the message must be
+    // rejected, otherwise 'delay' is set to the time reading from the client should pause.
+    bool admit(rate_limit &client, const topic_handle &topic, const std::size_t bytes,
+               std::chrono::nanoseconds &delay);
+};
+
+}  // namespace octopus_mq
+
+#endif
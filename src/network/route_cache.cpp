@@ -0,0 +1,87 @@
+#include "network/route_cache.hpp"
+
+#include "core/metrics.hpp"
+
+namespace octopus_mq {
+
+route_cache::route_cache(const std::size_t capacity) : _capacity(capacity), _hand(0) {}
+
+void route_cache::compute(const topic_handle &topic, const scope_list &scopes,
+                          route_mask &destination) {
+    destination.resize(scopes.size());
+    for (std::size_t i = 0; i < scopes.size(); ++i) destination[i] = scopes[i]->includes(topic);
+}
+
+std::size_t route_cache::evict() {
+    // Slots referenced since the last pass get a second chance
+    while (_slots[_hand].referenced) {
+        _slots[_hand].referenced = false;
+        _hand = (_hand + 1) % _slots.size();
+    }
+    const std::size_t victim = _hand;
+    _hand = (_hand + 1) % _slots.size();
+
+    auto range = _index.equal_range(_slots[victim].topic.hash());
+    for (auto iter = range.first; iter != range.second; ++iter)
+        if (iter->second == victim) {
+            _index.erase(iter);
+            break;
+        }
+    metrics::add(metric::route_cache_evictions);
+    return victim;
+}
+
+void route_cache::capacity(const std::size_t capacity) {
+    _capacity = capacity;
+    invalidate();
+}
+
+const std::size_t &route_cache::capacity() const { return _capacity; }
+
+std::size_t route_cache::size() const { return _slots.size(); }
+
+void route_cache::validate(const scope_list &scopes) {
+    // Scopes are immutable and replaced as a whole, so comparing pointers is enough
+    if (scopes == _scopes) return;
+    _scopes = scopes;
+    invalidate();
+}
+
+void route_cache::invalidate() {
+    _slots.clear();
+    _index.clear();
+    _hand = 0;
+}
+
+const route_mask &route_cache::routes(const topic_handle &topic) {
+    if (_capacity == 0) {
+        compute(topic, _scopes, _uncached);
+        return _uncached;
+    }
+
+    auto range = _index.equal_range(topic.hash());
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        slot &hit = _slots[iter->second];
+        if (hit.topic == topic) {
+            hit.referenced = true;
+            metrics::add(metric::route_cache_hits);
+            return hit.routes;
+        }
+    }
+    metrics::add(metric::route_cache_misses);
+
+    std::size_t position;
+    if (_slots.size() < _capacity) {
+        position = _slots.size();
+        _slots.push_back(slot());
+    } else
+        position = evict();
+    slot &miss = _slots[position];
+    miss.topic = topic;
+    miss.referenced = false;
+    compute(topic, _scopes, miss.routes);
+    _index.emplace(topic.hash(), position);
+    return miss.routes;
+}
+
+}  // namespace octopus_mq
@@ -0,0 +1,73 @@
+#ifndef OCTOMQ_ROUTE_CACHE_H_
+#define OCTOMQ_ROUTE_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "network/message.hpp"
+#include "network/topic.hpp"
+
+namespace octopus_mq {
+
+namespace route_cache_config {
+
+    namespace field_name {
+
+        constexpr char route_cache[] = "route_cache";
+        constexpr char size[] = "size";
+
+    }  // namespace field_name
+
+    namespace constants {
+
+        constexpr std::size_t default_size = 4096;
+
+    }  // namespace constants
+
+}  // namespace route_cache_config
+
+using route_mask = std::vector<bool>;  // Element per adapter of the pool, true if scope matches
+using scope_list = std::vector<std::shared_ptr<const scope>>;  // Scopes of the adapter pool
+
+// Cache of scope evaluation results: topic -> adapters whose scopes include the topic.
+// Cached masks are only valid for the scope list they were computed for, so the cache is
+// cleared as soon as any scope of the pool changes or adapters are added or removed.
+// Entries are evicted with the CLOCK algorithm. Zero capacity disables caching.
+class route_cache {
+    struct slot {
+        topic_handle topic;
+        route_mask routes;
+        bool referenced;
+    };
+
+    std::vector<slot> _slots;
+    std::unordered_multimap<std::uint64_t, std::size_t> _index;  // Topic hash -> slot
+    std::size_t _capacity;
+    std::size_t _hand;
+    scope_list _scopes;    // Scopes the cached masks were computed for
+    route_mask _uncached;  // Result storage when caching is disabled
+
+    static void compute(const topic_handle &topic, const scope_list &scopes,
+                        route_mask &destination);
+    std::size_t evict();
+
+   public:
+    explicit route_cache(const std::size_t capacity = route_cache_config::constants::default_size);
+
+    void capacity(const std::size_t capacity);  // Clears the cache
+    const std::size_t &capacity() const;
+    std::size_t size() const;
+
+    // Clears the cache if scopes differ from the ones cached masks were computed for
+    void validate(const scope_list &scopes);
+    void invalidate();
+    // Returned reference is valid until the next call. validate() must be called with
+    // the same scopes before.
+    const route_mask &routes(const topic_handle &topic);
+};
+
+}  // namespace octopus_mq
+
+#endif
@@ -0,0 +1,91 @@
+#include "network/topic.hpp"
+
+#include <algorithm>
+
+namespace octopus_mq {
+
+topic_entry::topic_entry(const std::string_view &name, const std::uint64_t hash)
+    : _name(name), _hash(hash), _wildcard(_name.find_first_of("#+") != string::npos) {
+    // Tokens are computed once here and reused by every scope and subscription check
+    if (_name.empty()) return;
+    const std::string_view view(_name);
+    for (size_t first = 0; first <= view.size();) {
+        size_t second = view.find_first_of('/', first);
+        if (second == std::string_view::npos) second = view.size();
+        _tokens.push_back(view.substr(first, second - first));
+        first = second + 1;
+    }
+}
+
+const string &topic_entry::name() const { return _name; }
+
+const std::uint64_t &topic_entry::hash() const { return _hash; }
+
+const topic_tokens_view &topic_entry::tokens() const { return _tokens; }
+
+const bool &topic_entry::wildcard() const { return _wildcard; }
+
+topic_handle::topic_handle(std::shared_ptr<const topic_entry> entry) : _entry(std::move(entry)) {}
+
+const string &topic_handle::name() const { return _entry ? _entry->name() : _empty_name; }
+
+std::uint64_t topic_handle::hash() const { return _entry ? _entry->hash() : 0; }
+
+const topic_tokens_view &topic_handle::tokens() const {
+    return _entry ? _entry->tokens() : _empty_tokens;
+}
+
+bool topic_handle::wildcard() const { return _entry and _entry->wildcard(); }
+
+bool topic_handle::empty() const { return not _entry or _entry->name().empty(); }
+
+bool topic_handle::operator==(const topic_handle &other) const { return _entry == other._entry; }
+
+bool topic_handle::operator!=(const topic_handle &other) const { return _entry != other._entry; }
+
+std::array<topic_table::shard, topic_table::_shard_count> topic_table::_shards;
+
+std::uint64_t topic_table::hash(const std::string_view &name) {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char c : name) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+void topic_table::collect(shard &shard) {
+    // Entry referenced only by the table could not gain new references without the shard lock
+    for (auto iter = shard.topics.begin(); iter != shard.topics.end();)
+        if (iter->second.use_count() == 1)
+            iter = shard.topics.erase(iter);
+        else
+            ++iter;
+    shard.collect_size = std::max(_min_collect_size, shard.topics.size() * 2);
+}
+
+topic_handle topic_table::intern(const std::string_view &name) {
+    const std::uint64_t topic_hash = hash(name);
+    shard &shard = _shards[topic_hash % _shard_count];
+
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    auto range = shard.topics.equal_range(topic_hash);
+    for (auto iter = range.first; iter != range.second; ++iter)
+        if (iter->second->name() == name) return topic_handle(iter->second);
+
+    if (shard.topics.size() >= shard.collect_size) collect(shard);
+    auto entry = std::make_shared<const topic_entry>(name, topic_hash);
+    shard.topics.emplace(topic_hash, entry);
+    return topic_handle(std::move(entry));
+}
+
+std::size_t topic_table::size() {
+    std::size_t size = 0;
+    for (auto &shard : _shards) {
+        std::lock_guard<std::mutex> shard_lock(shard.mutex);
+        size += shard.topics.size();
+    }
+    return size;
+}
+
+}  // namespace octopus_mq
@@ -0,0 +1,88 @@
+#ifndef OCTOMQ_TOPIC_H_
+#define OCTOMQ_TOPIC_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace octopus_mq {
+
+using std::string;
+using topic_tokens_view = std::vector<std::string_view>;
+
+// Immutable topic (or topic filter) stored in the topic table.
+// Tokens are views into the name, split by '/'.
+class topic_entry {
+    const string _name;
+    const std::uint64_t _hash;
+    topic_tokens_view _tokens;
+    bool _wildcard;
+
+   public:
+    topic_entry(const std::string_view &name, const std::uint64_t hash);
+    topic_entry(const topic_entry &) = delete;
+    topic_entry &operator=(const topic_entry &) = delete;
+
+    const string &name() const;
+    const std::uint64_t &hash() const;
+    const topic_tokens_view &tokens() const;
+    const bool &wildcard() const;  // true if name contains '+' or '#'
+};
+
+// Cheap to copy reference to an interned topic. Handles of equal topics point to the same
+// entry, so comparison does not touch the topic name. Default constructed handle is an
+// empty topic.
+class topic_handle {
+    std::shared_ptr<const topic_entry> _entry;
+
+    static inline const string _empty_name;
+    static inline const topic_tokens_view _empty_tokens;
+
+   public:
+    topic_handle() = default;
+    explicit topic_handle(std::shared_ptr<const topic_entry> entry);
+
+    const string &name() const;
+    std::uint64_t hash() const;
+    const topic_tokens_view &tokens() const;
+    bool wildcard() const;
+    bool empty() const;
+
+    bool operator==(const topic_handle &other) const;
+    bool operator!=(const topic_handle &other) const;
+};
+
+// Process-wide table of interned topics. Table is split into shards by topic hash,
+// so concurrent interning from different adapter threads rarely contends on a lock.
+// Entries no longer referenced by any handle are dropped when a shard grows.
+class topic_table {
+    static constexpr std::size_t _shard_count = 16;
+    static constexpr std::size_t _min_collect_size = 1024;
+
+    struct shard {
+        std::mutex mutex;
+        // Topics are keyed by their hash, collisions are resolved by comparing names
+        std::unordered_multimap<std::uint64_t, std::shared_ptr<const topic_entry>,
+                                std::hash<std::uint64_t>>
+            topics;
+        std::size_t collect_size = _min_collect_size;
+    };
+
+    static std::array<shard, _shard_count> _shards;
+
+    static void collect(shard &shard);
+
+   public:
+    static topic_handle intern(const std::string_view &name);
+    static std::uint64_t hash(const std::string_view &name);  // 64-bit FNV-1a
+    static std::size_t size();
+};
+
+}  // namespace octopus_mq
+
+#endif
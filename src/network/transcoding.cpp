@@ -0,0 +1,99 @@
+#include "network/transcoding.hpp"
+
+#include "core/error.hpp"
+#include "core/metrics.hpp"
+
+namespace octopus_mq {
+
+transcoding_settings::transcoding_settings(const nlohmann::json &json) {
+    if (not json.is_object()) throw field_type_error(transcoding_config::field_name::transcoding);
+
+    _ingress = parse_format(json, transcoding_config::field_name::ingress);
+    _egress = parse_format(json, transcoding_config::field_name::egress);
+
+    // Parsing optional 'offload_size' field
+    if (auto item = json.find(transcoding_config::field_name::offload_size);
+        item != json.end()) {
+        if (not item->is_number_unsigned())
+            throw field_type_error(transcoding_config::field_name::offload_size);
+        _offload_size = item->get<std::size_t>();
+    }
+}
+
+payload_format transcoding_settings::parse_format(const nlohmann::json &json,
+                                                  const char *field_name) {
+    auto item = json.find(field_name);
+    if (item == json.end()) return payload_format::json;
+    if (not item->is_string()) throw field_type_error(field_name);
+    const string name = item->get<string>();
+    if (name == transcoding_config::format_name::json) return payload_format::json;
+    if (name == transcoding_config::format_name::cbor) return payload_format::cbor;
+    if (name == transcoding_config::format_name::msgpack) return payload_format::msgpack;
+    throw field_encapsulated_error(field_name, "unknown payload format '" + name + '\'');
+}
+
+const payload_format &transcoding_settings::ingress() const { return _ingress; }
+
+const payload_format &transcoding_settings::egress() const { return _egress; }
+
+const std::size_t &transcoding_settings::offload_size() const { return _offload_size; }
+
+bool transcoding_settings::enabled() const {
+    return _ingress != payload_format::json or _egress != payload_format::json;
+}
+
+bool transcoding_settings::offloaded(const std::size_t payload_size) const {
+    return _offload_size != 0 and payload_size >= _offload_size;
+}
+
+std::optional<message_payload> transcode(const std::string_view &payload,
+                                         const payload_format from, const payload_format to) {
+    nlohmann::json document;
+    switch (from) {
+        case payload_format::json:
+            document = nlohmann::json::parse(payload.begin(), payload.end(), nullptr, false);
+            break;
+        case payload_format::cbor:
+            document = nlohmann::json::from_cbor(payload.begin(), payload.end(), true, false);
+            break;
+        case payload_format::msgpack:
+            document = nlohmann::json::from_msgpack(payload.begin(), payload.end(), true, false);
+            break;
+    }
+    if (document.is_discarded()) return std::nullopt;
+
+    message_payload result;
+    switch (to) {
+        case payload_format::json: {
+            const string text = document.dump();
+            result.assign(text.begin(), text.end());
+            break;
+        }
+        case payload_format::cbor:
+            nlohmann::json::to_cbor(document, result);
+            break;
+        case payload_format::msgpack:
+            nlohmann::json::to_msgpack(document, result);
+            break;
+    }
+    return result;
+}
+
+transcoded_ptr transcode_egress(message &message, const payload_format format) {
+    if (transcoded_ptr cached = message.transcoded(format)) return cached;
+    std::optional<message_payload> payload =
+        transcode(message.payload(), payload_format::json, format);
+    metrics::add(payload ? metric::transcoded : metric::transcoding_failed);
+    return message.transcoded(format, std::move(payload));
+}
+
+bool transcode_ingress(message &message, const payload_format format) {
+    std::optional<message_payload> payload =
+        transcode(message.payload(), format, payload_format::json);
+    metrics::add(payload ? metric::transcoded : metric::transcoding_failed);
+    if (not payload) return false;
+    message.payload(std::move(*payload));
+    return true;
+}
+
+}  // namespace octopus_mq
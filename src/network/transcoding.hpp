@@ -0,0 +1,77 @@
+#ifndef OCTOMQ_TRANSCODING_H_
+#define OCTOMQ_TRANSCODING_H_
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "json.hpp"
+#include "network/message.hpp"
+#include "network/network.hpp"
+
+namespace octopus_mq {
+
+using std::string;
+
+namespace transcoding_config {
+
+    namespace field_name {
+
+        constexpr char transcoding[] = "transcoding";
+        constexpr char ingress[] = "ingress";
+        constexpr char egress[] = "egress";
+        constexpr char offload_size[] = "offload_size";
+
+    }  // namespace field_name
+
+    namespace format_name {
+
+        constexpr char json[] = "json";
+        constexpr char cbor[] = "cbor";
+        constexpr char msgpack[] = "msgpack";
+
+    }  // namespace format_name
+
+    namespace constants {
+
+        constexpr std::size_t default_offload_size = 0x10000;  // 64 kB
+
+    }  // namespace constants
+
+}  // namespace transcoding_config
+
+// Optional 'transcoding' field of an adapter. Messages are exchanged between adapters as JSON,
+// payloads received in the ingress format are converted to JSON and JSON payloads are sent in
+// the egress format. Payloads which are not valid in the source format are passed unchanged.
+class transcoding_settings {
+    payload_format _ingress = payload_format::json;
+    payload_format _egress = payload_format::json;
+    // Payloads of this size and larger are converted by a worker thread, zero never
+    std::size_t _offload_size = transcoding_config::constants::default_offload_size;
+
+    static payload_format parse_format(const nlohmann::json &json, const char *field_name);
+
+   public:
+    transcoding_settings() = default;
+    explicit transcoding_settings(const nlohmann::json &json);
+
+    const payload_format &ingress() const;
+    const payload_format &egress() const;
+    const std::size_t &offload_size() const;
+    bool enabled() const;
+    bool offloaded(const std::size_t payload_size) const;
+};
+
+// Returns the payload converted between formats, nothing if it is not valid in 'from' format
+std::optional<message_payload> transcode(const std::string_view &payload,
+                                         const payload_format from, const payload_format to);
+// Returns JSON payload of the message converted to the format, the conversion is cached on
+// the message for other subscribers and adapters. Could be called from any thread.
+transcoded_ptr transcode_egress(message &message, const payload_format format);
+// Replaces payload of a message that is not shared yet with its conversion to JSON.
+// Returns false if the payload is not valid in the format.
+bool transcode_ingress(message &message, const payload_format format);
+
+}  // namespace octopus_mq
+
+#endif
@@ -0,0 +1,166 @@
+#include "network/tuning.hpp"
+
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+
+#include "core/error.hpp"
+#include "core/log.hpp"
+
+namespace octopus_mq {
+
+std::vector<int> tuning_settings::parse_cpu_list(const string &cpu_list) {
+    // Format of /sys cpulist files and 'cpus' field: "0-3,8,10-11"
+    std::vector<int> cpus;
+    size_t first = 0;
+    while (first < cpu_list.size()) {
+        size_t second = cpu_list.find(',', first);
+        if (second == string::npos) second = cpu_list.size();
+        const string range = cpu_list.substr(first, second - first);
+        first = second + 1;
+        if (range.empty() or range == "\n") continue;
+
+        size_t used = 0;
+        const int from = std::stoi(range, &used);
+        int to = from;
+        if (used < range.size() and range[used] == '-') to = std::stoi(range.substr(used + 1));
+        if (from < 0 or to < from) throw field_range_error(tuning::field_name::cpus);
+        for (int cpu = from; cpu <= to; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<int> tuning_settings::numa_node_cpus(const int node) {
+    std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    string line;
+    if (not cpulist.is_open() or not std::getline(cpulist, line)) return std::vector<int>();
+    return parse_cpu_list(line);
+}
+
+tuning_settings::tuning_settings(const nlohmann::json &json) {
+    if (not json.is_object()) throw field_type_error(tuning::field_name::tuning);
+
+    if (auto item = json.find(tuning::field_name::cpus); item != json.end()) {
+        if (item->is_string()) {
+            try {
+                _cpus = parse_cpu_list(item->get<string>());
+            } catch (const std::logic_error &) {
+                throw field_type_error(tuning::field_name::cpus);
+            }
+        } else if (item->is_array()) {
+            _cpus = std::vector<int>();
+            for (auto &cpu : *item) {
+                if (not cpu.is_number_unsigned()) throw field_type_error(tuning::field_name::cpus);
+                _cpus->push_back(cpu.get<int>());
+            }
+        } else
+            throw field_type_error(tuning::field_name::cpus);
+        if (_cpus->empty()) throw field_range_error(tuning::field_name::cpus);
+    }
+    if (auto item = json.find(tuning::field_name::numa_node); item != json.end()) {
+        if (not item->is_number_unsigned()) throw field_type_error(tuning::field_name::numa_node);
+        _numa_node = item->get<int>();
+    }
+    if (auto item = json.find(tuning::field_name::busy_poll); item != json.end()) {
+        if (not item->is_boolean()) throw field_type_error(tuning::field_name::busy_poll);
+        _busy_poll = item->get<bool>();
+    }
+    if (auto item = json.find(tuning::field_name::tcp_nodelay); item != json.end()) {
+        if (not item->is_boolean()) throw field_type_error(tuning::field_name::tcp_nodelay);
+        _tcp_nodelay = item->get<bool>();
+    }
+    for (auto [field, value] : { std::make_pair(tuning::field_name::send_buffer, &_send_buffer),
+                                 std::make_pair(tuning::field_name::receive_buffer,
+                                                &_receive_buffer),
+                                 std::make_pair(tuning::field_name::socket_busy_poll,
+                                                &_socket_busy_poll) }) {
+        if (auto item = json.find(field); item != json.end()) {
+            if (not item->is_number_unsigned()) throw field_type_error(field);
+            *value = item->get<int>();
+        }
+    }
+}
+
+void tuning_settings::inherit(const tuning_settings &defaults) {
+    if (not _cpus) _cpus = defaults._cpus;
+    if (not _numa_node) _numa_node = defaults._numa_node;
+    if (not _busy_poll) _busy_poll = defaults._busy_poll;
+    if (not _tcp_nodelay) _tcp_nodelay = defaults._tcp_nodelay;
+    if (not _send_buffer) _send_buffer = defaults._send_buffer;
+    if (not _receive_buffer) _receive_buffer = defaults._receive_buffer;
+    if (not _socket_busy_poll) _socket_busy_poll = defaults._socket_busy_poll;
+}
+
+bool tuning_settings::busy_poll() const { return _busy_poll.value_or(false); }
+
+bool tuning_settings::operator==(const tuning_settings &other) const {
+    return _cpus == other._cpus and _numa_node == other._numa_node and
+           _busy_poll == other._busy_poll and _tcp_nodelay == other._tcp_nodelay and
+           _send_buffer == other._send_buffer and _receive_buffer == other._receive_buffer and
+           _socket_busy_poll == other._socket_busy_poll;
+}
+
+void tuning_settings::apply_to_thread(const string &thread_name) const {
+    std::vector<int> cpus;
+    if (_cpus)
+        cpus = *_cpus;
+    else if (_numa_node) {
+        cpus = numa_node_cpus(*_numa_node);
+        if (cpus.empty())
+            log::print(log_type::warning, thread_name + ": unknown NUMA node " +
+                                              std::to_string(*_numa_node) + '.');
+    }
+
+    if (not cpus.empty()) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for (const int cpu : cpus)
+            if (cpu < CPU_SETSIZE) CPU_SET(cpu, &cpu_set);
+        if (int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set))
+            log::print(log_type::warning,
+                       thread_name + ": cannot set CPU affinity: " + strerror(error) + '.');
+    }
+
+    if (_numa_node) {
+        // Memory allocated by the thread is preferably taken from its NUMA node
+        const int max_nodes = sizeof(unsigned long) * 8;
+        const unsigned long node_mask = (*_numa_node < max_nodes) ? 1UL << *_numa_node : 0;
+        if (node_mask == 0 or
+            syscall(SYS_set_mempolicy, MPOL_PREFERRED, &node_mask, max_nodes) != 0)
+            log::print(log_type::warning, thread_name + ": cannot set NUMA memory policy.");
+    }
+}
+
+void tuning_settings::apply_to_socket(const int socket, const string &adapter_name) const {
+    auto set_option = [&](int level, int option, int value, const char *option_name) {
+        if (setsockopt(socket, level, option, &value, sizeof(value)) != 0)
+            log::print(log_type::warning, adapter_name + ": cannot set " + option_name + ": " +
+                                              strerror(errno) + '.');
+    };
+    if (_tcp_nodelay) set_option(IPPROTO_TCP, TCP_NODELAY, *_tcp_nodelay, "TCP_NODELAY");
+    if (_send_buffer) set_option(SOL_SOCKET, SO_SNDBUF, *_send_buffer, "SO_SNDBUF");
+    if (_receive_buffer) set_option(SOL_SOCKET, SO_RCVBUF, *_receive_buffer, "SO_RCVBUF");
+#ifdef SO_BUSY_POLL
+    if (_socket_busy_poll)
+        set_option(SOL_SOCKET, SO_BUSY_POLL, *_socket_busy_poll, "SO_BUSY_POLL");
+#endif
+}
+
+void tuning_settings::apply_to_listener(const int socket, const string &adapter_name) const {
+    // Accepted sockets inherit the receive buffer, so TCP window scale is negotiated for it
+    if (_receive_buffer and
+        setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &*_receive_buffer, sizeof(int)) != 0)
+        log::print(log_type::warning,
+                   adapter_name + ": cannot set SO_RCVBUF: " + strerror(errno) + '.');
+}
+
+}  // namespace octopus_mq
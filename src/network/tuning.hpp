@@ -0,0 +1,69 @@
+#ifndef OCTOMQ_TUNING_H_
+#define OCTOMQ_TUNING_H_
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+namespace octopus_mq {
+
+using std::string;
+
+namespace tuning {
+
+    namespace field_name {
+
+        constexpr char tuning[] = "tuning";
+        constexpr char cpus[] = "cpus";
+        constexpr char numa_node[] = "numa_node";
+        constexpr char busy_poll[] = "busy_poll";
+        constexpr char tcp_nodelay[] = "tcp_nodelay";
+        constexpr char send_buffer[] = "send_buffer";
+        constexpr char receive_buffer[] = "receive_buffer";
+        constexpr char socket_busy_poll[] = "socket_busy_poll";
+
+    }  // namespace field_name
+
+}  // namespace tuning
+
+// Thread placement and socket options.
+// Global 'tuning' section applies to the control thread and is the default for adapters,
+// 'tuning' section of an adapter overrides global fields one by one.
+// Unset fields keep system defaults.
+class tuning_settings {
+    std::optional<std::vector<int>> _cpus;  // CPUs the thread is pinned to
+    std::optional<int> _numa_node;          // Node for pinning (if no CPUs set) and memory
+    std::optional<bool> _busy_poll;         // Worker spins instead of sleeping in epoll
+    std::optional<bool> _tcp_nodelay;
+    std::optional<int> _send_buffer;       // SO_SNDBUF, bytes
+    std::optional<int> _receive_buffer;    // SO_RCVBUF, bytes
+    std::optional<int> _socket_busy_poll;  // SO_BUSY_POLL, microseconds
+
+    static std::vector<int> parse_cpu_list(const string &cpu_list);
+    static std::vector<int> numa_node_cpus(const int node);
+
+   public:
+    tuning_settings() = default;
+    explicit tuning_settings(const nlohmann::json &json);
+
+    // Fills fields, which are not set, from the defaults
+    void inherit(const tuning_settings &defaults);
+
+    bool busy_poll() const;
+
+    bool operator==(const tuning_settings &other) const;
+
+    // Pins calling thread and sets its memory policy. Errors are logged, not thrown,
+    // as the thread is still able to work without tuning.
+    void apply_to_thread(const string &thread_name) const;
+    // Sets options of a connected TCP socket
+    void apply_to_socket(const int socket, const string &adapter_name) const;
+    // Sets options of a listening socket, buffer sizes are inherited by accepted sockets
+    void apply_to_listener(const int socket, const string &adapter_name) const;
+};
+
+}  // namespace octopus_mq
+
+#endif
@@ -0,0 +1,440 @@
+#include "network/wal.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+#include <boost/crc.hpp>
+
+#include "core/error.hpp"
+#include "core/log.hpp"
+#include "core/metrics.hpp"
+
+namespace octopus_mq {
+
+struct wal_segment {
+    string path;
+    char *data = nullptr;  // Null in segments recovered on startup, they are only deleted
+    std::size_t size = 0;
+    std::size_t offset = 0;  // End of the last entry
+    std::size_t synced = 0;  // Flushed up to this offset
+    wal_sequence last = 0;   // Sequence of the last entry, zero if segment is empty
+
+    ~wal_segment() {
+        if (data) munmap(data, size);
+    }
+};
+
+// Entry header holds size and CRC-32 of the body followed by the sequence. Size is written
+// last, so an entry interrupted by a crash has zero size and ends the segment.
+static constexpr std::size_t header_size = 16;
+// Adapter name, topic and origin lengths, publish options, MQTT version, mesh stamp,
+// properties and payload lengths
+static constexpr std::size_t fixed_body_size = 2 + 2 + 1 + 1 + 8 + 8 + 2 + 4 + 4;
+
+class entry_writer {
+    char *_out;
+
+   public:
+    explicit entry_writer(char *out) : _out(out) {}
+
+    template <typename T>
+    void put(const T value) {
+        std::memcpy(_out, &value, sizeof(T));
+        _out += sizeof(T);
+    }
+    template <typename Length>
+    void put_bytes(const std::string_view bytes) {
+        put(static_cast<Length>(bytes.size()));
+        std::memcpy(_out, bytes.data(), bytes.size());
+        _out += bytes.size();
+    }
+};
+
+// Fails instead of reading past the end of the body
+class entry_reader {
+    const char *_data;
+    std::size_t _size;
+    std::size_t _offset = 0;
+
+   public:
+    entry_reader(const char *data, const std::size_t size) : _data(data), _size(size) {}
+
+    template <typename T>
+    bool get(T &value) {
+        if (_size - _offset < sizeof(T)) return false;
+        std::memcpy(&value, _data + _offset, sizeof(T));
+        _offset += sizeof(T);
+        return true;
+    }
+    template <typename Length>
+    bool get_bytes(std::string_view &bytes) {
+        Length length;
+        if (not get(length) or _size - _offset < length) return false;
+        bytes = std::string_view(_data + _offset, length);
+        _offset += length;
+        return true;
+    }
+};
+
+static std::uint32_t checksum(const char *data, const std::size_t size) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+static message_ptr decode_entry(const char *data, const std::size_t size, string &adapter_name) {
+    entry_reader reader(data, size);
+    std::string_view adapter, topic, origin, props, payload;
+    std::uint8_t pubopts, version;
+    node_id origin_node;
+    message_hash hash;
+    if (not(reader.get_bytes<std::uint16_t>(adapter) and reader.get_bytes<std::uint16_t>(topic) and
+            reader.get(pubopts) and reader.get(version) and reader.get(origin_node) and
+            reader.get(hash) and reader.get_bytes<std::uint16_t>(origin) and
+            reader.get_bytes<std::uint32_t>(props) and reader.get_bytes<std::uint32_t>(payload)))
+        return nullptr;
+
+    adapter_name = adapter;
+    message_ptr shared_message = std::make_shared<message>(
+        message_payload(), topic_table::intern(string(topic)), pubopts,
+        version == static_cast<std::uint8_t>(mqtt::version::v5) ? mqtt::version::v5
+                                                                 : mqtt::version::v3);
+    shared_message->payload(payload.data(), payload.size());
+    shared_message->origin(string(origin));
+    if (not props.empty()) shared_message->props(std::make_shared<const string>(props));
+    shared_message->stamp(origin_node, hash);
+    return shared_message;
+}
+
+// Reads entries of the segment, the ones after the checkpoint are added to 'entries'
+static void recover(wal_segment &segment, const wal_sequence checkpoint,
+                    std::vector<wal_entry> &entries) {
+    const int fd = ::open(segment.path.c_str(), O_RDONLY);
+    struct stat status;
+    if (fd < 0 or fstat(fd, &status) != 0) {
+        log::print(log_type::warning, "write-ahead log: cannot read '" + segment.path +
+                                          "': " + strerror(errno) + '.');
+        if (fd >= 0) ::close(fd);
+        return;
+    }
+    const std::size_t size = static_cast<std::size_t>(status.st_size);
+    void *mapping = (size != 0) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (mapping == MAP_FAILED) return;
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    const char *data = static_cast<const char *>(mapping);
+    for (std::size_t offset = 0; size - offset >= header_size;) {
+        std::uint32_t body_size, body_checksum;
+        wal_sequence sequence;
+        std::memcpy(&body_size, data + offset, sizeof(body_size));
+        std::memcpy(&body_checksum, data + offset + 4, sizeof(body_checksum));
+        std::memcpy(&sequence, data + offset + 8, sizeof(sequence));
+        // Zero size is the end of the segment, bad checksum is a torn write of the last entry
+        if (body_size == 0 or size - offset - header_size < body_size or
+            checksum(data + offset + header_size, body_size) != body_checksum)
+            break;
+        if (sequence > checkpoint) {
+            string adapter_name;
+            if (message_ptr shared_message =
+                    decode_entry(data + offset + header_size, body_size, adapter_name)) {
+                shared_message->wal_sequence(sequence);
+                entries.emplace_back(std::move(adapter_name), std::move(shared_message));
+            }
+        }
+        segment.last = sequence;
+        offset += header_size + body_size;
+    }
+    munmap(mapping, size);
+}
+
+write_ahead_log::~write_ahead_log() { close(); }
+
+std::vector<wal_entry> write_ahead_log::open(const wal_settings &settings) {
+    namespace fs = std::filesystem;
+    std::vector<wal_entry> entries;
+    close();
+    _settings = settings;
+    if (not enabled()) return entries;
+
+    std::error_code ec;
+    fs::create_directories(_settings.directory, ec);
+    if (ec) throw wal_error(_settings.directory, ec.message());
+    const string checkpoint_path =
+        (fs::path(_settings.directory) / wal_config::constants::checkpoint_file).string();
+    _checkpoint_fd = ::open(checkpoint_path.c_str(), O_RDWR | O_CREAT, 0600);
+    if (_checkpoint_fd < 0) throw wal_error(checkpoint_path, strerror(errno));
+    if (pread(_checkpoint_fd, &_checkpoint, sizeof(_checkpoint), 0) != sizeof(_checkpoint))
+        _checkpoint = 0;
+
+    std::vector<string> paths;
+    for (auto &file : fs::directory_iterator(_settings.directory, ec))
+        if (file.is_regular_file() and
+            file.path().extension() == wal_config::constants::segment_extension)
+            paths.push_back(file.path().string());
+    if (ec) throw wal_error(_settings.directory, ec.message());
+
+    _appended = _checkpoint;
+    for (auto &path : paths) {
+        // Numbers of new segments follow the existing ones, so names stay unique
+        _next_segment = std::max<std::uint64_t>(
+            _next_segment, std::strtoull(fs::path(path).stem().c_str(), nullptr, 16) + 1);
+        auto segment = std::make_shared<wal_segment>();
+        segment->path = path;
+        recover(*segment, _checkpoint, entries);
+        if (segment->last <= _checkpoint) {
+            // Dispatched or empty segment, the latter could be a spare one
+            unlink(path.c_str());
+            continue;
+        }
+        _appended = std::max(_appended, segment->last);
+        _sealed.push_back(std::move(segment));
+    }
+    // Spare segment could be taken after one created by a rotation, so the order of names is
+    // not the order of entries
+    std::sort(_sealed.begin(), _sealed.end(),
+              [](const wal_segment_ptr &a, const wal_segment_ptr &b) { return a->last < b->last; });
+    std::sort(entries.begin(), entries.end(), [](const wal_entry &a, const wal_entry &b) {
+        return a.second->wal_sequence() < b.second->wal_sequence();
+    });
+    _synced = _appended;
+    // Entries which could not be decoded are not replayed, so they are released right away
+    _released.assign(_appended - _checkpoint, true);
+    for (auto &entry : entries) _released[entry.second->wal_sequence() - _checkpoint - 1] = false;
+
+    _thread = std::thread(&write_ahead_log::worker, this);
+    return entries;
+}
+
+void write_ahead_log::close() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _should_stop = true;
+    }
+    _worker_cv.notify_all();
+    if (_thread.joinable()) _thread.join();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_settings.fsync != fsync_policy::never and _synced < _appended) sync(lock);
+    if (_spare) unlink(_spare->path.c_str());
+    _spare.reset();
+    _current.reset();
+    _sealed.clear();
+    _released.clear();
+    if (_checkpoint_fd >= 0) ::close(_checkpoint_fd);
+    _checkpoint_fd = -1;
+    _appended = _synced = _checkpoint = _next_segment = 0;
+    _should_stop = false;
+}
+
+bool write_ahead_log::enabled() const { return not _settings.directory.empty(); }
+
+wal_segment_ptr write_ahead_log::create_segment(std::unique_lock<std::mutex> &lock,
+                                                const std::size_t size) {
+    namespace fs = std::filesystem;
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx%s", static_cast<unsigned long long>(_next_segment++),
+                  wal_config::constants::segment_extension);
+    auto segment = std::make_shared<wal_segment>();
+    segment->path = (fs::path(_settings.directory) / name).string();
+    segment->size = size;
+    lock.unlock();
+
+    const int fd = ::open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    // Blocks are allocated up front, so appends do not extend the file
+    if (fd >= 0 and posix_fallocate(fd, 0, segment->size) == 0) {
+        void *mapping = mmap(nullptr, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) segment->data = static_cast<char *>(mapping);
+    }
+    const int error = errno;
+    if (fd >= 0) ::close(fd);
+    if (not segment->data) {
+        log::print(log_type::error, "write-ahead log: cannot create '" + segment->path +
+                                        "': " + strerror(error) + '.');
+        if (fd >= 0) unlink(segment->path.c_str());
+        lock.lock();
+        return nullptr;
+    }
+    madvise(segment->data, segment->size, MADV_SEQUENTIAL);
+    if (_settings.fsync != fsync_policy::never) {
+        // New directory entry must be durable as well
+        const int directory = ::open(_settings.directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (directory >= 0) {
+            fsync(directory);
+            ::close(directory);
+        }
+    }
+    lock.lock();
+    return segment;
+}
+
+bool write_ahead_log::rotate(std::unique_lock<std::mutex> &lock, const std::size_t record_size) {
+    wal_segment_ptr segment;
+    if (_spare and _spare->size >= record_size) {
+        segment = std::move(_spare);
+        _worker_cv.notify_all();
+    } else {
+        // Log thread has not prepared a spare yet or the entry does not fit in one
+        segment = create_segment(lock, std::max(_settings.segment_size, record_size));
+        if (not segment) return false;
+    }
+    if (_current) _sealed.push_back(std::move(_current));
+    _current = std::move(segment);
+    return true;
+}
+
+wal_sequence write_ahead_log::append(const string &adapter_name, const message &message) {
+    const string &topic = message.topic();
+    const string &origin = message.origin();
+    const std::string_view props = message.raw_props() ? std::string_view(*message.raw_props())
+                                                       : std::string_view();
+    const std::string_view payload = message.payload();
+    const std::size_t body_size = fixed_body_size + adapter_name.size() + topic.size() +
+                                  origin.size() + props.size() + payload.size();
+    const std::size_t record_size = header_size + body_size;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (not _current or _current->size - _current->offset < record_size)
+        if (not rotate(lock, record_size)) return 0;
+
+    char *record = _current->data + _current->offset;
+    entry_writer body(record + header_size);
+    body.put_bytes<std::uint16_t>(adapter_name);
+    body.put_bytes<std::uint16_t>(topic);
+    body.put(message.pubopts());
+    body.put(static_cast<std::uint8_t>(message.mqtt_version()));
+    body.put(message.origin_node());
+    body.put(message.hash());
+    body.put_bytes<std::uint16_t>(origin);
+    body.put_bytes<std::uint32_t>(props);
+    body.put_bytes<std::uint32_t>(payload);
+
+    const wal_sequence sequence = _appended + 1;
+    entry_writer header(record);
+    header.put(std::uint32_t(0));
+    header.put(checksum(record + header_size, body_size));
+    header.put(sequence);
+    // Size must not be stored before the rest of the entry, even if the process is killed
+    std::atomic_signal_fence(std::memory_order_release);
+    entry_writer(record).put(static_cast<std::uint32_t>(body_size));
+
+    _current->offset += record_size;
+    _current->last = sequence;
+    _appended = sequence;
+    _released.push_back(false);
+    metrics::add(metric::wal_appends);
+    return sequence;
+}
+
+void write_ahead_log::sync(std::unique_lock<std::mutex> &lock) {
+    struct range {
+        wal_segment_ptr segment;
+        std::size_t from;
+        std::size_t to;
+    };
+    std::vector<range> ranges;
+    const wal_sequence target = _appended;
+    for (auto &segment : _sealed)
+        if (segment->data and segment->synced < segment->offset)
+            ranges.push_back({ segment, segment->synced, segment->offset });
+    if (_current and _current->synced < _current->offset)
+        ranges.push_back({ _current, _current->synced, _current->offset });
+    lock.unlock();
+
+    static const std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    for (auto &item : ranges) {
+        const std::size_t from = item.from - item.from % page_size;  // Must be page aligned
+        if (msync(item.segment->data + from, item.to - from, MS_SYNC) != 0)
+            log::print(log_type::error, "write-ahead log: cannot flush '" + item.segment->path +
+                                            "': " + strerror(errno) + '.');
+    }
+
+    lock.lock();
+    for (auto &item : ranges) item.segment->synced = std::max(item.segment->synced, item.to);
+    _synced = std::max(_synced, target);
+    metrics::add(metric::wal_syncs);
+}
+
+void write_ahead_log::commit(const wal_sequence sequence) {
+    if (sequence == 0 or _settings.fsync != fsync_policy::always) return;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_synced < sequence) {
+        if (_syncing) {
+            // Leader flushes this entry too
+            _synced_cv.wait(lock);
+            continue;
+        }
+        _syncing = true;
+        sync(lock);
+        _syncing = false;
+        _synced_cv.notify_all();
+    }
+}
+
+void write_ahead_log::release(const wal_sequence sequence) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Log could be reopened since the entry was appended
+    if (sequence <= _checkpoint or sequence - _checkpoint > _released.size()) return;
+    _released[sequence - _checkpoint - 1] = true;
+}
+
+void write_ahead_log::checkpoint() {
+    if (not enabled()) return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    wal_sequence checkpoint = _checkpoint;
+    for (; not _released.empty() and _released.front(); _released.pop_front()) ++checkpoint;
+    if (checkpoint == _checkpoint) return;
+    _checkpoint = checkpoint;
+    // Checkpoint is not flushed, a stale one only replays dispatched entries again
+    if (pwrite(_checkpoint_fd, &_checkpoint, sizeof(_checkpoint), 0) != sizeof(_checkpoint))
+        log::print(log_type::error,
+                   "write-ahead log: cannot write checkpoint: " + string(strerror(errno)) + '.');
+    while (not _sealed.empty() and _sealed.front()->last <= _checkpoint) {
+        unlink(_sealed.front()->path.c_str());
+        _sealed.pop_front();
+    }
+}
+
+void write_ahead_log::worker() {
+    using clock = std::chrono::steady_clock;
+    const bool flushes = _settings.fsync == fsync_policy::interval;
+    clock::time_point retry = clock::now();
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (not _should_stop) {
+        if (not _spare and retry <= clock::now()) {
+            // File creation and preallocation stay off the path of appends
+            wal_segment_ptr segment = create_segment(lock, _settings.segment_size);
+            if (not segment)
+                retry = clock::now() + _settings.interval;
+            else if (_should_stop)
+                unlink(segment->path.c_str());
+            else
+                _spare = std::move(segment);
+        }
+        const auto woken = [&] { return _should_stop or (not _spare and retry <= clock::now()); };
+        if (flushes)
+            _worker_cv.wait_for(lock, _settings.interval, woken);
+        else if (_spare)
+            _worker_cv.wait(lock, woken);
+        else
+            _worker_cv.wait_until(lock, retry, woken);
+        if (flushes and _synced < _appended and not _syncing) {
+            _syncing = true;
+            sync(lock);
+            _syncing = false;
+            _synced_cv.notify_all();
+        }
+    }
+}
+
+}  // namespace octopus_mq
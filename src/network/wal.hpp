@@ -0,0 +1,129 @@
+#ifndef OCTOMQ_WAL_H_
+#define OCTOMQ_WAL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "network/message.hpp"
+
+namespace octopus_mq {
+
+using std::string;
+
+namespace wal_config {
+
+    namespace field_name {
+
+        constexpr char wal[] = "wal";
+        constexpr char directory[] = "directory";
+        constexpr char segment_size[] = "segment_size";
+        constexpr char fsync[] = "fsync";
+        constexpr char interval[] = "interval";
+
+    }  // namespace field_name
+
+    namespace fsync_name {
+
+        constexpr char always[] = "always";
+        constexpr char interval[] = "interval";
+        constexpr char never[] = "never";
+
+    }  // namespace fsync_name
+
+    namespace constants {
+
+        constexpr std::size_t default_segment_size = 0x4000000;  // 64 MB
+        constexpr std::size_t min_segment_size = 0x10000;        // 64 kB
+        constexpr std::chrono::milliseconds default_interval = std::chrono::milliseconds(100);
+        constexpr char segment_extension[] = ".wal";
+        constexpr char checkpoint_file[] = "checkpoint";
+
+    }  // namespace constants
+
+}  // namespace wal_config
+
+// When appended entries are flushed to the disk:
+// always - before the message is acknowledged, concurrent appends share a flush;
+// interval - periodically by the log thread, a power loss could lose the last interval;
+// never - by the kernel, entries survive a crash of the process but not of the host.
+enum class fsync_policy { always, interval, never };
+
+struct wal_settings {
+    string directory;  // Log is disabled when empty
+    std::size_t segment_size = wal_config::constants::default_segment_size;
+    fsync_policy fsync = fsync_policy::interval;
+    std::chrono::milliseconds interval = wal_config::constants::default_interval;
+};
+
+using wal_sequence = std::uint64_t;  // Zero is not a valid sequence
+// Message recovered from the log with the name of the adapter that received it
+using wal_entry = std::pair<string, message_ptr>;
+
+struct wal_segment;
+using wal_segment_ptr = std::shared_ptr<wal_segment>;
+
+// Write-ahead log of messages accepted by the global queue. Entries are appended to
+// memory-mapped segment files, which are deleted once the checkpoint passes their last entry.
+// Checkpoint advances over entries released by the dispatcher after all adapters the message
+// was dispatched to handed it off. Entries after the checkpoint are replayed on startup, so
+// a message could be delivered twice, but a message acknowledged to its publisher is not lost.
+class write_ahead_log {
+    wal_settings _settings;
+    std::mutex _mutex;
+    std::condition_variable _synced_cv;
+    wal_segment_ptr _current;             // Segment entries are appended to
+    wal_segment_ptr _spare;               // Preallocated by the log thread for the next rotation
+    std::deque<wal_segment_ptr> _sealed;  // Full segments waiting for the checkpoint
+    std::uint64_t _next_segment = 0;      // Number in the name of the next segment file
+    wal_sequence _appended = 0;
+    wal_sequence _synced = 0;
+    wal_sequence _checkpoint = 0;
+    std::deque<bool> _released;  // Entries after the checkpoint, true once released
+    bool _syncing = false;  // Flush is in progress, another appender becomes a follower
+    int _checkpoint_fd = -1;
+    std::thread _thread;  // Prepares spare segments and flushes periodically with interval policy
+    bool _should_stop = false;
+    std::condition_variable _worker_cv;
+
+    // Creates the next segment file of the given size, lock is released during the creation
+    wal_segment_ptr create_segment(std::unique_lock<std::mutex> &lock, const std::size_t size);
+    bool rotate(std::unique_lock<std::mutex> &lock, const std::size_t record_size);
+    // Flushes everything appended so far, lock is released during the flush
+    void sync(std::unique_lock<std::mutex> &lock);
+    void worker();
+
+   public:
+    write_ahead_log() = default;
+    write_ahead_log(const write_ahead_log &) = delete;
+    write_ahead_log &operator=(const write_ahead_log &) = delete;
+    ~write_ahead_log();
+
+    // Opens the log and returns entries which were not handed off before the process stopped,
+    // their messages carry their sequences. Does nothing if the log directory is not set,
+    // throws wal_error if it cannot be used.
+    std::vector<wal_entry> open(const wal_settings &settings);
+    void close();
+    bool enabled() const;
+
+    // Returns sequence of the entry, zero if it could not be appended. Callers must serialize
+    // appends and checkpoints, so the log keeps the order of the queue.
+    wal_sequence append(const string &adapter_name, const message &message);
+    // Waits until the entry is flushed if fsync policy is 'always'
+    void commit(const wal_sequence sequence);
+    // Marks the entry as handed off by all adapters, could be called from any thread
+    void release(const wal_sequence sequence);
+    // Moves the checkpoint over released entries
+    void checkpoint();
+};
+
+}  // namespace octopus_mq
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <errno.h>
 
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
 #include <iostream>
@@ -9,8 +10,13 @@
 #include <string>
 
 #include "core/log.hpp"
+#include "core/memory_budget.hpp"
+#include "core/metrics.hpp"
 #include "core/settings.hpp"
 #include "network/adapter_factory.hpp"
+#ifdef OCTOMQ_ENABLE_DDS
+#include "threads/dds/peer.hpp"
+#endif
 
 namespace octopus_mq {
 
@@ -62,6 +68,67 @@ void control::print_adapters() {
     log::print_empty_line();
 }
 
+void control::reload_adapters() {
+    _should_reload = false;
+    log::print(log_type::info, "reloading configuration file...");
+
+    adapter_pool new_pool;
+    try {
+        settings::load(_config_file_name, new_pool);
+    } catch (const std::runtime_error &re) {
+        log::print(log_type::error, string(re.what()) + " Keeping current configuration.");
+        return;
+    }
+    metrics::interval(settings::metrics_interval());
+    _message_queue.configure_routes(settings::route_cache_size());
+    memory_budget::configure(settings::memory());
+    chunk_store::configure(settings::chunk_store());
+
+    // Messages already queued are delivered to the adapters they were addressed to
+    _message_queue.wait_and_pop_all(std::chrono::milliseconds(0), _adapter_pool);
+    _message_queue.configure_priorities(settings::priorities());
+
+    adapter_pool removed;
+    for (auto &adapter : _adapter_pool) {
+        auto same = std::find_if(new_pool.begin(), new_pool.end(), [&adapter](auto &item) {
+            return item.second == nullptr and item.first->same_except_scope(*adapter.first);
+        });
+        if (same != new_pool.end()) {
+            // Adapter keeps running with all its connections, only the scope is swapped.
+            // Dispatcher picks up the new scope with the next message.
+            adapter.first->scope(same->first->scope());
+            *same = adapter;
+        } else
+            removed.push_back(adapter);
+    }
+
+    // Removed adapters are stopped first to release their bindings for the added ones
+    for (auto &adapter : removed) {
+        log::print(log_type::info, "stopping adapter '" + adapter.first->name() + "'.");
+        adapter.second->stop();
+        adapter.second.reset();
+    }
+
+    // Added adapters which failed to start are skipped, the rest keep running
+    for (auto iter = new_pool.begin(); iter != new_pool.end();) {
+        if (iter->second != nullptr) {
+            ++iter;
+            continue;
+        }
+        try {
+            iter->second = adapter_interface_factory::from_settings(iter->first, _message_queue);
+            iter->second->run();
+            ++iter;
+        } catch (const std::runtime_error &re) {
+            log::print(log_type::error, "adapter '" + iter->first->name() + "': " + re.what());
+            iter = new_pool.erase(iter);
+        }
+    }
+
+    _adapter_pool = std::move(new_pool);
+    print_adapters();
+}
+
 static std::map<const int, const char *> supported_signals = {
     { SIGHUP, "hangup" }, { SIGINT, "interrupt" }, { SIGQUIT, "quit" }, { SIGABRT, "abort" }
 };
@@ -71,6 +138,11 @@ void control::init_signal_handlers() {
 }
 
 void control::signal_handler(int sig) {
+    // Hangup reloads configuration, it is handled by the control thread
+    if (sig == SIGHUP) {
+        _should_reload = true;
+        return;
+    }
     log::print(log_type::info, "received %s signal, stopping...", supported_signals[sig]);
     _should_stop = true;
 }
@@ -93,6 +165,7 @@ void control::run(const int argc, const char **argv) {
                 if (not std::filesystem::is_regular_file(config_file_name))
                     throw std::runtime_error("not a file: " + config_file_name);
                 settings::load(config_file_name, _adapter_pool);
+                _config_file_name = config_file_name;
             } else
                 throw std::runtime_error("misleading option: " + string(argv[i]));
         }
@@ -104,15 +177,33 @@ void control::run(const int argc, const char **argv) {
     if (_daemon) daemonize();
     log::print_started(_daemon);
 
+    node::id(settings::mesh().id);
+    _message_queue.configure(settings::mesh());
+    _message_queue.configure_routes(settings::route_cache_size());
+    _message_queue.configure_priorities(settings::priorities());
+    memory_budget::configure(settings::memory());
+    chunk_store::configure(settings::chunk_store());
+    metrics::interval(settings::metrics_interval());
+    settings::tuning().apply_to_thread("control thread");
+    // Log is opened once, its settings are not changed by reloads
+    _message_queue.configure_wal(settings::wal());
+
     initialize_adapters();
 
     if (_initialized) {
         print_adapters();
+        _message_queue.replay(_adapter_pool);
         // Following functions implements a loop of the main thread.
         // The loop is running as long as _should_stop == false.
         message_queue_manager();
         shutdown_adapters();
+        _message_queue.close_wal();
+        metrics::print();
     }
+#ifdef OCTOMQ_ENABLE_DDS
+    // Peers are stopped by now, including the ones removed by reloads
+    dds::peer::shutdown();
+#endif
 
     log::print_stopped(not _initialized);
 }
@@ -124,6 +215,8 @@ void control::message_queue_manager() {
             // All adapters strictly push to message_pool, but never read.
             // This function is responsible for reading and calling inject_publish on all adapters
             _message_queue.wait_and_pop_all(std::chrono::milliseconds(100), _adapter_pool);
+            metrics::print_periodic();
+            if (_should_reload) reload_adapters();
         } catch (const std::runtime_error &re) {
             log::print(log_type::fatal, re.what());
             _initialized = false;  // To indicate an error in log::print_stopped()
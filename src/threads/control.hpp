@@ -3,6 +3,7 @@
 
 #include <signal.h>
 
+#include <atomic>
 #include <cstdint>
 #include <map>
 #include <string>
@@ -23,6 +24,8 @@ class control {
     static inline bool _initialized = false;
     static inline bool _daemon = false;
     static inline bool _should_stop = false;
+    static inline std::atomic<bool> _should_reload = false;
+    static inline string _config_file_name;
 
     static inline message_queue _message_queue = message_queue();
     static inline adapter_pool _adapter_pool = adapter_pool();
@@ -33,6 +36,7 @@ class control {
     static void initialize_adapters();
     static void shutdown_adapters();
     static void print_adapters();
+    static void reload_adapters();
 
     static void message_queue_manager();  // Main thread routine
 
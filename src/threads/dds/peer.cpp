@@ -1,14 +1,232 @@
 #include "threads/dds/peer.hpp"
+#include "core/log.hpp"
+
+#include <dds/DCPS/Marked_Default_Qos.h>
+#include <dds/DCPS/Service_Participant.h>
+#include <dds/DCPS/RTPS/RtpsDiscovery.h>
+#include <dds/DCPS/transport/framework/TransportRegistry.h>
+#include <dds/DCPS/transport/rtps_udp/RtpsUdpInst.h>
+#include <dds/DCPS/transport/rtps_udp/RtpsUdpInst_rch.h>
+#include <dds/DCPS/transport/tcp/TcpInst.h>
+#include <dds/DCPS/transport/tcp/TcpInst_rch.h>
+#include <ace/INET_Addr.h>
+
+#include <stdexcept>
 
 namespace octopus_mq::dds {
 
+reader_listener::reader_listener(peer &peer) : _peer(peer) {}
+
+void reader_listener::on_data_available(DDS::DataReader_ptr reader) {
+    messageDataReader_var message_reader = messageDataReader::_narrow(reader);
+    if (CORBA::is_nil(message_reader.in())) return;
+
+    // Empty sequences make take() loan samples from the reader cache instead of copying them
+    messageSeq samples;
+    DDS::SampleInfoSeq infos;
+    if (message_reader->take(samples, infos, DDS::LENGTH_UNLIMITED, DDS::ANY_SAMPLE_STATE,
+                             DDS::ANY_VIEW_STATE, DDS::ANY_INSTANCE_STATE) != DDS::RETCODE_OK)
+        return;
+    for (CORBA::ULong i = 0; i < samples.length(); ++i)
+        if (infos[i].valid_data) _peer.receive(samples[i]);
+    message_reader->return_loan(samples, infos);
+}
+
 peer::peer(const octopus_mq::adapter_settings_ptr adapter_settings, message_queue& global_queue)
     : adapter_interface(adapter_settings, global_queue) {}
 
-void peer::run() {}
+void peer::create_transport() {
+    dds::adapter_settings_ptr settings =
+        std::static_pointer_cast<dds::adapter_settings>(_adapter_settings);
+    const string domain_string = std::to_string(settings->domain());
+    const string config_name = "octomq_" + settings->binging_name();
+
+    // RTPS discovery is shared by all peers of the same domain, so it is registered only by
+    // the first of them
+    {
+        std::lock_guard<std::mutex> discovery_lock(_discovery_mutex);
+        if (_discovery_domains.insert(settings->domain()).second) {
+            OpenDDS::RTPS::RtpsDiscovery_rch discovery =
+                OpenDDS::DCPS::make_rch<OpenDDS::RTPS::RtpsDiscovery>("octomq_rtps_" +
+                                                                      domain_string);
+            TheServiceParticipant->add_discovery(
+                OpenDDS::DCPS::static_rchandle_cast<OpenDDS::DCPS::Discovery>(discovery));
+            TheServiceParticipant->set_repo_domain(settings->domain(), discovery->key());
+        }
+    }
+
+    ACE_INET_Addr local_address;
+    if (settings->phy().ip() == network::constants::null_ip)
+        local_address.set(static_cast<u_short>(settings->port()));
+    else
+        local_address.set(static_cast<u_short>(settings->port()),
+                          settings->phy().ip_string().c_str());
+
+    _transport_config = TheTransportRegistry->create_config(config_name);
+    OpenDDS::DCPS::TransportInst_rch inst;
+    if (settings->transport() == transport_type::udp) {
+        inst = TheTransportRegistry->create_inst(config_name, "rtps_udp");
+        OpenDDS::DCPS::static_rchandle_cast<OpenDDS::DCPS::RtpsUdpInst>(inst)->local_address(
+            local_address);
+    } else {
+        inst = TheTransportRegistry->create_inst(config_name, "tcp");
+        OpenDDS::DCPS::static_rchandle_cast<OpenDDS::DCPS::TcpInst>(inst)->local_address(
+            local_address);
+    }
+    _transport_config->instances_.push_back(inst);
+}
+
+void peer::create_entities() {
+    dds::adapter_settings_ptr settings =
+        std::static_pointer_cast<dds::adapter_settings>(_adapter_settings);
+    DDS::DomainParticipantFactory_var factory = TheParticipantFactory;
+
+    _participant = factory->create_participant(settings->domain(), PARTICIPANT_QOS_DEFAULT, 0,
+                                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+    if (CORBA::is_nil(_participant.in()))
+        throw std::runtime_error("cannot create dds domain participant.");
+    TheTransportRegistry->bind_config(_transport_config, _participant.in());
+    // Samples published by this peer must not be read back by it
+    _participant->ignore_participant(_participant->get_instance_handle());
+
+    messageTypeSupport_var type_support = new messageTypeSupportImpl;
+    if (type_support->register_type(_participant.in(), "") != DDS::RETCODE_OK)
+        throw std::runtime_error("cannot register dds message type.");
+    CORBA::String_var type_name = type_support->get_type_name();
+
+    _topic = _participant->create_topic(constants::topic_name, type_name.in(), TOPIC_QOS_DEFAULT,
+                                        0, OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+    if (CORBA::is_nil(_topic.in())) throw std::runtime_error("cannot create dds topic.");
+
+    _publisher = _participant->create_publisher(PUBLISHER_QOS_DEFAULT, 0,
+                                                OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+    _subscriber = _participant->create_subscriber(SUBSCRIBER_QOS_DEFAULT, 0,
+                                                  OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+    if (CORBA::is_nil(_publisher.in()) or CORBA::is_nil(_subscriber.in()))
+        throw std::runtime_error("cannot create dds publisher or subscriber.");
+
+    // Each instance carries a stream of messages of one MQTT topic. History is bounded, so a
+    // slow reader loses the oldest samples of a topic instead of blocking the dispatcher,
+    // which calls write() in inject_publish().
+    DDS::DataWriterQos writer_qos;
+    _publisher->get_default_datawriter_qos(writer_qos);
+    writer_qos.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
+    writer_qos.reliability.max_blocking_time.sec = 0;
+    writer_qos.reliability.max_blocking_time.nanosec = constants::max_blocking_nanosec;
+    writer_qos.history.kind = DDS::KEEP_LAST_HISTORY_QOS;
+    writer_qos.history.depth = constants::history_depth;
+    DDS::DataWriter_var writer = _publisher->create_datawriter(
+        _topic.in(), writer_qos, 0, OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+    _writer = messageDataWriter::_narrow(writer.in());
+
+    DDS::DataReaderQos reader_qos;
+    _subscriber->get_default_datareader_qos(reader_qos);
+    reader_qos.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
+    reader_qos.history.kind = DDS::KEEP_LAST_HISTORY_QOS;
+    reader_qos.history.depth = constants::history_depth;
+    _listener = new reader_listener(*this);
+    DDS::DataReader_var reader = _subscriber->create_datareader(
+        _topic.in(), reader_qos, _listener.in(), OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+    _reader = messageDataReader::_narrow(reader.in());
+
+    if (CORBA::is_nil(_writer.in()) or CORBA::is_nil(_reader.in()))
+        throw std::runtime_error("cannot create dds data writer or data reader.");
+}
+
+DDS::InstanceHandle_t peer::instance(const std::uint64_t hash, const message &sample) {
+    if (auto iter = _instance_index.find(hash); iter != _instance_index.end()) {
+        instance_slot &slot = _instances[iter->second];
+        slot.referenced = true;
+        return slot.handle;
+    }
+    const DDS::InstanceHandle_t handle = _writer->register_instance(sample);
+    if (_instances.size() < constants::max_instances) {
+        _instance_index.emplace(hash, _instances.size());
+        _instances.push_back({ hash, handle, false });
+        return handle;
+    }
+    // Instances written since the hand last passed them get another round
+    while (_instances[_instance_hand].referenced) {
+        _instances[_instance_hand].referenced = false;
+        _instance_hand = (_instance_hand + 1) % _instances.size();
+    }
+    instance_slot &slot = _instances[_instance_hand];
+    message key;
+    key.hash = slot.hash;
+    _writer->unregister_instance(key, slot.handle);
+    _instance_index.erase(slot.hash);
+    _instance_index.emplace(hash, _instance_hand);
+    slot = { hash, handle, false };
+    _instance_hand = (_instance_hand + 1) % _instances.size();
+    return handle;
+}
+
+void peer::run() {
+    _service_started = true;
+    create_transport();
+    create_entities();
+}
+
+void peer::stop() {
+    if (not CORBA::is_nil(_participant.in())) {
+        {
+            // Publishing stops before the writer is deleted
+            std::lock_guard<std::mutex> instances_lock(_instances_mutex);
+            _writer = messageDataWriter::_nil();
+            _instances.clear();
+            _instance_index.clear();
+            _instance_hand = 0;
+        }
+        _participant->delete_contained_entities();
+        TheParticipantFactory->delete_participant(_participant.in());
+        _reader = messageDataReader::_nil();
+        _participant = DDS::DomainParticipant::_nil();
+    }
+}
+
+void peer::shutdown() {
+    if (not _service_started.exchange(false)) return;
+    TheServiceParticipant->shutdown();
+    std::lock_guard<std::mutex> discovery_lock(_discovery_mutex);
+    _discovery_domains.clear();
+}
+
+void peer::inject_publish(const message_ptr shared_message) {
+    // Message is handed off when this returns, whether it was written or not
+    const handoff_receipt receipt = _global_queue.receipt(shared_message);
+    const std::string_view payload = shared_message->payload();
+    // Interned topic hash (64-bit FNV-1a) is used as a DDS instance key,
+    // so samples of the same MQTT topic always land in the same DDS instance.
+    const std::uint64_t hash = shared_message->interned_topic().hash();
+
+    dds::message sample;
+    sample.hash = hash;
+    sample.message_hash = shared_message->hash();
+    sample.origin_node = shared_message->origin_node();
+    sample.mqtt_topic = shared_message->topic().c_str();
+    sample.mqtt_client_id = shared_message->origin().c_str();
+    // Sequence borrows the payload buffer without taking ownership (release = false),
+    // so no copy is made. Sample is serialized before write() returns.
+    sample.data.replace(payload.size(), payload.size(),
+                        const_cast<CORBA::Char *>(payload.data()), false);
 
-void peer::stop() {}
+    std::lock_guard<std::mutex> instances_lock(_instances_mutex);
+    if (CORBA::is_nil(_writer.in())) return;
+    if (_writer->write(sample, instance(hash, sample)) != DDS::RETCODE_OK)
+        log::print(log_type::error, _adapter_settings->name() + ": cannot publish '" +
+                                        shared_message->topic() + "'.");
+}
 
-void peer::inject_publish(const message_ptr message) { (*message); }
+void peer::receive(const message &sample) {
+    // Single copy straight from the loaned sample buffer into the payload
+    message_ptr shared_message = std::make_shared<octopus_mq::message>(
+        octopus_mq::message_payload(), topic_table::intern(sample.mqtt_topic.in()),
+        std::uint8_t(0));
+    shared_message->payload(reinterpret_cast<const char *>(sample.data.get_buffer()),
+                            sample.data.length());
+    shared_message->origin(string(sample.mqtt_client_id.in()));
+    shared_message->stamp(sample.origin_node, sample.message_hash);
+    _global_queue.push(_adapter_settings, shared_message);
+}
 
-}  // namespace octopus_mq::dds
\ No newline at end of file
+}  // namespace octopus_mq::dds
@@ -6,15 +6,102 @@
 #include "network/message.hpp"
 #include "network/network.hpp"
 
+#include <dds/DdsDcpsInfrastructureC.h>
+#include <dds/DdsDcpsPublicationC.h>
+#include <dds/DdsDcpsSubscriptionC.h>
+#include <dds/DCPS/LocalObject.h>
+#include <dds/DCPS/transport/framework/TransportConfig_rch.h>
+
+#include "threads/dds/message/messageTypeSupportImpl.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 namespace octopus_mq::dds {
 
+namespace constants {
+
+    constexpr char topic_name[] = "octopus_mq";
+    // Registered instances per writer, the least recently written ones are unregistered
+    constexpr std::size_t max_instances = 4096;
+    // Samples kept per instance until they are acknowledged or taken
+    constexpr CORBA::Long history_depth = 64;
+    // Longest time write() could block the dispatcher while the writer is out of resources
+    constexpr CORBA::ULong max_blocking_nanosec = 50000000;  // 50 ms
+
+}  // namespace constants
+
+class peer;
+
+class reader_listener final : public virtual OpenDDS::DCPS::LocalObject<DDS::DataReaderListener> {
+    peer &_peer;
+
+   public:
+    explicit reader_listener(peer &peer);
+
+    void on_data_available(DDS::DataReader_ptr reader);
+
+    void on_requested_deadline_missed(DDS::DataReader_ptr,
+                                      const DDS::RequestedDeadlineMissedStatus &) {}
+    void on_requested_incompatible_qos(DDS::DataReader_ptr,
+                                       const DDS::RequestedIncompatibleQosStatus &) {}
+    void on_sample_rejected(DDS::DataReader_ptr, const DDS::SampleRejectedStatus &) {}
+    void on_liveliness_changed(DDS::DataReader_ptr, const DDS::LivelinessChangedStatus &) {}
+    void on_subscription_matched(DDS::DataReader_ptr, const DDS::SubscriptionMatchedStatus &) {}
+    void on_sample_lost(DDS::DataReader_ptr, const DDS::SampleLostStatus &) {}
+};
+
 class peer final : public adapter_interface {
+    DDS::DomainParticipant_var _participant;
+    DDS::Topic_var _topic;
+    DDS::Publisher_var _publisher;
+    DDS::Subscriber_var _subscriber;
+    messageDataWriter_var _writer;
+    messageDataReader_var _reader;
+    DDS::DataReaderListener_var _listener;
+    OpenDDS::DCPS::TransportConfig_rch _transport_config;
+
+    struct instance_slot {
+        std::uint64_t hash;
+        DDS::InstanceHandle_t handle;
+        bool referenced;
+    };
+
+    // Instances are registered once per MQTT topic and reused for all following samples.
+    // Idle ones are unregistered with the CLOCK algorithm once there are too many of them.
+    // The mutex guards the writer as well, stop() could reset it while a message is written.
+    std::vector<instance_slot> _instances;
+    std::unordered_map<std::uint64_t, std::size_t> _instance_index;  // Topic hash -> slot
+    std::size_t _instance_hand = 0;
+    std::mutex _instances_mutex;
+
+    // Service participant is shared by all peers and cannot be used again after its shutdown,
+    // so it runs from the start of the first peer until the process exits
+    static inline std::atomic<bool> _service_started = false;
+    // Domains with registered RTPS discovery
+    static inline std::unordered_set<DDS::DomainId_t> _discovery_domains;
+    static inline std::mutex _discovery_mutex;
+
+    void create_transport();
+    void create_entities();
+    // Requires _instances_mutex to be held
+    DDS::InstanceHandle_t instance(const std::uint64_t hash, const message &sample);
+
    public:
     peer(const octopus_mq::adapter_settings_ptr adapter_settings, message_queue& global_queue);
 
     void run();
     void stop();
     void inject_publish(const message_ptr message);
+
+    void receive(const message &sample);
+
+    // Shuts down the service participant once all peers are stopped, called at process exit
+    static void shutdown();
 };
 
 }  // namespace octopus_mq::dds
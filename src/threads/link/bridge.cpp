@@ -0,0 +1,401 @@
+#include "threads/link/bridge.hpp"
+
+#include "core/error.hpp"
+#include "core/log.hpp"
+#include "core/metrics.hpp"
+
+#include <netinet/in.h>
+
+#include <cstdio>
+
+namespace octopus_mq::link {
+
+using boost::asio::ip::tcp;
+
+static std::string node_name(const node_id id) {
+    char name[sizeof(node_id) * 2 + 1];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(id));
+    return std::string(name);
+}
+
+session::session(bridge &bridge, tcp::socket socket)
+    : _bridge(bridge),
+      _socket(std::move(socket)),
+      _peer_node(mesh::constants::null_node),
+      _open(true),
+      _rx_window(bridge.link_settings()->window()),
+      _rx_consumed(0),
+      _next_topic_id(0),
+      _credits(0),
+      _write_in_progress(false) {
+    boost::system::error_code ec;
+    auto endpoint = _socket.remote_endpoint(ec);
+    if (not ec) _remote_address = address(endpoint.address().to_string(), endpoint.port());
+    _socket.set_option(tcp::no_delay(true), ec);
+    bridge.settings()->tuning().apply_to_socket(_socket.native_handle(), bridge.settings()->name());
+}
+
+void session::start() {
+    frame_writer writer;
+    writer.hello({ node::id(), _rx_window });
+    _frames.push_back(writer.finish(frame_type::hello));
+    log::print_event(_bridge.settings()->name(), _remote_address, _peer_name,
+                     network_event_type::send, frame_names::hello);
+    write();
+    read_header();
+}
+
+void session::close() {
+    if (not _open) return;
+    _open = false;
+    boost::system::error_code ec;
+    _socket.shutdown(tcp::socket::shutdown_both, ec);
+    _socket.close(ec);
+}
+
+void session::fail(const std::string &reason) {
+    if (not _open) return;
+    std::string message = reason + " at " + _remote_address.to_string();
+    if (not _peer_name.empty()) message += " (" + _peer_name + ")";
+    log::print(log_type::error, _bridge.settings()->name() + ": " + message + '.');
+    close();
+    _bridge.closed(shared_from_this());
+}
+
+void session::read_header() {
+    auto self = shared_from_this();
+    boost::asio::async_read(
+        _socket, boost::asio::buffer(_header),
+        [this, self](const boost::system::error_code &ec, std::size_t) {
+            if (ec) {
+                if (ec != boost::asio::error::operation_aborted) fail(ec.message());
+                return;
+            }
+            const std::uint32_t length = frame_reader::frame_length(_header.data());
+            if (length < constants::header_size - sizeof(std::uint32_t) or
+                length > constants::max_accepted_frame_size)
+                return fail("invalid frame length");
+            _body.resize(length - (constants::header_size - sizeof(std::uint32_t)));
+            read_body();
+        });
+}
+
+void session::read_body() {
+    auto self = shared_from_this();
+    boost::asio::async_read(_socket, boost::asio::buffer(_body),
+                            [this, self](const boost::system::error_code &ec, std::size_t) {
+                                if (ec) {
+                                    if (ec != boost::asio::error::operation_aborted)
+                                        fail(ec.message());
+                                    return;
+                                }
+                                try {
+                                    handle_frame();
+                                } catch (const std::runtime_error &re) {
+                                    return fail(re.what());
+                                }
+                                if (_open) read_header();
+                            });
+}
+
+void session::handle_frame() {
+    frame_reader reader(_body.data(), _body.size(), frame_reader::flags(_header.data()));
+    switch (frame_reader::type(_header.data())) {
+        case frame_type::hello: {
+            const struct hello hello = reader.hello();
+            _peer_node = hello.id;
+            _peer_name = node_name(hello.id);
+            _credits += hello.window;
+            log::print_event(_bridge.settings()->name(), _remote_address, _peer_name,
+                             network_event_type::receive, frame_names::hello);
+            if (_peer_node == node::id()) throw link_protocol_error("link to itself");
+            _bridge.established(*this);
+            flush();
+            break;
+        }
+        case frame_type::batch:
+            if (_peer_node == mesh::constants::null_node)
+                throw link_protocol_error("batch before hello");
+            handle_batch(reader);
+            break;
+        case frame_type::credit:
+            _credits += reader.credit();
+            flush();
+            break;
+        default:
+            throw link_protocol_error("unknown frame type");
+    }
+}
+
+void session::handle_batch(frame_reader &reader) {
+    std::size_t received = 0;
+    while (not reader.at_end()) {
+        topic_id id;
+        switch (reader.next_record()) {
+            case record_type::topic: {
+                std::string topic_name;
+                reader.topic(id, topic_name);
+                if (id >= constants::max_topics) throw link_protocol_error("invalid topic id");
+                _rx_topics[id] = topic_table::intern(topic_name);
+                break;
+            }
+            case record_type::message: {
+                message_ptr message = reader.message(id);
+                auto topic = _rx_topics.find(id);
+                if (topic == _rx_topics.end()) throw link_protocol_error("unknown topic id");
+                message->topic(topic->second);
+                _bridge.receive(*this, message);
+                ++received;
+                break;
+            }
+            default:
+                throw link_protocol_error("unknown record type");
+        }
+    }
+    log::print_event(_bridge.settings()->name(), _remote_address, _peer_name,
+                     network_event_type::receive,
+                     std::string(frame_names::batch) + " (" + std::to_string(received) + ", " +
+                         log::size_to_string(_body.size()) + ')');
+    _bridge.received_batch();
+
+    // Credits are granted back in bulk once half of the window is consumed
+    _rx_consumed += received;
+    if (_rx_consumed >= (_rx_window + 1) / 2) {
+        frame_writer writer;
+        writer.credit(_rx_consumed);
+        _frames.push_back(writer.finish(frame_type::credit));
+        _rx_consumed = 0;
+        write();
+    }
+}
+
+void session::enqueue(const message_ptr message, const handoff_receipt &receipt) {
+    // Message is never sent back to the node where it entered the mesh
+    if (message->origin_node() == _peer_node) return;
+    // Frame of a single message must still be accepted by the peer
+    const std::size_t frame_size = frame_writer::topic_size(message->topic()) +
+                                   frame_writer::message_size(*message) + sizeof(std::uint16_t);
+    if (frame_size > constants::max_accepted_frame_size) {
+        metrics::add(metric::link_dropped);
+        return log::print(log_type::error, _bridge.settings()->name() + ": '" +
+                                               message->topic() + "' is too large for a link.");
+    }
+    // Peer withholding credits must not make the queue grow without bound
+    if (_pending.size() >= constants::max_pending) return metrics::add(metric::link_dropped);
+    _pending.emplace_back(message, receipt);
+}
+
+void session::flush() {
+    if (not _open or _write_in_progress) return;
+
+    const compression compression = _bridge.link_settings()->compression();
+    frame_writer writer;
+    std::size_t sent = 0;
+    while (not _pending.empty() and _credits > 0 and
+           _frames.size() < constants::max_frames_per_write) {
+        const message_ptr &message = _pending.front().first;
+        auto topic = _tx_topics.find(message->topic());
+        std::size_t record_size = frame_writer::message_size(*message);
+        if (topic == _tx_topics.end()) record_size += frame_writer::topic_size(message->topic());
+        // Batch is closed before a record which would make it larger than a frame,
+        // so only a single large message could exceed max_frame_size
+        if (not writer.empty() and writer.size() + record_size > constants::max_frame_size) {
+            _frames.push_back(writer.finish(frame_type::batch, compression));
+            continue;
+        }
+        if (topic == _tx_topics.end()) {
+            // Dictionary starts over when it is full, the peer replaces redefined ids
+            if (_tx_topics.size() >= constants::max_topics) {
+                _tx_topics.clear();
+                _next_topic_id = 0;
+            }
+            // First message of the topic carries its dictionary entry
+            topic = _tx_topics.emplace(message->topic(), _next_topic_id++).first;
+            writer.topic(topic->second, topic->first);
+        }
+        writer.message(topic->second, *message);
+        _pending.pop_front();
+        --_credits;
+        ++sent;
+        if (writer.size() >= constants::max_frame_size)
+            _frames.push_back(writer.finish(frame_type::batch, compression));
+    }
+    if (not writer.empty()) _frames.push_back(writer.finish(frame_type::batch, compression));
+    if (sent > 0)
+        log::print_event(_bridge.settings()->name(), _remote_address, _peer_name,
+                         network_event_type::send,
+                         std::string(frame_names::batch) + " (" + std::to_string(sent) + ')');
+    write();
+}
+
+void session::write() {
+    if (not _open or _write_in_progress or _frames.empty()) return;
+
+    std::vector<boost::asio::const_buffer> buffers;
+    while (not _frames.empty()) {
+        _writing.push_back(std::move(_frames.front()));
+        _frames.pop_front();
+        buffers.push_back(boost::asio::buffer(_writing.back()));
+    }
+    _write_in_progress = true;
+
+    auto self = shared_from_this();
+    boost::asio::async_write(
+        _socket, buffers, [this, self](const boost::system::error_code &ec, std::size_t) {
+            _write_in_progress = false;
+            _writing.clear();
+            if (ec) {
+                if (ec != boost::asio::error::operation_aborted) fail(ec.message());
+                return;
+            }
+            flush();
+        });
+}
+
+const address &session::remote_address() const { return _remote_address; }
+
+const node_id &session::peer_node() const { return _peer_node; }
+
+bridge::bridge(const octopus_mq::adapter_settings_ptr adapter_settings,
+               message_queue& global_queue)
+    : adapter_interface(adapter_settings, global_queue),
+      _work(boost::asio::make_work_guard(_ioc)),
+      _acceptor(_ioc),
+      _reconnect_timer(_ioc),
+      _reconnect_delay(constants::min_reconnect_delay),
+      _inbox("egress") {
+    if (link_settings()->role() == mqtt::adapter_role::broker) {
+        tcp::endpoint endpoint(tcp::v4(), static_cast<std::uint16_t>(_adapter_settings->port()));
+        if (_adapter_settings->phy().ip() != network::constants::null_ip)
+            endpoint.address(boost::asio::ip::make_address(_adapter_settings->phy().ip_string()));
+        _acceptor.open(endpoint.protocol());
+        _acceptor.set_option(tcp::acceptor::reuse_address(true));
+        _acceptor.bind(endpoint);
+        _acceptor.listen();
+    }
+}
+
+link::adapter_settings_ptr bridge::link_settings() const {
+    return std::static_pointer_cast<link::adapter_settings>(_adapter_settings);
+}
+
+inline void bridge::worker() {
+    const tuning_settings &tuning = _adapter_settings->tuning();
+    tuning.apply_to_thread(_adapter_settings->name());
+    if (tuning.busy_poll())
+        while (not _ioc.stopped()) _ioc.poll();
+    else
+        _ioc.run();
+}
+
+inline void bridge::accept() {
+    _acceptor.async_accept([this](const boost::system::error_code &ec, tcp::socket socket) {
+        if (ec) {
+            if (ec != boost::asio::error::operation_aborted)
+                log::print(log_type::error, _adapter_settings->name() + ": " + ec.message());
+            return;
+        }
+        session_ptr new_session = std::make_shared<session>(*this, std::move(socket));
+        _sessions.insert(new_session);
+        new_session->start();
+        accept();
+    });
+}
+
+inline void bridge::connect() {
+    const address &remote = link_settings()->remote_address();
+    auto socket = std::make_shared<tcp::socket>(_ioc);
+    // Addresses are stored in network byte order
+    tcp::endpoint endpoint(boost::asio::ip::address_v4(ntohl(remote.ip())),
+                           static_cast<std::uint16_t>(remote.port()));
+    socket->async_connect(endpoint, [this, socket](const boost::system::error_code &ec) {
+        if (ec) {
+            if (ec == boost::asio::error::operation_aborted) return;
+            log::print(log_type::error, _adapter_settings->name() + ": " + ec.message() + " at " +
+                                            link_settings()->remote_address().to_string() + '.');
+            return schedule_reconnect();
+        }
+        session_ptr new_session = std::make_shared<session>(*this, std::move(*socket));
+        _sessions.insert(new_session);
+        new_session->start();
+    });
+}
+
+inline void bridge::schedule_reconnect() {
+    _reconnect_timer.expires_after(_reconnect_delay);
+    _reconnect_timer.async_wait([this](const boost::system::error_code &ec) {
+        if (not ec) connect();
+    });
+    _reconnect_delay = std::min(_reconnect_delay * 2, constants::max_reconnect_delay);
+}
+
+inline void bridge::drain_inbox() {
+    std::vector<injected_message> inbox;
+    std::unique_lock<std::mutex> inbox_lock(_inbox_mutex);
+    inbox.reserve(_inbox.size());
+    for (injected_message item; _inbox.pop(item);) inbox.push_back(std::move(item));
+    inbox_lock.unlock();
+    // Message is handed off once every link encoded it or dropped it
+    for (auto &session : _sessions) {
+        for (auto &item : inbox) session->enqueue(item.first, item.second);
+        session->flush();
+    }
+}
+
+void bridge::receive(const session &origin, const message_ptr message) {
+    // Forwarding is not dispatched by the queue, so the message is held for the links before
+    // the queue could checkpoint it
+    message->hold();
+    // Only messages which were not seen by this node yet are forwarded to other links
+    if (not _global_queue.push(_adapter_settings, message)) return;
+    const handoff_receipt receipt = _global_queue.receipt(message);
+    for (auto &session : _sessions)
+        if (session.get() != &origin) session->enqueue(message, receipt);
+}
+
+void bridge::received_batch() {
+    for (auto &session : _sessions) session->flush();
+}
+
+void bridge::established(const session &) { _reconnect_delay = constants::min_reconnect_delay; }
+
+void bridge::closed(const session_ptr session) {
+    _sessions.erase(session);
+    if (link_settings()->role() == mqtt::adapter_role::client and _work.owns_work())
+        schedule_reconnect();
+}
+
+void bridge::run() {
+    if (link_settings()->role() == mqtt::adapter_role::broker)
+        accept();
+    else
+        connect();
+    _thread = std::thread(&bridge::worker, this);
+}
+
+void bridge::stop() {
+    if (_thread.joinable()) {
+        boost::asio::post(_ioc, [this]() {
+            _work.reset();
+            _reconnect_timer.cancel();
+            boost::system::error_code ec;
+            _acceptor.close(ec);
+            for (auto &session : _sessions) session->close();
+            _sessions.clear();
+        });
+        _thread.join();
+    }
+}
+
+void bridge::inject_publish(const message_ptr message) {
+    handoff_receipt receipt = _global_queue.receipt(message);
+    std::unique_lock<std::mutex> inbox_lock(_inbox_mutex);
+    const bool schedule = _inbox.empty();
+    _inbox.configure(_global_queue.priorities());
+    _inbox.push(message->priority(), injected_message(message, std::move(receipt)));
+    inbox_lock.unlock();
+    // A single drain is scheduled for all messages injected before it runs
+    if (schedule) boost::asio::post(_ioc, [this]() { drain_inbox(); });
+}
+
+}  // namespace octopus_mq::link
@@ -0,0 +1,133 @@
+#ifndef OCTOMQ_LINK_BRIDGE_H_
+#define OCTOMQ_LINK_BRIDGE_H_
+
+#include "network/adapter.hpp"
+#include "network/link/adapter.hpp"
+#include "network/message.hpp"
+#include "network/network.hpp"
+#include "threads/link/frame.hpp"
+
+#include <boost/asio.hpp>
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace octopus_mq::link {
+
+namespace frame_names {
+
+    constexpr char hello[] = "hello";
+    constexpr char batch[] = "batch";
+    constexpr char credit[] = "credit";
+
+}  // namespace frame_names
+
+namespace constants {
+
+    constexpr std::chrono::seconds min_reconnect_delay = std::chrono::seconds(1);
+    constexpr std::chrono::seconds max_reconnect_delay = std::chrono::seconds(30);
+    constexpr std::size_t max_frames_per_write = 16;
+    constexpr std::size_t max_pending = 0x10000;  // Messages waiting for credits of a link
+
+}  // namespace constants
+
+class bridge;
+
+// Single TCP connection to another octopusMQ node. All methods must be called from the
+// io_context thread of the owning bridge.
+class session : public std::enable_shared_from_this<session> {
+    bridge &_bridge;
+    boost::asio::ip::tcp::socket _socket;
+    address _remote_address;
+    std::string _peer_name;
+    node_id _peer_node;
+    bool _open;
+
+    // Receiving side
+    std::array<char, constants::header_size> _header;
+    frame_buffer _body;
+    std::unordered_map<topic_id, topic_handle> _rx_topics;
+    std::uint32_t _rx_window;
+    std::uint32_t _rx_consumed;  // messages received since the last credit grant
+
+    // Sending side
+    std::unordered_map<std::string, topic_id> _tx_topics;
+    topic_id _next_topic_id;
+    // Newest messages are dropped when it is full. Receipts are released once messages are
+    // encoded into frames.
+    std::deque<std::pair<message_ptr, handoff_receipt>> _pending;
+    std::uint64_t _credits;  // messages which could be sent without waiting for a credit grant
+    std::deque<frame_buffer> _frames;
+    std::vector<frame_buffer> _writing;
+    bool _write_in_progress;
+
+    void read_header();
+    void read_body();
+    void handle_frame();
+    void handle_batch(frame_reader &reader);
+    void write();
+    void fail(const std::string &reason);
+
+   public:
+    session(bridge &bridge, boost::asio::ip::tcp::socket socket);
+
+    void start();
+    void close();
+    void enqueue(const message_ptr message, const handoff_receipt &receipt);
+    void flush();
+
+    const address &remote_address() const;
+    const node_id &peer_node() const;
+};
+
+using session_ptr = std::shared_ptr<session>;
+
+// Adapter connecting octopusMQ nodes with a batched binary protocol over TCP (see frame.hpp).
+// In broker role it accepts any number of links, in client role it keeps a single link to the
+// remote node and reconnects when the link is lost.
+class bridge final : public adapter_interface {
+    boost::asio::io_context _ioc;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> _work;
+    boost::asio::ip::tcp::acceptor _acceptor;
+    boost::asio::steady_timer _reconnect_timer;
+    std::chrono::seconds _reconnect_delay;
+    std::thread _thread;
+    std::set<session_ptr> _sessions;
+
+    priority_lanes<injected_message> _inbox;  // Highest priority messages are batched first
+    std::mutex _inbox_mutex;
+
+    inline void worker();
+    inline void accept();
+    inline void connect();
+    inline void schedule_reconnect();
+    inline void drain_inbox();
+
+   public:
+    bridge(const octopus_mq::adapter_settings_ptr adapter_settings, message_queue& global_queue);
+
+    void run();
+    void stop();
+
+    void inject_publish(const message_ptr message);
+
+    // Session callbacks, called from the io_context thread
+    void receive(const session &origin, const message_ptr message);
+    void received_batch();
+    void established(const session &session);
+    void closed(const session_ptr session);
+
+    link::adapter_settings_ptr link_settings() const;
+};
+
+}  // namespace octopus_mq::link
+
+#endif
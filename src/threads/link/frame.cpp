@@ -0,0 +1,264 @@
+#include "threads/link/frame.hpp"
+
+#include "core/error.hpp"
+
+#include <cstring>
+
+#ifdef OCTOMQ_ENABLE_LZ4
+#include <lz4.h>
+#endif
+#ifdef OCTOMQ_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace octopus_mq::link {
+
+frame_writer::frame_writer() : _buffer(constants::header_size) {}
+
+void frame_writer::put_uint8(const std::uint8_t value) { _buffer.push_back(value); }
+
+void frame_writer::put_uint16(const std::uint16_t value) {
+    put_uint8(value >> 8);
+    put_uint8(value & 0xff);
+}
+
+void frame_writer::put_uint32(const std::uint32_t value) {
+    put_uint16(value >> 16);
+    put_uint16(value & 0xffff);
+}
+
+void frame_writer::put_uint64(const std::uint64_t value) {
+    put_uint32(value >> 32);
+    put_uint32(value & 0xffffffff);
+}
+
+void frame_writer::put_bytes(const char *data, const std::size_t size) {
+    _buffer.insert(_buffer.end(), data, data + size);
+}
+
+void frame_writer::topic(const topic_id id, const std::string &topic_name) {
+    put_uint8(static_cast<std::uint8_t>(record_type::topic));
+    put_uint32(id);
+    put_uint16(topic_name.size());
+    put_bytes(topic_name.data(), topic_name.size());
+}
+
+void frame_writer::message(const topic_id id, const octopus_mq::message &message) {
+    const std::string_view payload = message.payload();
+    put_uint8(static_cast<std::uint8_t>(record_type::message));
+    put_uint32(id);
+    put_uint64(message.origin_node());
+    put_uint64(message.hash());
+    put_uint8(message.pubopts());
+    put_uint16(message.origin().size());
+    put_bytes(message.origin().data(), message.origin().size());
+    put_uint32(payload.size());
+    put_bytes(payload.data(), payload.size());
+}
+
+std::size_t frame_writer::topic_size(const std::string &topic_name) {
+    return sizeof(std::uint8_t) + sizeof(topic_id) + sizeof(std::uint16_t) + topic_name.size();
+}
+
+std::size_t frame_writer::message_size(const octopus_mq::message &message) {
+    return sizeof(std::uint8_t) + sizeof(topic_id) + sizeof(node_id) + sizeof(std::uint64_t) +
+           sizeof(std::uint8_t) + sizeof(std::uint16_t) + message.origin().size() +
+           sizeof(std::uint32_t) + message.payload().size();
+}
+
+void frame_writer::hello(const struct hello &hello) {
+    put_bytes(constants::magic, sizeof(constants::magic));
+    put_uint8(constants::version);
+    put_uint64(hello.id);
+    put_uint32(hello.window);
+}
+
+void frame_writer::credit(const std::uint32_t credit) { put_uint32(credit); }
+
+std::size_t frame_writer::size() const { return _buffer.size() - constants::header_size; }
+
+bool frame_writer::empty() const { return size() == 0; }
+
+frame_buffer frame_writer::finish(const frame_type type, const compression compression) {
+    std::uint8_t flags = 0;
+    const std::size_t body_size = size();
+
+    if (compression != compression::none and body_size >= constants::min_compressed_size) {
+        [[maybe_unused]] const char *body = _buffer.data() + constants::header_size;
+        frame_buffer compressed(constants::header_size + sizeof(std::uint32_t));
+        std::size_t compressed_size = 0;
+        switch (compression) {
+#ifdef OCTOMQ_ENABLE_LZ4
+            case compression::lz4: {
+                const int bound = LZ4_compressBound(body_size);
+                compressed.resize(compressed.size() + bound);
+                const int result =
+                    LZ4_compress_default(body, compressed.data() + constants::header_size + 4,
+                                         body_size, bound);
+                if (result > 0) {
+                    compressed_size = result;
+                    flags = frame_flags::lz4;
+                }
+                break;
+            }
+#endif
+#ifdef OCTOMQ_ENABLE_ZSTD
+            case compression::zstd: {
+                const std::size_t bound = ZSTD_compressBound(body_size);
+                compressed.resize(compressed.size() + bound);
+                const std::size_t result =
+                    ZSTD_compress(compressed.data() + constants::header_size + 4, bound, body,
+                                  body_size, 1);
+                if (not ZSTD_isError(result)) {
+                    compressed_size = result;
+                    flags = frame_flags::zstd;
+                }
+                break;
+            }
+#endif
+            default:
+                break;
+        }
+        // Compressed frame is used only if it is actually smaller
+        if (flags != 0 and compressed_size + sizeof(std::uint32_t) < body_size) {
+            compressed.resize(constants::header_size + sizeof(std::uint32_t) + compressed_size);
+            compressed[constants::header_size] = static_cast<char>(body_size >> 24);
+            compressed[constants::header_size + 1] = static_cast<char>(body_size >> 16);
+            compressed[constants::header_size + 2] = static_cast<char>(body_size >> 8);
+            compressed[constants::header_size + 3] = static_cast<char>(body_size);
+            _buffer.swap(compressed);
+        } else
+            flags = 0;
+    }
+
+    const std::uint32_t length = _buffer.size() - sizeof(std::uint32_t);
+    _buffer[0] = static_cast<char>(length >> 24);
+    _buffer[1] = static_cast<char>(length >> 16);
+    _buffer[2] = static_cast<char>(length >> 8);
+    _buffer[3] = static_cast<char>(length);
+    _buffer[4] = static_cast<char>(type);
+    _buffer[5] = static_cast<char>(flags);
+
+    frame_buffer frame;
+    frame.swap(_buffer);
+    _buffer.resize(constants::header_size);
+    return frame;
+}
+
+frame_reader::frame_reader(const char *body, const std::size_t size, const std::uint8_t flags)
+    : _data(body), _size(size), _offset(0) {
+    if ((flags & (frame_flags::lz4 | frame_flags::zstd)) == 0) return;
+
+    const std::uint32_t original_size = get_uint32();
+    if (original_size > constants::max_accepted_frame_size)
+        throw link_protocol_error("decompressed frame is too large");
+    _decompressed.resize(original_size);
+    [[maybe_unused]] const char *compressed = _data + _offset;
+    [[maybe_unused]] const std::size_t compressed_size = _size - _offset;
+
+    if (flags & frame_flags::lz4) {
+#ifdef OCTOMQ_ENABLE_LZ4
+        if (LZ4_decompress_safe(compressed, _decompressed.data(), compressed_size,
+                                original_size) != static_cast<int>(original_size))
+            throw link_protocol_error("corrupted lz4 frame");
+#else
+        throw link_protocol_error("lz4 compression is not supported by this node");
+#endif
+    } else {
+#ifdef OCTOMQ_ENABLE_ZSTD
+        if (ZSTD_decompress(_decompressed.data(), original_size, compressed, compressed_size) !=
+            original_size)
+            throw link_protocol_error("corrupted zstd frame");
+#else
+        throw link_protocol_error("zstd compression is not supported by this node");
+#endif
+    }
+    _data = _decompressed.data();
+    _size = _decompressed.size();
+    _offset = 0;
+}
+
+std::uint32_t frame_reader::frame_length(const char *header) {
+    return (static_cast<std::uint32_t>(static_cast<std::uint8_t>(header[0])) << 24) |
+           (static_cast<std::uint32_t>(static_cast<std::uint8_t>(header[1])) << 16) |
+           (static_cast<std::uint32_t>(static_cast<std::uint8_t>(header[2])) << 8) |
+           static_cast<std::uint32_t>(static_cast<std::uint8_t>(header[3]));
+}
+
+frame_type frame_reader::type(const char *header) { return static_cast<frame_type>(header[4]); }
+
+std::uint8_t frame_reader::flags(const char *header) { return header[5]; }
+
+void frame_reader::require(const std::size_t size) const {
+    if (_offset + size > _size) throw link_protocol_error("truncated frame");
+}
+
+std::uint8_t frame_reader::get_uint8() {
+    require(1);
+    return static_cast<std::uint8_t>(_data[_offset++]);
+}
+
+std::uint16_t frame_reader::get_uint16() {
+    const std::uint16_t high = get_uint8();
+    return (high << 8) | get_uint8();
+}
+
+std::uint32_t frame_reader::get_uint32() {
+    const std::uint32_t high = get_uint16();
+    return (high << 16) | get_uint16();
+}
+
+std::uint64_t frame_reader::get_uint64() {
+    const std::uint64_t high = get_uint32();
+    return (high << 32) | get_uint32();
+}
+
+bool frame_reader::at_end() const { return _offset >= _size; }
+
+record_type frame_reader::next_record() { return static_cast<record_type>(get_uint8()); }
+
+void frame_reader::topic(topic_id &id, std::string &topic_name) {
+    id = get_uint32();
+    const std::uint16_t length = get_uint16();
+    require(length);
+    topic_name.assign(_data + _offset, length);
+    _offset += length;
+}
+
+message_ptr frame_reader::message(topic_id &id) {
+    id = get_uint32();
+    const node_id origin_node = get_uint64();
+    const message_hash hash = get_uint64();
+    const std::uint8_t pubopts = get_uint8();
+
+    const std::uint16_t origin_length = get_uint16();
+    require(origin_length);
+    std::string origin(_data + _offset, origin_length);
+    _offset += origin_length;
+
+    const std::uint32_t payload_length = get_uint32();
+    require(payload_length);
+    message_ptr shared_message = std::make_shared<octopus_mq::message>(message_payload(), pubopts);
+    shared_message->payload(_data + _offset, payload_length);
+    _offset += payload_length;
+
+    shared_message->origin(origin);
+    shared_message->stamp(origin_node, hash);
+    return shared_message;
+}
+
+struct hello frame_reader::hello() {
+    require(sizeof(constants::magic));
+    if (memcmp(_data + _offset, constants::magic, sizeof(constants::magic)) != 0)
+        throw link_protocol_error("peer is not an octopusMQ node");
+    _offset += sizeof(constants::magic);
+    if (get_uint8() != constants::version) throw link_protocol_error("unsupported version");
+    struct hello hello;
+    hello.id = get_uint64();
+    hello.window = get_uint32();
+    return hello;
+}
+
+std::uint32_t frame_reader::credit() { return get_uint32(); }
+
+}  // namespace octopus_mq::link
@@ -0,0 +1,126 @@
+#ifndef OCTOMQ_LINK_FRAME_H_
+#define OCTOMQ_LINK_FRAME_H_
+
+#include "network/link/adapter.hpp"
+#include "network/mesh.hpp"
+#include "network/message.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Link protocol between octopusMQ nodes.
+//
+// Stream is a sequence of frames. All integers are big-endian.
+//   frame:  length (u32, size of everything after this field), type (u8), flags (u8), body
+// If frame is compressed (flags has lz4 or zstd bit), body is
+//   uncompressed size (u32), compressed data
+//
+// Frame types:
+//   hello:  magic "OCMQ" (4), version (u8), node id (u64), window (u32)
+//           Sent once by both sides right after connection. Window is the number of messages
+//           the peer may send before it receives the first credit frame.
+//   batch:  sequence of records
+//   credit: number of messages (u32) the peer is allowed to send in addition to its window
+//
+// Batch records:
+//   topic:   kind (u8), topic id (u32), topic length (u16), topic
+//            Defines an entry of the sender's topic dictionary, valid until the id is defined
+//            again. Ids are below max_topics, the sender starts over from zero when it runs
+//            out of them.
+//   message: kind (u8), topic id (u32), origin node (u64), hash (u64), pubopts (u8),
+//            origin client id length (u16), origin client id, payload length (u32), payload
+
+namespace octopus_mq::link {
+
+using topic_id = std::uint32_t;
+using frame_buffer = std::vector<char>;
+
+enum class frame_type : std::uint8_t { hello = 1, batch = 2, credit = 3 };
+
+enum class record_type : std::uint8_t { topic = 1, message = 2 };
+
+namespace frame_flags {
+
+    constexpr std::uint8_t lz4 = 0x01;
+    constexpr std::uint8_t zstd = 0x02;
+
+}  // namespace frame_flags
+
+namespace constants {
+
+    constexpr char magic[] = { 'O', 'C', 'M', 'Q' };
+    constexpr std::uint8_t version = 1;
+    constexpr std::size_t header_size = 6;          // length, type, flags
+    constexpr std::size_t max_frame_size = 0x10000;  // batches are closed at this size
+    constexpr std::size_t max_accepted_frame_size = 0x4000000;
+    constexpr topic_id max_topics = 0x10000;  // Entries of a topic dictionary
+    constexpr std::size_t min_compressed_size = 256;
+
+}  // namespace constants
+
+struct hello {
+    node_id id;
+    std::uint32_t window;
+};
+
+// Builds a single frame. Records are appended to the body, header is written by finish().
+class frame_writer {
+    frame_buffer _buffer;
+
+    void put_uint8(const std::uint8_t value);
+    void put_uint16(const std::uint16_t value);
+    void put_uint32(const std::uint32_t value);
+    void put_uint64(const std::uint64_t value);
+    void put_bytes(const char *data, const std::size_t size);
+
+   public:
+    frame_writer();
+
+    void topic(const topic_id id, const std::string &topic_name);
+    void message(const topic_id id, const octopus_mq::message &message);
+    // Encoded sizes of the records
+    static std::size_t topic_size(const std::string &topic_name);
+    static std::size_t message_size(const octopus_mq::message &message);
+    void hello(const struct hello &hello);
+    void credit(const std::uint32_t credit);
+
+    std::size_t size() const;
+    bool empty() const;
+
+    // Writes frame header, optionally compresses the body and returns the frame
+    frame_buffer finish(const frame_type type, const compression compression = compression::none);
+};
+
+// Parses body of a single frame received from the link
+class frame_reader {
+    const char *_data;
+    std::size_t _size;
+    std::size_t _offset;
+    frame_buffer _decompressed;
+
+    void require(const std::size_t size) const;
+    std::uint8_t get_uint8();
+    std::uint16_t get_uint16();
+    std::uint32_t get_uint32();
+    std::uint64_t get_uint64();
+
+   public:
+    // Body must stay valid while the reader is used
+    frame_reader(const char *body, const std::size_t size, const std::uint8_t flags);
+
+    static std::uint32_t frame_length(const char *header);
+    static frame_type type(const char *header);
+    static std::uint8_t flags(const char *header);
+
+    bool at_end() const;
+    record_type next_record();
+    void topic(topic_id &id, std::string &topic_name);
+    message_ptr message(topic_id &id);
+    struct hello hello();
+    std::uint32_t credit();
+};
+
+}  // namespace octopus_mq::link
+
+#endif
@@ -1,5 +1,10 @@
 #include "threads/mqtt/broker.hpp"
+#include "core/error.hpp"
 #include "core/log.hpp"
+#include "core/memory_budget.hpp"
+#include "core/metrics.hpp"
+
+#include <charconv>
 
 #include <boost/asio/ip/address.hpp>
 
@@ -34,53 +39,599 @@ static string boost_error_to_string(const mqtt_cpp::error_code& error) {
     }
 }
 
+// Removes Topic Alias property from the properties and returns its value.
+// Aliases are valid only within a single connection, so they are never forwarded.
+static topic_alias take_topic_alias(mqtt_cpp::v5::properties& props) {
+    topic_alias alias = topic_alias_constants::null_alias;
+    auto is_alias = [&alias](const mqtt_cpp::v5::property_variant& prop) {
+        return mqtt_cpp::visit(
+            mqtt_cpp::make_lambda_visitor(
+                [&alias](const mqtt_cpp::v5::property::topic_alias& property) {
+                    alias = property.val();
+                    return true;
+                },
+                [](const auto&) { return false; }),
+            prop);
+    };
+    props.erase(std::remove_if(props.begin(), props.end(), is_alias), props.end());
+    return alias;
+}
+
+static topic_alias topic_alias_maximum(const mqtt_cpp::v5::properties& props) {
+    topic_alias maximum = topic_alias_constants::null_alias;
+    auto visitor = mqtt_cpp::make_lambda_visitor(
+        [&maximum](const mqtt_cpp::v5::property::topic_alias_maximum& property) {
+            maximum = property.val();
+        },
+        [](const auto&) {});
+    for (auto const& prop : props) mqtt_cpp::visit(visitor, prop);
+    return maximum;
+}
+
+static std::uint32_t maximum_packet_size(const mqtt_cpp::v5::properties& props) {
+    std::uint32_t maximum = 0;
+    auto visitor = mqtt_cpp::make_lambda_visitor(
+        [&maximum](const mqtt_cpp::v5::property::maximum_packet_size& property) {
+            maximum = property.val();
+        },
+        [](const auto&) {});
+    for (auto const& prop : props) mqtt_cpp::visit(visitor, prop);
+    return maximum;
+}
+
+static std::uint32_t subscription_identifier(const mqtt_cpp::v5::properties& props) {
+    std::uint32_t identifier = 0;
+    auto visitor = mqtt_cpp::make_lambda_visitor(
+        [&identifier](const mqtt_cpp::v5::property::subscription_identifier& property) {
+            identifier = static_cast<std::uint32_t>(property.val());
+        },
+        [](const auto&) {});
+    for (auto const& prop : props) mqtt_cpp::visit(visitor, prop);
+    return identifier;
+}
+
+// Returns number of messages per topic requested by the history user property of SUBSCRIBE,
+// zero for all of them. Returns nothing if history was not requested.
+static std::optional<std::size_t> history_request(const mqtt_cpp::v5::properties& props) {
+    std::optional<std::size_t> count;
+    auto visitor = mqtt_cpp::make_lambda_visitor(
+        [&count](const mqtt_cpp::v5::property::user_property& property) {
+            if (std::string_view(property.key()) != history_config::constants::user_property)
+                return;
+            const std::string_view value = property.val();
+            std::size_t parsed = 0;
+            if (value.empty()) {
+                count = parsed;
+                return;
+            }
+            const auto [end, ec] =
+                std::from_chars(value.data(), value.data() + value.size(), parsed);
+            if (ec == std::errc() and end == value.data() + value.size()) count = parsed;
+        },
+        [](const auto&) {});
+    for (auto const& prop : props) mqtt_cpp::visit(visitor, prop);
+    return count;
+}
+
+// Returns conflation interval requested by the user property of SUBSCRIBE, the adapter
+// default if none
+template <typename Server>
+inline std::chrono::milliseconds broker<Server>::conflation_request(
+    const mqtt_cpp::v5::properties& props) const {
+    std::chrono::milliseconds interval = _conflation;
+    auto visitor = mqtt_cpp::make_lambda_visitor(
+        [&interval](const mqtt_cpp::v5::property::user_property& property) {
+            if (std::string_view(property.key()) != conflation_config::constants::user_property)
+                return;
+            const std::string_view value = property.val();
+            std::uint32_t parsed = 0;
+            const auto [end, ec] =
+                std::from_chars(value.data(), value.data() + value.size(), parsed);
+            if (ec == std::errc() and end == value.data() + value.size())
+                interval = std::chrono::milliseconds(parsed);
+        },
+        [](const auto&) {});
+    for (auto const& prop : props) mqtt_cpp::visit(visitor, prop);
+    return interval;
+}
+
+// Returns expression of the payload filter user property of SUBSCRIBE, empty if none
+static std::string_view payload_filter_request(const mqtt_cpp::v5::properties& props) {
+    std::string_view expression;
+    auto visitor = mqtt_cpp::make_lambda_visitor(
+        [&expression](const mqtt_cpp::v5::property::user_property& property) {
+            if (std::string_view(property.key()) == payload_filter_config::constants::user_property)
+                expression = property.val();
+        },
+        [](const auto&) {});
+    for (auto const& prop : props) mqtt_cpp::visit(visitor, prop);
+    return expression;
+}
+
+template <typename Server>
+inline void broker<Server>::unsubscribe(const connection_id id,
+                                        const std::vector<mqtt_cpp::buffer>& topics) {
+    auto& idx = _subs.template get<topic_connection_tag>();
+    for (auto const& topic : topics)
+        if (auto iter = idx.find(std::make_tuple(id, topic)); iter != idx.end()) idx.erase(iter);
+}
+
 template <typename Server>
-inline void broker<Server>::close_connection(connection_sp const& con) {
-    _connections.erase(con);
-    _meta.erase(con);
+inline void broker<Server>::close_connection(const connection_id id) {
+    _registry.remove(id);
     std::lock_guard<std::mutex> subs_lock(_subs_mutex);
-    _connections.erase(con);
     auto& idx = _subs.template get<connection_tag>();
-    auto r = idx.equal_range(con);
+    auto r = idx.equal_range(id);
     idx.erase(r.first, r.second);
 }
 
 template <typename Server>
-inline void broker<Server>::share(const mqtt_cpp::buffer& topic_name,
+inline bool broker<Server>::admit_connection() {
+    if (_admission.max_connections != 0 and _registry.size() >= _admission.max_connections)
+        return false;
+    return not _accept_bucket or
+           _accept_bucket->try_take(1, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                           std::chrono::steady_clock::now().time_since_epoch())
+                                           .count());
+}
+
+template <typename Server>
+inline bool broker<Server>::defer_connect(const connection_id id, std::function<void()> handle) {
+    if (_admission.connect_batch == 0) {
+        handle();
+        return true;
+    }
+    _connects.emplace_back(id, std::move(handle));
+    metrics::add(metric::connects_deferred);
+    if (not _connects_scheduled) {
+        _connects_scheduled = true;
+        post(_ioc, [this] { drain_connects(); });
+    }
+    // Reading resumes after CONNACK is sent by drain_connects()
+    return false;
+}
+
+template <typename Server>
+inline void broker<Server>::drain_connects() {
+    for (std::size_t i = 0; i < _admission.connect_batch and not _connects.empty(); ++i) {
+        auto [id, handle] = std::move(_connects.front());
+        _connects.pop_front();
+        // Connection could be closed while its CONNECT was waiting
+        auto con = _registry.lock(id);
+        if (not con) continue;
+        handle();
+        con->async_read_next_message(con);
+    }
+    if (_connects.empty())
+        _connects_scheduled = false;
+    else
+        // The rest waits behind handlers that became ready meanwhile
+        post(_ioc, [this] { drain_connects(); });
+}
+
+template <typename Server>
+inline void broker<Server>::turn_wheel() {
+    _wheel_timer.expires_after(_keep_alive_wheel.tick());
+    _wheel_timer.async_wait([this](const boost::system::error_code& ec) {
+        if (ec) return;
+        _keep_alive_wheel.advance(std::chrono::steady_clock::now());
+        _history.sweep();
+        turn_wheel();
+    });
+}
+
+template <typename Server>
+inline void broker<Server>::keep_alive(const connection_id id, const std::uint16_t keep_alive) {
+    if (keep_alive == 0) return;
+    _keep_alive_wheel.schedule(_registry[id].keep_alive,
+                               std::chrono::milliseconds(std::uint64_t(keep_alive) * 1500),
+                               [this, id] {
+                                   if (_registry.contains(id)) keep_alive_expired(id);
+                               });
+}
+
+template <typename Server>
+inline void broker<Server>::keep_alive_expired(const connection_id id) {
+    log::print(log_type::warning, _adapter_settings->name() + ": keep alive expired at " +
+                                      _registry[id].address.to_string() + " (" +
+                                      _registry[id].client_id + ").");
+    metrics::add(metric::keep_alive_expired);
+    if (_registry[id].protocol_version == version::v5)
+        _registry.connection(id).disconnect(
+            mqtt_cpp::v5::disconnect_reason_code::keep_alive_timeout);
+    else
+        _registry.connection(id).force_disconnect();
+    close_connection(id);
+}
+
+template <typename Server>
+inline bool broker<Server>::oversized(const connection_id id, const std::size_t size) {
+    if (_max_packet_size == 0 or size <= _max_packet_size) return false;
+    log::print(log_type::error, _adapter_settings->name() + ": packet of " +
+                                    log::size_to_string(size) + " exceeds " +
+                                    "maximum packet size at " +
+                                    _registry[id].address.to_string() + " (" +
+                                    _registry[id].client_id + ").");
+    if (_registry[id].protocol_version == version::v5)
+        _registry.connection(id).disconnect(
+            mqtt_cpp::v5::disconnect_reason_code::packet_too_large);
+    else
+        _registry.connection(id).force_disconnect();
+    close_connection(id);
+    return true;
+}
+
+template <typename Server>
+inline bool broker<Server>::admit(const connection_id id,
+                                  const mqtt_cpp::optional<packet_id_t> packet_id,
+                                  const mqtt_cpp::qos qos, const topic_handle& topic,
+                                  const std::size_t size, std::chrono::nanoseconds& delay) {
+    if (_rate_limiter.admit(_registry[id].limit, topic, size, delay)) return true;
+    log::print_event(_adapter_settings->name(), _registry[id].address, _registry[id].client_id,
+                     network_event_type::receive,
+                     std::string(packet_names::publish) + " rejected (rate limit)");
+    acknowledge(id, packet_id, qos, false);
+    return false;
+}
+
+template <typename Server>
+inline void broker<Server>::acknowledge(const connection_id id,
+                                        const mqtt_cpp::optional<packet_id_t> packet_id,
+                                        const mqtt_cpp::qos qos, const bool accepted) {
+    // QoS 0 messages are not acknowledged, refused ones are silently dropped.
+    // MQTT v3 has no reason codes, a refused message is not acknowledged, so the publisher
+    // sends it again after reconnecting.
+    if (not packet_id) return;
+    if (not accepted and _registry[id].protocol_version == version::v3) return;
+    connection& con = _registry.connection(id);
+    if (qos == mqtt_cpp::qos::at_least_once) {
+        con.puback(*packet_id, accepted ? mqtt_cpp::v5::puback_reason_code::success
+                                        : mqtt_cpp::v5::puback_reason_code::quota_exceeded);
+        log::print_event(_adapter_settings->name(), _registry[id].address, _registry[id].client_id,
+                         network_event_type::send, packet_names::puback);
+    } else if (qos == mqtt_cpp::qos::exactly_once) {
+        con.pubrec(*packet_id, accepted ? mqtt_cpp::v5::pubrec_reason_code::success
+                                        : mqtt_cpp::v5::pubrec_reason_code::quota_exceeded);
+        log::print_event(_adapter_settings->name(), _registry[id].address, _registry[id].client_id,
+                         network_event_type::send, packet_names::pubrec);
+    }
+}
+
+template <typename Server>
+inline bool broker<Server>::continue_reading(const connection_id id,
+                                             const std::chrono::nanoseconds delay) {
+    if (delay.count() == 0 and not memory_budget::exceeded()) return true;
+    pause_reading(id, delay);
+    return false;
+}
+
+template <typename Server>
+inline void broker<Server>::pause_reading(const connection_id id,
+                                          const std::chrono::nanoseconds delay) {
+    // Publish handler returned false, so the next packet is read only when timer expires.
+    // TCP flow control then slows the client down.
+    auto timer = std::make_shared<boost::asio::steady_timer>(
+        _ioc, std::max<std::chrono::nanoseconds>(delay, std::chrono::nanoseconds(0)));
+    timer->async_wait([this, timer, id](const boost::system::error_code& ec) {
+        if (ec) return;
+        // Connection could be closed while reading was paused
+        auto con = _registry.lock(id);
+        if (not con) return;
+        if (memory_budget::exceeded())
+            pause_reading(id, memory_config::constants::recheck_interval);
+        else
+            con->async_read_next_message(con);
+    });
+}
+
+template <typename Server>
+inline void broker<Server>::fan_out(const topic_handle& topic, const mqtt_cpp::buffer& topic_name,
+                                    const mqtt_cpp::buffer& contents,
+                                    const std::string_view& document,
+                                    const mqtt_cpp::publish_options pubopts,
+                                    const mqtt_cpp::v5::properties& props,
+                                    const std::optional<connection_id> publisher,
+                                    const handoff_receipt& receipt) {
+    _matches.clear();
+    _verdicts.clear();
+    auto const& idx = _subs.template get<topic_tag>();
+    for (auto& sub : idx)
+        if (scope::matches_filter(sub.filter, topic) and
+            not(sub.nl_value == mqtt_cpp::nl::yes and publisher == sub.con) and
+            (not sub.predicate or passes(*sub.predicate, document)))
+            _matches.push_back(
+                { sub.con, sub.qos_value, sub.rap_value, sub.identifier, sub.conflation });
+    if (_deliver_once)
+        // Matches of the same connection become adjacent and are merged below
+        std::sort(_matches.begin(), _matches.end(),
+                  [](const match& a, const match& b) { return a.con < b.con; });
+
+    publish_cache cache(topic_name, contents, props);
+    for (auto first = _matches.begin(); first != _matches.end();) {
+        auto last = std::next(first);
+        mqtt_cpp::qos qos_value = first->qos_value;
+        mqtt_cpp::rap rap_value = first->rap_value;
+        bool identified = first->identifier != 0;
+        // Any subscription taking every message makes the connection take it
+        std::chrono::milliseconds conflation = first->conflation;
+        for (; _deliver_once and last != _matches.end() and last->con == first->con; ++last) {
+            qos_value = std::max(qos_value, last->qos_value);
+            if (last->rap_value == mqtt_cpp::rap::retain) rap_value = mqtt_cpp::rap::retain;
+            identified = identified or last->identifier != 0;
+            conflation = std::min(conflation, last->conflation);
+        }
+        qos_value = std::min(qos_value, pubopts.get_qos());
+
+        struct metadata& meta = _registry[first->con];
+        connection& con = _registry.connection(first->con);
+        // Retain As Published is an MQTT v5 option, v3 subscribers never get the flag
+        const mqtt_cpp::retain retain =
+            (meta.protocol_version == mqtt::version::v5 and rap_value == mqtt_cpp::rap::retain)
+                ? pubopts.get_retain()
+                : mqtt_cpp::retain::no;
+        // Subscriber learns which of its subscriptions matched
+        auto subscriber_props = [&props, first, last] {
+            mqtt_cpp::v5::properties result = props;
+            for (auto item = first; item != last; ++item)
+                if (item->identifier != 0)
+                    result.emplace_back(
+                        mqtt_cpp::v5::property::subscription_identifier(item->identifier));
+            return result;
+        };
+        if (conflation.count() != 0) {
+            conflate(first->con,
+                     { topic, topic_name, contents, qos_value | retain,
+                       meta.protocol_version == mqtt::version::v5 ? subscriber_props()
+                                                                 : mqtt_cpp::v5::properties(),
+                       receipt },
+                     conflation);
+            first = last;
+            continue;
+        }
+        // Subscription identifiers and outbound aliases make the packet unique to the subscriber
+        if (not identified and (meta.protocol_version == mqtt::version::v3 or
+                                meta.aliases_tx.maximum() == topic_alias_constants::null_alias) and
+            cache.send(con, meta.protocol_version, qos_value | retain, meta.max_packet_size))
+            metrics::add(metric::publishes_shared);
+        else if (meta.protocol_version == mqtt::version::v3)
+            con.publish(topic_name, contents, qos_value);
+        else
+            publish_v5(first->con, topic_name, contents, qos_value | retain, subscriber_props());
+        log::print_event(_adapter_settings->name(), meta.address, meta.client_id,
+                         network_event_type::send,
+                         std::string(packet_names::publish) + " (" +
+                             log::size_to_string(contents.size()) + ')');
+        first = last;
+    }
+}
+
+template <typename Server>
+inline bool broker<Server>::share(const connection_id id,
+                                  const mqtt_cpp::optional<packet_id_t> packet_id,
+                                  const topic_handle& topic, const mqtt_cpp::buffer& topic_name,
                                   const mqtt_cpp::buffer& contents,
                                   const mqtt_cpp::publish_options& pubopts,
                                   const mqtt::version version,
-                                  const mqtt_cpp::v5::properties& props) {
-    message_payload payload(contents.begin(), contents.end());
-    std::string topic(topic_name);
-    message_ptr shared_message =
-        std::make_shared<message>(std::move(payload), topic, std::uint8_t(pubopts), version, props);
-    _global_queue.push(_adapter_settings, shared_message);
+                                  const mqtt_cpp::v5::properties& props,
+                                  const std::chrono::nanoseconds delay) {
+    message_ptr shared_message = std::make_shared<message>(
+        message_payload(), topic, std::uint8_t(pubopts), version, props);
+    shared_message->payload(contents.data(), contents.size());
+    const payload_format format = _transcoding.ingress();
+    const mqtt_cpp::qos qos = pubopts.get_qos();
+    if (format != payload_format::json) {
+        if (_transcoder and _transcoding.offloaded(contents.size())) {
+            // Reading stays paused until the message is shared, so the connection's messages
+            // keep their order
+            post(*_transcoder, [this, id, packet_id, shared_message, topic_name, pubopts,
+                                props, format, delay] {
+                transcode_ingress(*shared_message, format);
+                post(_ioc, [this, id, packet_id, shared_message, topic_name, pubopts, props,
+                            delay] {
+                    publish_local(id, shared_message, topic_name, pubopts, props);
+                    push(id, packet_id, pubopts.get_qos(), shared_message);
+                    if (_registry.contains(id)) pause_reading(id, delay);
+                });
+            });
+            return false;
+        }
+        transcode_ingress(*shared_message, format);
+    }
+    publish_local(id, shared_message, topic_name, pubopts, props);
+    push(id, packet_id, qos, shared_message);
+    return true;
+}
+
+template <typename Server>
+inline void broker<Server>::publish_local(const connection_id id, const message_ptr& message,
+                                          const mqtt_cpp::buffer& topic_name,
+                                          const mqtt_cpp::publish_options pubopts,
+                                          const mqtt_cpp::v5::properties& props) {
+    // Payload is decoded once by share(), which also passes the JSON on to other adapters
+    const mqtt_cpp::buffer egress = egress_contents(message);
+    std::lock_guard<std::mutex> _subs_lock(_subs_mutex);
+    fan_out(message->interned_topic(), topic_name, egress, message->payload(), pubopts, props,
+            id);
+}
+
+template <typename Server>
+inline void broker<Server>::push(const connection_id id,
+                                 const mqtt_cpp::optional<packet_id_t> packet_id,
+                                 const mqtt_cpp::qos qos, const message_ptr& message) {
+    _history.record(message);
+    const bool accepted = _global_queue.push(_adapter_settings, message);
+    if (_registry.contains(id)) acknowledge(id, packet_id, qos, accepted);
+}
+
+template <typename Server>
+inline mqtt_cpp::buffer broker<Server>::egress_contents(const message_ptr& message) {
+    if (_transcoding.egress() != payload_format::json)
+        if (transcoded_ptr converted = transcode_egress(*message, _transcoding.egress());
+            converted->payload)
+            // Buffer keeps the conversion alive
+            return mqtt_cpp::buffer(
+                std::string_view(converted->payload->data(), converted->payload->size()),
+                converted);
+    return mqtt_cpp::buffer(message->payload(), message);
+}
+
+template <typename Server>
+inline void broker<Server>::conflate(const connection_id id, conflation_buffer::entry&& entry,
+                                     const std::chrono::milliseconds interval) {
+    conflation_buffer& buffer = _registry[id].conflated;
+    if (buffer.queue(std::move(entry), interval)) metrics::add(metric::conflated);
+    const std::uint64_t timer_id = buffer.schedule();
+    if (timer_id == 0) return;
+    auto timer = std::make_shared<boost::asio::steady_timer>(_ioc, buffer.flush_time());
+    timer->async_wait([this, timer, id, timer_id](const boost::system::error_code& ec) {
+        // Queued messages are dropped with the connection, a replaced timer does nothing
+        if (not ec and _registry.contains(id) and _registry[id].conflated.armed(timer_id))
+            flush_conflated(id);
+    });
+}
+
+template <typename Server>
+inline void broker<Server>::flush_conflated(const connection_id id) {
+    // Outbound aliases used by publish_v5() are guarded by _subs_mutex
+    std::lock_guard<std::mutex> _subs_lock(_subs_mutex);
+    struct metadata& meta = _registry[id];
+    connection& con = _registry.connection(id);
+    for (auto& item : meta.conflated.take()) {
+        if (meta.protocol_version == mqtt::version::v3)
+            con.publish(item.topic_name, item.contents, item.pubopts);
+        else
+            publish_v5(id, item.topic_name, item.contents, item.pubopts, std::move(item.props));
+        log::print_event(_adapter_settings->name(), meta.address, meta.client_id,
+                         network_event_type::send,
+                         std::string(packet_names::publish) + " (" +
+                             log::size_to_string(item.contents.size()) + ')');
+    }
+}
+
+template <typename Server>
+inline bool broker<Server>::passes(const payload_filter& predicate,
+                                   const std::string_view& document) {
+    for (auto& [filter, verdict] : _verdicts)
+        if (filter == &predicate) return verdict;
+    const bool verdict = predicate.evaluate(document);
+    _verdicts.emplace_back(&predicate, verdict);
+    metrics::add(verdict ? metric::payload_filter_passed : metric::payload_filter_dropped);
+    return verdict;
+}
+
+template <typename Server>
+inline void broker<Server>::replay_history(const connection_id id, const topic_handle& filter,
+                                           const std::size_t count, const mqtt_cpp::qos qos,
+                                           const payload_filter_ptr& predicate) {
+    if (not _registry.contains(id)) return;
+    const std::vector<message_ptr> messages = _history.replay(filter, count);
+    if (messages.empty()) return;
+    std::lock_guard<std::mutex> _subs_lock(_subs_mutex);
+    for (auto& message : messages) {
+        // Buffers keep the message alive, as in deliver()
+        mqtt_cpp::buffer topic_name(std::string_view(message->interned_topic().name()),
+                                    message);
+        _verdicts.clear();
+        if (predicate and not passes(*predicate, message->payload())) continue;
+        mqtt_cpp::buffer contents = egress_contents(message);
+        const mqtt_cpp::qos qos_value =
+            std::min(qos, mqtt_cpp::publish_options(message->pubopts()).get_qos());
+        publish_v5(id, topic_name, contents, qos_value | mqtt_cpp::retain::no, message->props());
+    }
+    metrics::add(metric::history_replayed, messages.size());
+    log::print_event(_adapter_settings->name(), _registry[id].address, _registry[id].client_id,
+                     network_event_type::send,
+                     std::string(packet_names::publish) + " (" +
+                         std::to_string(messages.size()) + " from history)");
+}
+
+template <typename Server>
+inline void broker<Server>::publish_v5(const connection_id id, const mqtt_cpp::buffer& topic_name,
+                                       const mqtt_cpp::buffer& contents,
+                                       const mqtt_cpp::publish_options pubopts,
+                                       mqtt_cpp::v5::properties props) {
+    struct metadata& meta = _registry[id];
+    connection& con = _registry.connection(id);
+    bool mapped = false;
+    const topic_alias alias = (meta.protocol_version == version::v5)
+                                  ? meta.aliases_tx.assign(std::string(topic_name), mapped)
+                                  : topic_alias_constants::null_alias;
+    if (alias == topic_alias_constants::null_alias)
+        return con.publish(topic_name, contents, pubopts, std::move(props));
+
+    props.emplace_back(mqtt_cpp::v5::property::topic_alias(alias));
+    if (mapped) {
+        // Client already knows the alias, topic name is omitted
+        metrics::add(metric::topic_alias_tx_saved,
+                     topic_name.size() - topic_alias_constants::property_size);
+        con.publish(mqtt_cpp::buffer(), contents, pubopts, std::move(props));
+    } else
+        con.publish(topic_name, contents, pubopts, std::move(props));
 }
 
 template <typename Server>
 inline void broker<Server>::worker() {
+    const tuning_settings &tuning = _adapter_settings->tuning();
+    tuning.apply_to_thread(_adapter_settings->name());
     _server->listen();
-    _ioc.run();
+    turn_wheel();
+    if (tuning.busy_poll())
+        // Latency mode: handlers are run as soon as they are ready, thread never sleeps
+        while (not _ioc.stopped()) _ioc.poll();
+    else
+        _ioc.run();
 }
 
 template <typename Server>
 broker<Server>::broker(const octopus_mq::adapter_settings_ptr adapter_settings,
                        message_queue& global_queue)
-    : adapter_interface(adapter_settings, global_queue) {
+    : adapter_interface(adapter_settings, global_queue),
+      _keep_alive_wheel(_wheel_tick),
+      _wheel_timer(_ioc),
+      _deliver_once(
+          std::static_pointer_cast<mqtt::adapter_settings>(adapter_settings)->deliver_once()),
+      _conflation(
+          std::static_pointer_cast<mqtt::adapter_settings>(adapter_settings)->conflation()),
+      _history(std::static_pointer_cast<mqtt::adapter_settings>(adapter_settings)->history()),
+      _transcoding(
+          std::static_pointer_cast<mqtt::adapter_settings>(adapter_settings)->transcoding()),
+      _egress("egress"),
+      _egress_scheduled(false),
+      _rate_limiter(
+          std::static_pointer_cast<mqtt::adapter_settings>(adapter_settings)->rate_limits()),
+      _max_packet_size(
+          std::static_pointer_cast<mqtt::adapter_settings>(adapter_settings)->max_packet_size()),
+      _admission(std::static_pointer_cast<mqtt::adapter_settings>(adapter_settings)->admission()),
+      _connects_scheduled(false) {
+    if (_transcoding.enabled() and _transcoding.offload_size() != 0)
+        _transcoder = std::make_unique<boost::asio::thread_pool>(1);
+    if (_admission.accept_rate != 0)
+        _accept_bucket =
+            std::make_unique<token_bucket>(_admission.accept_rate, _admission.accept_burst);
+    // Connection contexts are preallocated up to the connection limit
+    const std::size_t preallocated =
+        _admission.max_connections != 0
+            ? std::min(_admission.max_connections, admission_config::constants::max_preallocated)
+            : admission_config::constants::default_preallocated;
+    _registry.reserve(preallocated);
+
     // When octopus_mq::phy gets the name defined in OCTOMQ_IFACE_NAME_ANY
     // instead of correct interface name (which means any interface should be listened),
     // it stores address defined in OCTOMQ_NULL_IP as an interface IP address.
+    auto acceptor_config = [this](ip::tcp::acceptor& acceptor) {
+        _adapter_settings->tuning().apply_to_listener(acceptor.native_handle(),
+                                                      _adapter_settings->name());
+    };
     if (_adapter_settings->phy().ip() == network::constants::null_ip)
         _server = std::make_unique<Server>(
             ip::tcp::endpoint(ip::tcp::v4(),
                               boost::lexical_cast<uint16_t>(_adapter_settings->port())),
-            _ioc);
+            _ioc, _ioc, acceptor_config);
     else
         _server = std::make_unique<Server>(
             ip::tcp::endpoint(ip::make_address(_adapter_settings->phy().ip_string()),
                               boost::lexical_cast<uint16_t>(_adapter_settings->port())),
-            _ioc);
+            _ioc, _ioc, acceptor_config);
 
     _server->set_error_handler([](mqtt_cpp::error_code ec) {
         // 'Operation cancelled' occurs when control thread stops the broker
@@ -91,148 +642,179 @@ broker<Server>::broker(const octopus_mq::adapter_settings_ptr adapter_settings,
 
     _server->set_accept_handler([this](connection_sp spep) {
         auto& ep = *spep;
-        std::weak_ptr<connection> wp(spep);
+        boost::system::error_code ec;
 
-        auto llre = ep.socket().lowest_layer().remote_endpoint();
+        // Refused connections cost no more system calls than closing them
+        if (not admit_connection()) {
+            // Session is not started, so the connection is released with spep
+            log::print(log_type::warning, _adapter_settings->name() + ": connection refused.");
+            metrics::add(metric::connections_refused);
+            ep.socket().lowest_layer().close(ec);
+            return;
+        }
+        const auto llre = ep.socket().lowest_layer().remote_endpoint(ec);
+        if (ec) {
+            // Client has already reset the connection
+            ep.socket().lowest_layer().close(ec);
+            return;
+        }
         address remote_address(llre.address().to_string(), llre.port());
-        _meta[spep].address = remote_address;
+        const connection_id id = _registry.add(spep);
+        _registry[id].address = remote_address;
+        _adapter_settings->tuning().apply_to_socket(ep.socket().lowest_layer().native_handle(),
+                                                    _adapter_settings->name());
 
-        // Pass spep to keep lifetime.
-        // It makes sure wp.lock() never return nullptr in the handlers below
-        // including close_handler and error_handler.
+        // Pass spep to keep lifetime until the connection is closed.
+        // Handlers below refer to the connection by id, so they capture no shared pointers
+        // and ignore packets that arrive after the connection was removed.
         ep.start_session(std::move(spep));
+        // Acknowledgements are written by the handlers below, so every write of the connection
+        // is synchronous on the broker thread and packets of publish_cache never interleave
+        // with writes queued by the endpoint
+        ep.set_auto_pub_response(false);
 
-        using packet_id_t = typename std::remove_reference_t<decltype(ep)>::packet_id_t;
+        // Any received packet postpones keep alive expiry
+        // Oversized packets are refused before they are read
+        ep.set_is_valid_length_handler([this, id](mqtt_cpp::control_packet_type,
+                                                  std::size_t size) {
+            if (not _registry.contains(id)) return true;
+            _keep_alive_wheel.touch(_registry[id].keep_alive);
+            return not oversized(id, size);
+        });
 
         // Set connection level handlers (lower than MQTT)
-        ep.set_close_handler([this, wp]() {
+        ep.set_close_handler([this, id]() {
             log::print(log_type::info, _adapter_settings->name() + ": connection closed.");
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            this->close_connection(sp);
+            this->close_connection(id);
         });
 
-        ep.set_error_handler([this, wp](mqtt_cpp::error_code ec) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
+        ep.set_error_handler([this, id](mqtt_cpp::error_code ec) {
             // Connection may be already closed by close_handler
             // In this case socket error may pop up, but that is expected
-            if (_connections.find(sp) != _connections.end()) {
-                std::string message =
-                    boost_error_to_string(ec) + " at " + _meta[sp].address.to_string();
-                if (not _meta[sp].client_id.empty()) message += " (" + _meta[sp].client_id + ").";
+            if (_registry.contains(id)) {
+                const struct metadata& meta = _registry[id];
+                std::string message = boost_error_to_string(ec) + " at " + meta.address.to_string();
+                if (not meta.client_id.empty()) message += " (" + meta.client_id + ").";
                 log::print(log_type::error, _adapter_settings->name() + ": " + message);
-                this->close_connection(sp);
+                this->close_connection(id);
             }
         });
 
-        ep.set_pingreq_handler([this, wp]() {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::pingreq);
+        ep.set_pingreq_handler([this, id]() {
+            auto sp = _registry.lock(id);
+            if (not sp) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
+                             packet_names::pingreq);
             sp->pingresp();
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::send, packet_names::pingresp);
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::send,
+                             packet_names::pingresp);
             return true;
         });
 
         // Set handlers for MQTTv3 protocol
-        ep.set_connect_handler([this, wp](mqtt_cpp::buffer client_id,
+        ep.set_connect_handler([this, id](mqtt_cpp::buffer client_id,
                                           mqtt_cpp::optional<mqtt_cpp::buffer> /*username*/,
                                           mqtt_cpp::optional<mqtt_cpp::buffer> /*password*/,
                                           mqtt_cpp::optional<mqtt_cpp::will>,
-                                          bool /*clean_session*/, std::uint16_t /*keep_alive*/) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            this->_connections.insert(sp);
-            this->_meta[sp].client_id = client_id;
-            this->_meta[sp].protocol_version = version::v3;
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::connect);
-            sp->connack(false, mqtt_cpp::connect_return_code::accepted);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::send, packet_names::connack);
-            return true;
+                                          bool /*clean_session*/, std::uint16_t keep_alive) {
+            if (not _registry.contains(id)) return true;
+            return defer_connect(id, [this, id, client_id, keep_alive] {
+                this->_registry[id].client_id = client_id;
+                this->_registry[id].protocol_version = version::v3;
+                this->_registry[id].limit = _rate_limiter.client_limit();
+                log::print_event(_adapter_settings->name(), _registry[id].address,
+                                 _registry[id].client_id, network_event_type::receive,
+                                 packet_names::connect);
+                _registry.connection(id).connack(false, mqtt_cpp::connect_return_code::accepted);
+                log::print_event(_adapter_settings->name(), _registry[id].address,
+                                 _registry[id].client_id, network_event_type::send,
+                                 packet_names::connack);
+                this->keep_alive(id, keep_alive);
+            });
         });
 
-        ep.set_disconnect_handler([this, wp]() {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::disconnect);
-            this->close_connection(sp);
+        ep.set_disconnect_handler([this, id]() {
+            if (not _registry.contains(id)) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
+                             packet_names::disconnect);
+            this->close_connection(id);
             return true;
         });
 
-        ep.set_puback_handler([this, wp](packet_id_t /*packet_id*/) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::puback);
+        ep.set_puback_handler([this, id](packet_id_t /*packet_id*/) {
+            if (not _registry.contains(id)) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
+                             packet_names::puback);
             return true;
         });
 
-        ep.set_pubrec_handler([this, wp](packet_id_t /*packet_id*/) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::pubrec);
+        ep.set_pubrec_handler([this, id](packet_id_t packet_id) {
+            auto sp = _registry.lock(id);
+            if (not sp) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
+                             packet_names::pubrec);
+            sp->pubrel(packet_id);
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::send,
+                             packet_names::pubrel);
             return true;
         });
 
-        ep.set_pubrel_handler([this, wp](packet_id_t /*packet_id*/) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::pubrel);
+        ep.set_pubrel_handler([this, id](packet_id_t packet_id) {
+            auto sp = _registry.lock(id);
+            if (not sp) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
+                             packet_names::pubrel);
+            sp->pubcomp(packet_id);
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::send,
+                             packet_names::pubcomp);
             return true;
         });
 
-        ep.set_pubcomp_handler([this, wp](packet_id_t /*packet_id*/) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::pubcomp);
+        ep.set_pubcomp_handler([this, id](packet_id_t /*packet_id*/) {
+            if (not _registry.contains(id)) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
+                             packet_names::pubcomp);
             return true;
         });
 
-        ep.set_publish_handler([this, wp](mqtt_cpp::optional<packet_id_t> /*packet_id*/,
+        ep.set_publish_handler([this, id](mqtt_cpp::optional<packet_id_t> packet_id,
                                           mqtt_cpp::publish_options pubopts,
                                           mqtt_cpp::buffer topic_name, mqtt_cpp::buffer contents) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive,
+            if (not _registry.contains(id)) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
                              std::string(packet_names::publish) + " (" +
                                  log::size_to_string(contents.size()) + ')');
-            std::unique_lock<std::mutex> _subs_lock(this->_subs_mutex);
-            auto const& idx = this->_subs.template get<topic_tag>();
-            for (auto& sub : idx) {
-                if (scope::matches_filter(sub.topic_filter, topic_name)) {
-                    sub.con->publish(topic_name, contents,
-                                     std::min(sub.qos_value, pubopts.get_qos()));
-                    auto llre = sub.con->socket().lowest_layer().remote_endpoint();
-                    address remote_address(llre.address().to_string(), llre.port());
-                    log::print_event(_adapter_settings->name(), remote_address,
-                                     _meta[sub.con].client_id, network_event_type::send,
-                                     std::string(packet_names::publish) + " (" +
-                                         log::size_to_string(contents.size()) + ')');
-                }
-            }
-            _subs_lock.unlock();
-            this->share(topic_name, contents, pubopts, mqtt::version::v3);
-            return true;
+            const topic_handle topic = topic_table::intern(topic_name);
+            if (memory_budget::shed(static_cast<std::uint8_t>(pubopts.get_qos())))
+                return continue_reading(id, std::chrono::nanoseconds(0));
+            std::chrono::nanoseconds delay;
+            if (not admit(id, packet_id, pubopts.get_qos(), topic, contents.size(), delay))
+                return continue_reading(id, std::chrono::nanoseconds(0));
+            if (not this->share(id, packet_id, topic, topic_name, contents, pubopts,
+                                mqtt::version::v3, mqtt_cpp::v5::properties(), delay))
+                return false;
+            return continue_reading(id, delay);
         });
 
         ep.set_subscribe_handler(
-            [this, wp](
+            [this, id](
                 packet_id_t packet_id,
                 std::vector<std::tuple<mqtt_cpp::buffer, mqtt_cpp::subscribe_options>> entries) {
-                auto sp = wp.lock();
-                BOOST_ASSERT(sp);
-                log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                                 network_event_type::receive, packet_names::subscribe);
+                auto sp = _registry.lock(id);
+                if (not sp) return true;
+                log::print_event(_adapter_settings->name(), _registry[id].address,
+                                 _registry[id].client_id, network_event_type::receive,
+                                 packet_names::subscribe);
                 std::vector<mqtt_cpp::suback_return_code> res;
                 res.reserve(entries.size());
                 for (auto const& e : entries) {
@@ -241,178 +823,256 @@ broker<Server>::broker(const octopus_mq::adapter_settings_ptr adapter_settings,
                     if (scope::valid_topic_filter(topic_filter)) {
                         res.emplace_back(mqtt_cpp::qos_to_suback_return_code(qos_value));
                         std::lock_guard<std::mutex> _subs_lock(this->_subs_mutex);
-                        this->_subs.emplace(std::move(topic_filter), sp, qos_value);
+                        this->_subs.emplace(std::move(topic_filter), id, qos_value,
+                                            _conflation);
                     } else
                         res.emplace_back(mqtt_cpp::suback_return_code::failure);
                 }
                 sp->suback(packet_id, res);
-                log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                                 network_event_type::send, packet_names::suback);
+                log::print_event(_adapter_settings->name(), _registry[id].address,
+                                 _registry[id].client_id, network_event_type::send,
+                                 packet_names::suback);
                 return true;
             });
 
         ep.set_unsubscribe_handler(
-            [this, wp](packet_id_t packet_id, std::vector<mqtt_cpp::buffer> topics) {
-                auto sp = wp.lock();
-                BOOST_ASSERT(sp);
-                log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                                 network_event_type::receive, packet_names::unsubscribe);
+            [this, id](packet_id_t packet_id, std::vector<mqtt_cpp::buffer> topics) {
+                auto sp = _registry.lock(id);
+                if (not sp) return true;
+                log::print_event(_adapter_settings->name(), _registry[id].address,
+                                 _registry[id].client_id, network_event_type::receive,
+                                 packet_names::unsubscribe);
                 std::unique_lock<std::mutex> _subs_lock(this->_subs_mutex);
-                for (auto const& topic : topics) this->_subs.erase(topic);
+                unsubscribe(id, topics);
                 _subs_lock.unlock();
                 sp->unsuback(packet_id);
-                log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                                 network_event_type::send, packet_names::unsuback);
+                log::print_event(_adapter_settings->name(), _registry[id].address,
+                                 _registry[id].client_id, network_event_type::send,
+                                 packet_names::unsuback);
                 return true;
             });
 
         // Set handlers for MQTTv5 protocol
         ep.set_v5_connect_handler(
-            [this, wp](mqtt_cpp::buffer client_id,
+            [this, id](mqtt_cpp::buffer client_id,
                        mqtt_cpp::optional<mqtt_cpp::buffer> const& /*username*/,
                        mqtt_cpp::optional<mqtt_cpp::buffer> const& /*password*/,
                        mqtt_cpp::optional<mqtt_cpp::will>, bool /*clean_start*/,
-                       std::uint16_t /*keep_alive*/, mqtt_cpp::v5::properties) {
-                auto sp = wp.lock();
-                BOOST_ASSERT(sp);
-                this->_connections.insert(sp);
-                this->_meta[sp].client_id = client_id;
-                this->_meta[sp].protocol_version = version::v5;
-                log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                                 network_event_type::receive, packet_names::connect);
-                sp->connack(false, mqtt_cpp::v5::connect_reason_code::success);
-                log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                                 network_event_type::send, packet_names::connack);
-                return true;
+                       std::uint16_t keep_alive, mqtt_cpp::v5::properties props) {
+                if (not _registry.contains(id)) return true;
+                return defer_connect(id, [this, id, client_id, keep_alive,
+                                          props = std::move(props)] {
+                    this->_registry[id].client_id = client_id;
+                    this->_registry[id].protocol_version = version::v5;
+                    this->_registry[id].limit = _rate_limiter.client_limit();
+                    std::unique_lock<std::mutex> _subs_lock(this->_subs_mutex);
+                    this->_registry[id].aliases_tx.maximum(topic_alias_maximum(props));
+                    this->_registry[id].max_packet_size = maximum_packet_size(props);
+                    _subs_lock.unlock();
+                    log::print_event(_adapter_settings->name(), _registry[id].address,
+                                     _registry[id].client_id, network_event_type::receive,
+                                     packet_names::connect);
+                    mqtt_cpp::v5::properties connack_props{
+                        mqtt_cpp::v5::property::topic_alias_maximum(
+                            topic_alias_constants::receive_maximum)
+                    };
+                    // Advertised limit is also enforced by mqtt_cpp before the packet is buffered
+                    if (_max_packet_size != 0)
+                        connack_props.emplace_back(
+                            mqtt_cpp::v5::property::maximum_packet_size(_max_packet_size));
+                    _registry.connection(id).connack(false,
+                                                     mqtt_cpp::v5::connect_reason_code::success,
+                                                     std::move(connack_props));
+                    log::print_event(_adapter_settings->name(), _registry[id].address,
+                                     _registry[id].client_id, network_event_type::send,
+                                     packet_names::connack);
+                    this->keep_alive(id, keep_alive);
+                });
             });
 
         ep.set_v5_disconnect_handler(
-            [this, wp](mqtt_cpp::v5::disconnect_reason_code /*reason_code*/,
+            [this, id](mqtt_cpp::v5::disconnect_reason_code /*reason_code*/,
                        mqtt_cpp::v5::properties) {
-                auto sp = wp.lock();
-                BOOST_ASSERT(sp);
-                log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                                 network_event_type::receive, packet_names::disconnect);
-                this->close_connection(sp);
+                if (not _registry.contains(id)) return true;
+                log::print_event(_adapter_settings->name(), _registry[id].address,
+                                 _registry[id].client_id, network_event_type::receive,
+                                 packet_names::disconnect);
+                this->close_connection(id);
                 return true;
             });
 
-        ep.set_v5_puback_handler([this, wp](packet_id_t /*packet_id*/,
+        ep.set_v5_puback_handler([this, id](packet_id_t /*packet_id*/,
                                             mqtt_cpp::v5::puback_reason_code /*reason_code*/,
                                             mqtt_cpp::v5::properties) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::puback);
+            if (not _registry.contains(id)) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
+                             packet_names::puback);
             return true;
         });
 
-        ep.set_v5_pubrec_handler([this, wp](packet_id_t /*packet_id*/,
-                                            mqtt_cpp::v5::pubrec_reason_code /*reason_code*/,
+        ep.set_v5_pubrec_handler([this, id](packet_id_t packet_id,
+                                            mqtt_cpp::v5::pubrec_reason_code reason_code,
                                             mqtt_cpp::v5::properties) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::pubrec);
+            auto sp = _registry.lock(id);
+            if (not sp) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
+                             packet_names::pubrec);
+            // Refused message ends the exchange, pubrel is sent only for accepted ones
+            if (reason_code < mqtt_cpp::v5::pubrec_reason_code::unspecified_error) {
+                sp->pubrel(packet_id);
+                log::print_event(_adapter_settings->name(), _registry[id].address,
+                                 _registry[id].client_id, network_event_type::send,
+                                 packet_names::pubrel);
+            }
             return true;
         });
 
-        ep.set_v5_pubrel_handler([this, wp](packet_id_t /*packet_id*/,
+        ep.set_v5_pubrel_handler([this, id](packet_id_t packet_id,
                                             mqtt_cpp::v5::pubrel_reason_code /*reason_code*/,
                                             mqtt_cpp::v5::properties) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::pubrel);
+            auto sp = _registry.lock(id);
+            if (not sp) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
+                             packet_names::pubrel);
+            sp->pubcomp(packet_id);
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::send,
+                             packet_names::pubcomp);
             return true;
         });
 
-        ep.set_v5_pubcomp_handler([this, wp](packet_id_t /*packet_id*/,
+        ep.set_v5_pubcomp_handler([this, id](packet_id_t /*packet_id*/,
                                              mqtt_cpp::v5::pubcomp_reason_code /*reason_code*/,
                                              mqtt_cpp::v5::properties) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::pubcomp);
+            if (not _registry.contains(id)) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
+                             packet_names::pubcomp);
             return true;
         });
 
-        ep.set_v5_publish_handler([this, wp](mqtt_cpp::optional<packet_id_t> /*packet_id*/,
+        ep.set_v5_publish_handler([this, id](mqtt_cpp::optional<packet_id_t> packet_id,
                                              mqtt_cpp::publish_options pubopts,
                                              mqtt_cpp::buffer topic_name, mqtt_cpp::buffer contents,
                                              mqtt_cpp::v5::properties props) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive,
+            auto sp = _registry.lock(id);
+            if (not sp) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
                              std::string(packet_names::publish) + " (" +
                                  log::size_to_string(contents.size()) + ')');
-            std::unique_lock<std::mutex> _subs_lock(this->_subs_mutex);
-            auto const& idx = this->_subs.template get<topic_tag>();
-            for (auto& sub : idx) {
-                if (scope::matches_filter(sub.topic_filter, topic_name)) {
-                    if (sub.nl_value == mqtt_cpp::nl::yes && sub.con == sp) continue;
-                    mqtt_cpp::retain retain = (sub.rap_value == mqtt_cpp::rap::retain)
-                                                  ? pubopts.get_retain()
-                                                  : mqtt_cpp::retain::no;
-                    sub.con->publish(topic_name, contents,
-                                     std::min(sub.qos_value, pubopts.get_qos()) | retain, props);
-                    auto llre = sub.con->socket().lowest_layer().remote_endpoint();
-                    address remote_address(llre.address().to_string(), llre.port());
-                    log::print_event(_adapter_settings->name(), remote_address,
-                                     _meta[sub.con].client_id, network_event_type::send,
-                                     std::string(packet_names::publish) + " (" +
-                                         log::size_to_string(contents.size()) + ')');
+            if (topic_alias alias = take_topic_alias(props);
+                alias != topic_alias_constants::null_alias) {
+                std::string aliased_topic(topic_name);
+                if (not _registry[id].aliases_rx.resolve(alias, aliased_topic)) {
+                    log::print(log_type::error, _adapter_settings->name() +
+                                                    ": invalid topic alias at " +
+                                                    _registry[id].address.to_string() + " (" +
+                                                    _registry[id].client_id + ").");
+                    sp->disconnect(mqtt_cpp::v5::disconnect_reason_code::topic_alias_invalid);
+                    this->close_connection(id);
+                    return true;
+                }
+                if (topic_name.empty()) {
+                    metrics::add(metric::topic_alias_rx_saved,
+                                 aliased_topic.size() - topic_alias_constants::property_size);
+                    topic_name = mqtt_cpp::allocate_buffer(aliased_topic);
                 }
             }
-            _subs_lock.unlock();
-            this->share(topic_name, contents, pubopts, mqtt::version::v5, props);
-            return true;
+            const topic_handle topic = topic_table::intern(topic_name);
+            if (memory_budget::shed(static_cast<std::uint8_t>(pubopts.get_qos())))
+                return continue_reading(id, std::chrono::nanoseconds(0));
+            std::chrono::nanoseconds delay;
+            if (not admit(id, packet_id, pubopts.get_qos(), topic, contents.size(), delay))
+                return continue_reading(id, std::chrono::nanoseconds(0));
+            if (not this->share(id, packet_id, topic, topic_name, contents, pubopts,
+                                mqtt::version::v5, props, delay))
+                return false;
+            return continue_reading(id, delay);
         });
 
         ep.set_v5_subscribe_handler(
-            [this, wp](
+            [this, id](
                 packet_id_t packet_id,
                 std::vector<std::tuple<mqtt_cpp::buffer, mqtt_cpp::subscribe_options>> entries,
-                mqtt_cpp::v5::properties) {
-                auto sp = wp.lock();
-                BOOST_ASSERT(sp);
-                log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                                 network_event_type::receive, packet_names::subscribe);
+                mqtt_cpp::v5::properties props) {
+                auto sp = _registry.lock(id);
+                if (not sp) return true;
+                log::print_event(_adapter_settings->name(), _registry[id].address,
+                                 _registry[id].client_id, network_event_type::receive,
+                                 packet_names::subscribe);
+                // Identifier applies to all topic filters of the packet
+                const std::uint32_t identifier = subscription_identifier(props);
+                const std::optional<std::size_t> history =
+                    _history.empty() ? std::nullopt : history_request(props);
+                const std::chrono::milliseconds conflation = conflation_request(props);
+                // Predicate also applies to all topic filters, subscribers share its program
+                payload_filter_ptr predicate;
+                bool predicate_valid = true;
+                if (const std::string_view expression = payload_filter_request(props);
+                    not expression.empty()) {
+                    _payload_filters.collect();
+                    try {
+                        predicate = _payload_filters.get(expression);
+                    } catch (const filter_syntax_error& error) {
+                        predicate_valid = false;
+                        log::print(log_type::error, _adapter_settings->name() + ": " +
+                                                        error.what() + " at " +
+                                                        _registry[id].address.to_string() +
+                                                        " (" + _registry[id].client_id + ").");
+                    }
+                }
+                std::vector<std::pair<topic_handle, mqtt_cpp::qos>> replays;
                 std::vector<mqtt_cpp::v5::suback_reason_code> res;
                 res.reserve(entries.size());
                 for (auto const& e : entries) {
                     mqtt_cpp::buffer topic_filter = std::get<0>(e);
-                    if (scope::valid_topic_filter(topic_filter)) {
+                    if (not predicate_valid)
+                        res.emplace_back(
+                            mqtt_cpp::v5::suback_reason_code::implementation_specific_error);
+                    else if (scope::valid_topic_filter(topic_filter)) {
                         mqtt_cpp::qos qos_value = std::get<1>(e).get_qos();
                         mqtt_cpp::rap rap_value = std::get<1>(e).get_rap();
                         mqtt_cpp::nl nl_value = std::get<1>(e).get_nl();
                         res.emplace_back(mqtt_cpp::v5::qos_to_suback_reason_code(qos_value));
+                        if (history)
+                            replays.emplace_back(topic_table::intern(topic_filter), qos_value);
                         std::lock_guard<std::mutex> _subs_lock(this->_subs_mutex);
-                        this->_subs.emplace(std::move(topic_filter), sp, qos_value, rap_value,
-                                            nl_value);
+                        this->_subs.emplace(std::move(topic_filter), id, qos_value, rap_value,
+                                            nl_value, identifier, predicate, conflation);
                     } else
                         res.emplace_back(mqtt_cpp::v5::suback_reason_code::topic_filter_invalid);
                 }
                 sp->suback(packet_id, res);
-                log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                                 network_event_type::send, packet_names::suback);
+                log::print_event(_adapter_settings->name(), _registry[id].address,
+                                 _registry[id].client_id, network_event_type::send,
+                                 packet_names::suback);
+                for (auto& [filter, qos_value] : replays)
+                    post(_ioc, [this, id, filter = filter, qos_value = qos_value, history,
+                                predicate] {
+                        replay_history(id, filter, *history, qos_value, predicate);
+                    });
                 return true;
             });
 
-        ep.set_v5_unsubscribe_handler([this, wp](packet_id_t packet_id,
+        ep.set_v5_unsubscribe_handler([this, id](packet_id_t packet_id,
                                                  std::vector<mqtt_cpp::buffer> topics,
                                                  mqtt_cpp::v5::properties) {
-            auto sp = wp.lock();
-            BOOST_ASSERT(sp);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::receive, packet_names::unsubscribe);
+            auto sp = _registry.lock(id);
+            if (not sp) return true;
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::receive,
+                             packet_names::unsubscribe);
             std::unique_lock<std::mutex> _subs_lock(this->_subs_mutex);
-            for (auto const& topic : topics) this->_subs.erase(topic);
+            unsubscribe(id, topics);
             _subs_lock.unlock();
             sp->unsuback(packet_id);
-            log::print_event(_adapter_settings->name(), _meta[sp].address, _meta[sp].client_id,
-                             network_event_type::send, packet_names::unsuback);
+            log::print_event(_adapter_settings->name(), _registry[id].address,
+                             _registry[id].client_id, network_event_type::send,
+                             packet_names::unsuback);
             return true;
         });
     });
@@ -427,40 +1087,80 @@ template <typename Server>
 void broker<Server>::stop() {
     if (_thread.joinable()) {
         _ioc.stop();
-        _server->close();
         _thread.join();
+        // Conversions in progress post their results to the io context. Once they finish,
+        // the worker is dropped, so what is left is converted inline by the handlers below.
+        if (_transcoder) {
+            _transcoder->join();
+            _transcoder.reset();
+        }
+        _server->close();
+        // Handlers left by the stop and posted since, including egress drains and results of
+        // conversions, are run before the broker goes away
+        _ioc.restart();
+        _ioc.poll();
+    }
+}
+
+template <typename Server>
+inline void broker<Server>::drain_egress() {
+    for (std::size_t sent = 0; sent < _egress_batch; ++sent) {
+        injected_message item;
+        {
+            std::lock_guard<std::mutex> egress_lock(_egress_mutex);
+            if (not _egress.pop(item)) {
+                _egress_scheduled = false;
+                return;
+            }
+        }
+        auto& [message, receipt] = item;
+        if (_transcoder and _transcoding.egress() != payload_format::json and
+            _transcoding.offloaded(message->payload().size()) and
+            not message->transcoded(_transcoding.egress())) {
+            // Draining resumes once the payload is converted, so later messages keep their
+            // order. Ready handlers keep running meanwhile.
+            post(*_transcoder, [this, item = std::move(item)] {
+                transcode_egress(*item.first, _transcoding.egress());
+                post(_ioc, [this, item] {
+                    deliver(item.first, item.second);
+                    drain_egress();
+                });
+            });
+            return;
+        }
+        deliver(message, receipt);
     }
+    // Remaining messages are sent after pending socket operations had a chance to run
+    boost::asio::post(_ioc, [this]() { drain_egress(); });
 }
 
 template <typename Server>
 void broker<Server>::inject_publish(const message_ptr message) {
-    mqtt_cpp::buffer topic_name(std::string_view(message->topic().data(), message->topic().size()));
-    mqtt_cpp::buffer contents(
-        std::string_view(message->payload().data(), message->payload().size()));
+    handoff_receipt receipt = _global_queue.receipt(message);
+    {
+        std::lock_guard<std::mutex> egress_lock(_egress_mutex);
+        _egress.configure(_global_queue.priorities());
+        _egress.push(message->priority(), injected_message(message, std::move(receipt)));
+        if (_egress_scheduled) return;
+        _egress_scheduled = true;
+    }
+    boost::asio::post(_ioc, [this]() { drain_egress(); });
+}
+
+template <typename Server>
+inline void broker<Server>::deliver(const message_ptr& message,
+                                    const handoff_receipt& receipt) {
+    const topic_handle& topic = message->interned_topic();
+    // Buffers keep the message alive while packets referencing it are stored for resending,
+    // large payloads are sent straight from the chunk store
+    mqtt_cpp::buffer topic_name(std::string_view(topic.name()), message);
+    mqtt_cpp::buffer contents = egress_contents(message);
     mqtt_cpp::publish_options pubopts(message->pubopts());
 
+    _history.record(message);
     std::lock_guard<std::mutex> _subs_lock(_subs_mutex);
-    auto const& idx = this->_subs.template get<topic_tag>();
-    for (auto& sub : idx) {
-        if (scope::matches_filter(sub.topic_filter, topic_name)) {
-            if (message->mqtt_version() == mqtt::version::v3)
-                sub.con->publish(topic_name, contents, std::min(sub.qos_value, pubopts.get_qos()));
-            else {
-                mqtt_cpp::retain retain = (sub.rap_value == mqtt_cpp::rap::retain)
-                                              ? pubopts.get_retain()
-                                              : mqtt_cpp::retain::no;
-                sub.con->publish(topic_name, contents,
-                                 std::min(sub.qos_value, pubopts.get_qos()) | retain,
-                                 message->props());
-            }
-            auto llre = sub.con->socket().lowest_layer().remote_endpoint();
-            address remote_address(llre.address().to_string(), llre.port());
-            log::print_event(_adapter_settings->name(), remote_address, _meta[sub.con].client_id,
-                             network_event_type::send,
-                             std::string(packet_names::publish) + " (" +
-                                 log::size_to_string(contents.size()) + ')');
-        }
-    }
+    fan_out(topic, topic_name, contents, message->payload(), pubopts, message->props(),
+            std::nullopt, receipt);
 }
 
 template class broker<mqtt_cpp::server<>>;
@@ -1,47 +1,42 @@
 #ifndef OCTOMQ_MQTT_BROKER_H_
 #define OCTOMQ_MQTT_BROKER_H_
 
+#include "core/timer_wheel.hpp"
 #include "network/adapter.hpp"
+#include "network/history.hpp"
 #include "network/message.hpp"
 #include "network/mqtt/adapter.hpp"
 #include "network/network.hpp"
+#include "network/payload_filter.hpp"
+#include "network/transcoding.hpp"
 #include "threads/mqtt/config.hpp"
+#include "threads/mqtt/conflation.hpp"
+#include "threads/mqtt/connection_registry.hpp"
+#include "threads/mqtt/publish_cache.hpp"
+#include "threads/mqtt/topic_alias.hpp"
 
 #include "mqtt_server_cpp.hpp"
 
 #include <algorithm>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <mutex>
-#include <set>
+#include <optional>
 #include <thread>
+#include <tuple>
+#include <vector>
 
+#include <boost/asio/thread_pool.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/multi_index_container.hpp>
+#include <boost/multi_index/composite_key.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/static_assert.hpp>
 
 namespace octopus_mq::mqtt {
 
-namespace packet_names {
-
-    constexpr char connect[] = "connect";
-    constexpr char connack[] = "connack";
-    constexpr char publish[] = "publish";
-    constexpr char puback[] = "puback";
-    constexpr char pubrec[] = "pubrec";
-    constexpr char pubrel[] = "pubrel";
-    constexpr char pubcomp[] = "pubcomp";
-    constexpr char subscribe[] = "subscribe";
-    constexpr char suback[] = "suback";
-    constexpr char unsubscribe[] = "unsubscribe";
-    constexpr char unsuback[] = "unsuback";
-    constexpr char pingreq[] = "pingreq";
-    constexpr char pingresp[] = "pingresp";
-    constexpr char disconnect[] = "disconnect";
-
-}  // namespace packet_names
-
 namespace multi_index = boost::multi_index;
 
 struct topic_tag {};
@@ -52,6 +47,12 @@ struct metadata {
     address address;
     std::string client_id;
     mqtt::version protocol_version;
+    topic_alias_recv aliases_rx;
+    topic_alias_send aliases_tx;
+    rate_limit limit;  // Per client limit, unlimited until connected
+    wheel_timer keep_alive;  // Armed if client requested keep alive
+    std::uint32_t max_packet_size = 0;  // Maximum Packet Size of MQTT v5 client, zero is unlimited
+    conflation_buffer conflated;  // Messages of conflating subscriptions waiting for the flush
 };
 
 // Class Server must be one of the following:
@@ -73,29 +74,43 @@ class broker final : public adapter_interface {
 
     using connection = typename Server::endpoint_t;
     using connection_sp = std::shared_ptr<connection>;
+    using packet_id_t = typename connection::packet_id_t;
 
     class subscription {
        public:
         mqtt_cpp::buffer topic_filter;
-        connection_sp con;
+        topic_handle filter;  // Interned topic_filter, matched without tokenizing
+        connection_id con;
         mqtt_cpp::qos qos_value;
         mqtt_cpp::rap rap_value;
         mqtt_cpp::nl nl_value;
+        std::uint32_t identifier;  // MQTT v5 Subscription Identifier, zero if none
+        payload_filter_ptr predicate;  // Messages must pass it, null if none
+        std::chrono::milliseconds conflation;  // Zero delivers every message
 
-        subscription(mqtt_cpp::buffer topic_filter, connection_sp con, mqtt_cpp::qos qos_value)
+        subscription(mqtt_cpp::buffer topic_filter, connection_id con, mqtt_cpp::qos qos_value,
+                     std::chrono::milliseconds conflation)
             : topic_filter(std::move(topic_filter)),
-              con(std::move(con)),
+              filter(topic_table::intern(this->topic_filter)),
+              con(con),
               qos_value(qos_value),
               rap_value(mqtt_cpp::rap::dont),
-              nl_value(mqtt_cpp::nl::no) {}  // MQTT v3 constructor
+              nl_value(mqtt_cpp::nl::no),
+              identifier(0),
+              conflation(conflation) {}  // MQTT v3 constructor
 
-        subscription(mqtt_cpp::buffer topic_filter, connection_sp con, mqtt_cpp::qos qos_value,
-                     mqtt_cpp::rap rap_value, mqtt_cpp::nl nl_value)
+        subscription(mqtt_cpp::buffer topic_filter, connection_id con, mqtt_cpp::qos qos_value,
+                     mqtt_cpp::rap rap_value, mqtt_cpp::nl nl_value, std::uint32_t identifier,
+                     payload_filter_ptr predicate, std::chrono::milliseconds conflation)
             : topic_filter(std::move(topic_filter)),
-              con(std::move(con)),
+              filter(topic_table::intern(this->topic_filter)),
+              con(con),
               qos_value(qos_value),
               rap_value(rap_value),
-              nl_value(nl_value) {}  // MQTT v5 constructor
+              nl_value(nl_value),
+              identifier(identifier),
+              predicate(std::move(predicate)),
+              conflation(conflation) {}  // MQTT v5 constructor
     };
 
     using subscription_container = multi_index::multi_index_container<
@@ -106,32 +121,155 @@ class broker final : public adapter_interface {
                 BOOST_MULTI_INDEX_MEMBER(subscription, mqtt_cpp::buffer, topic_filter)>,
             multi_index::ordered_non_unique<  // Connection index
                 multi_index::tag<connection_tag>,
-                BOOST_MULTI_INDEX_MEMBER(subscription, connection_sp, con)>,
+                BOOST_MULTI_INDEX_MEMBER(subscription, connection_id, con)>,
             // Don't allow the same connection object to have the same topic multiple times.
-            // Note that this index does not get used by any code in the broker
-            // other than to enforce the uniqueness constraints.
+            // Unsubscribe looks the filters of a connection up with this index.
             multi_index::ordered_unique<
                 multi_index::tag<topic_connection_tag>,
                 multi_index::composite_key<
-                    subscription, BOOST_MULTI_INDEX_MEMBER(subscription, connection_sp, con),
+                    subscription, BOOST_MULTI_INDEX_MEMBER(subscription, connection_id, con),
                     BOOST_MULTI_INDEX_MEMBER(subscription, mqtt_cpp::buffer, topic_filter)>>>>;
 
+    // Subscription matched by a published message
+    struct match {
+        connection_id con;
+        mqtt_cpp::qos qos_value;
+        mqtt_cpp::rap rap_value;
+        std::uint32_t identifier;
+        std::chrono::milliseconds conflation;
+    };
+
    private:
+    static constexpr std::size_t _egress_batch = 64;  // Messages sent per io_context handler
+    // Resolution of keep alive timers, clients are disconnected after 1.5 keep alive intervals
+    static constexpr std::chrono::milliseconds _wheel_tick = std::chrono::milliseconds(100);
+
     boost::asio::io_context _ioc;
     std::unique_ptr<Server> _server;
     std::thread _thread;
-    std::set<connection_sp> _connections;
-    std::map<connection_sp, struct metadata> _meta;
+    timer_wheel _keep_alive_wheel;  // Keep alive timers of all connections, broker thread only
+    boost::asio::steady_timer _wheel_timer;
+    // Contexts of removed connections are reused, so an accept storm does not allocate them
+    connection_registry<connection, struct metadata> _registry;
     subscription_container _subs;
     std::mutex _subs_mutex;
+    // Overlapping subscriptions of a connection get a single copy at their highest QoS
+    const bool _deliver_once;
+    const std::chrono::milliseconds _conflation;  // Default of subscriptions, zero is off
+    std::vector<match> _matches;  // Reused by fan_out(), guarded by _subs_mutex
+    // Results of payload filters for the message being fanned out, guarded by _subs_mutex
+    std::vector<std::pair<const payload_filter*, bool>> _verdicts;
+    payload_filter_cache _payload_filters;  // Accessed only by the broker thread
+    history _history;  // Last messages of configured topics, accessed only by the broker thread
+    const transcoding_settings _transcoding;
+    // Converts large payloads off the broker thread, null if conversions are not offloaded
+    std::unique_ptr<boost::asio::thread_pool> _transcoder;
+    // Messages from other adapters wait here until the broker thread sends them,
+    // highest priority first
+    priority_lanes<injected_message> _egress;
+    bool _egress_scheduled;  // Drain handler is posted, guarded by _egress_mutex
+    std::mutex _egress_mutex;
+    rate_limiter _rate_limiter;
+    std::uint32_t _max_packet_size;  // Zero is unlimited
+    const admission_settings _admission;
+    std::unique_ptr<token_bucket> _accept_bucket;  // Null if accept rate is unlimited
+    // CONNECT packets waiting for their batch, accessed only by the broker thread
+    std::deque<std::pair<connection_id, std::function<void()>>> _connects;
+    bool _connects_scheduled;
 
-    inline void close_connection(connection_sp const& con);
+    inline void close_connection(const connection_id id);
+    // Removes filters of the connection only, requires _subs_mutex to be held
+    inline void unsubscribe(const connection_id id, const std::vector<mqtt_cpp::buffer>& topics);
     inline void worker();
+    inline void drain_egress();
+    inline void deliver(const message_ptr& message, const handoff_receipt& receipt);
+
+    // Returns false if accepted socket must be closed because of admission limits
+    inline bool admit_connection();
+    // Runs CONNECT handling in a batch after the already ready handlers, so established
+    // clients are served during connection storms. Returns true if reading could continue.
+    inline bool defer_connect(const connection_id id, std::function<void()> handle);
+    inline void drain_connects();
+
+    inline void turn_wheel();
+    // Arms keep alive timer of the connection, zero keep alive disables it
+    inline void keep_alive(const connection_id id, const std::uint16_t keep_alive);
+    inline void keep_alive_expired(const connection_id id);
+
+    // Disconnects the client if a packet of the given remaining length exceeds maximum packet
+    // size, called before the packet is read
+    inline bool oversized(const connection_id id, const std::size_t size);
+    // Checks rate limits of a received message. Returns false if it must be dropped,
+    // acknowledging it as refused when needed. Reading is paused when client is over limit.
+    inline bool admit(const connection_id id, const mqtt_cpp::optional<packet_id_t> packet_id,
+                      const mqtt_cpp::qos qos, const topic_handle& topic, const std::size_t size,
+                      std::chrono::nanoseconds& delay);
+    // Sends puback or pubrec when broker acknowledges publishes itself
+    inline void acknowledge(const connection_id id,
+                            const mqtt_cpp::optional<packet_id_t> packet_id,
+                            const mqtt_cpp::qos qos, const bool accepted);
+    // Returns true if next packet could be read right away, otherwise schedules the read
+    // after rate limit delay has passed and memory budget is not exceeded
+    inline bool continue_reading(const connection_id id, const std::chrono::nanoseconds delay);
+    inline void pause_reading(const connection_id id, const std::chrono::nanoseconds delay);
+
+    // Publishes to MQTT v5 subscriber replacing the topic with an alias when possible.
+    // Must be called with _subs_mutex locked, as outbound aliases are guarded by it.
+    inline void publish_v5(const connection_id id, const mqtt_cpp::buffer& topic_name,
+                           const mqtt_cpp::buffer& contents,
+                           const mqtt_cpp::publish_options pubopts,
+                           mqtt_cpp::v5::properties props);
+
+    // Sends the message to matching subscribers. Subscriptions with No Local option are
+    // skipped for the publisher. Packets are encoded once per variant and shared by the
+    // subscribers when possible. Packets and the retain flag follow the protocol version of
+    // each subscriber. Payload filters are evaluated on 'document', which differs from sent
+    // contents when the adapter transcodes. Conflated copies keep the receipt of a message
+    // from another adapter until they are flushed. Must be called with _subs_mutex locked.
+    inline void fan_out(const topic_handle& topic, const mqtt_cpp::buffer& topic_name,
+                        const mqtt_cpp::buffer& contents, const std::string_view& document,
+                        const mqtt_cpp::publish_options pubopts,
+                        const mqtt_cpp::v5::properties& props,
+                        const std::optional<connection_id> publisher = std::nullopt,
+                        const handoff_receipt& receipt = nullptr);
+
+    // Queues the message for the next flush of a conflating connection, replacing a queued
+    // message of the same topic. A shorter interval moves the armed flush earlier.
+    inline void conflate(const connection_id id, conflation_buffer::entry&& entry,
+                         const std::chrono::milliseconds interval);
+    // Must be called with _subs_mutex unlocked
+    inline void flush_conflated(const connection_id id);
+    inline std::chrono::milliseconds conflation_request(
+        const mqtt_cpp::v5::properties& props) const;
+
+    // Sends history of topics matching the filter to a new subscriber. Runs in a handler of
+    // its own after SUBACK, so the whole replay goes out in one batch.
+    inline void replay_history(const connection_id id, const topic_handle& filter,
+                               const std::size_t count, const mqtt_cpp::qos qos,
+                               const payload_filter_ptr& predicate);
+    // Evaluates each distinct filter once per message, _verdicts must be cleared before
+    inline bool passes(const payload_filter& predicate, const std::string_view& document);
 
-    inline void share(const mqtt_cpp::buffer& topic_name, const mqtt_cpp::buffer& contents,
-                      const mqtt_cpp::publish_options& pubopts,
-                      const mqtt::version version = mqtt::version::v3,
-                      const mqtt_cpp::v5::properties& props = mqtt_cpp::v5::properties());
+    // Sends a received message to local subscribers, passes it to other adapters and
+    // acknowledges it. Returns false if its payload was handed to the transcoding worker,
+    // which then does all of it and resumes reading.
+    inline bool share(const connection_id id, const mqtt_cpp::optional<packet_id_t> packet_id,
+                      const topic_handle& topic, const mqtt_cpp::buffer& topic_name,
+                      const mqtt_cpp::buffer& contents, const mqtt_cpp::publish_options& pubopts,
+                      const mqtt::version version, const mqtt_cpp::v5::properties& props,
+                      const std::chrono::nanoseconds delay);
+    // Fans out a received message decoded to JSON. Payload filters see the JSON document and
+    // subscribers get the egress format. Payload is sent from the message, so the receive
+    // buffer of the publisher is not kept by queued packets.
+    inline void publish_local(const connection_id id, const message_ptr& message,
+                              const mqtt_cpp::buffer& topic_name,
+                              const mqtt_cpp::publish_options pubopts,
+                              const mqtt_cpp::v5::properties& props);
+    // Acknowledges the message as accepted only if the global queue took it
+    inline void push(const connection_id id, const mqtt_cpp::optional<packet_id_t> packet_id,
+                     const mqtt_cpp::qos qos, const message_ptr& message);
+    // Payload of a message from another adapter in the egress format of this one
+    inline mqtt_cpp::buffer egress_contents(const message_ptr& message);
 
    public:
     broker(const octopus_mq::adapter_settings_ptr adapter_settings, message_queue& global_queue);
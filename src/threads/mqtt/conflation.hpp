@@ -0,0 +1,92 @@
+#ifndef OCTOMQ_MQTT_CONFLATION_H_
+#define OCTOMQ_MQTT_CONFLATION_H_
+
+#include "network/adapter.hpp"
+#include "network/topic.hpp"
+
+#include "mqtt_server_cpp.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace octopus_mq::mqtt {
+
+// Messages waiting for the next flush of a conflating connection, at most one per topic.
+// A newer message of a queued topic replaces the queued one in place, so topics keep the
+// order they were first queued in and a slow consumer gets only the latest value of each.
+// Buffers of the entries keep their data alive until the flush.
+class conflation_buffer {
+   public:
+    using clock = std::chrono::steady_clock;
+
+    struct entry {
+        topic_handle topic;
+        mqtt_cpp::buffer topic_name;
+        mqtt_cpp::buffer contents;
+        mqtt_cpp::publish_options pubopts;
+        mqtt_cpp::v5::properties props;  // Sent to MQTT v5 subscribers only
+        handoff_receipt receipt;  // Message is handed off once it is flushed or replaced
+    };
+
+   private:
+    std::vector<entry> _entries;
+    std::unordered_multimap<std::uint64_t, std::size_t> _index;  // Topic hash -> entry
+    clock::time_point _last_flush;
+    // The shortest interval of subscriptions with queued messages
+    std::chrono::milliseconds _interval = std::chrono::milliseconds::max();
+    clock::time_point _flush_time;  // Expiry of the armed flush timer
+    std::uint64_t _timer = 0;       // Id of the armed flush timer, zero if none is armed
+    std::uint64_t _last_timer = 0;
+
+   public:
+    // Returns true if the message replaced a queued one
+    bool queue(entry &&item, const std::chrono::milliseconds interval) {
+        _interval = std::min(_interval, interval);
+        auto range = _index.equal_range(item.topic.hash());
+        for (auto iter = range.first; iter != range.second; ++iter)
+            if (_entries[iter->second].topic == item.topic) {
+                _entries[iter->second] = std::move(item);
+                return true;
+            }
+        _index.emplace(item.topic.hash(), _entries.size());
+        _entries.push_back(std::move(item));
+        return false;
+    }
+
+    // Takes queued messages in their order and starts the next interval
+    std::vector<entry> take() {
+        std::vector<entry> entries;
+        entries.swap(_entries);
+        _index.clear();
+        _last_flush = clock::now();
+        _interval = std::chrono::milliseconds::max();
+        _timer = 0;
+        return entries;
+    }
+
+    // Time of the next flush, right away if the last one is older than the interval.
+    // Requires a queued message.
+    clock::time_point deadline() const { return std::max(clock::now(), _last_flush + _interval); }
+
+    // Returns id of a timer to arm for flush_time() if none is armed or the armed one expires
+    // after the deadline, as a subscription with a shorter interval joined. The armed timer
+    // becomes stale then. Returns zero if the armed timer is early enough.
+    std::uint64_t schedule() {
+        const clock::time_point time = deadline();
+        if (_timer != 0 and _flush_time <= time) return 0;
+        _flush_time = time;
+        return _timer = ++_last_timer;
+    }
+    // Returns true if the timer was not replaced and the buffer was not flushed since
+    bool armed(const std::uint64_t timer) const { return timer == _timer; }
+    const clock::time_point &flush_time() const { return _flush_time; }
+    bool empty() const { return _entries.empty(); }
+};
+
+}  // namespace octopus_mq::mqtt
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef OCTOMQ_MQTT_CONNECTION_REGISTRY_H_
+#define OCTOMQ_MQTT_CONNECTION_REGISTRY_H_
+
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+namespace octopus_mq::mqtt {
+
+// Dense index of a registry slot with the generation it had when the connection was added,
+// so an id kept after the connection is removed never refers to the slot's next occupant.
+struct connection_id {
+    std::uint32_t index;
+    std::uint32_t generation;
+
+    inline bool operator==(const connection_id &other) const {
+        return index == other.index and generation == other.generation;
+    }
+    inline bool operator!=(const connection_id &other) const { return not(*this == other); }
+    inline bool operator<(const connection_id &other) const {
+        return std::tie(index, generation) < std::tie(other.index, other.generation);
+    }
+};
+
+// Connections of a broker with their per connection context, stored in slots of fixed size
+// pages. Slots never move, so contexts could hold intrusive timers, and freed slots are
+// reused before the registry grows. Not thread safe.
+template <typename Connection, typename Context>
+class connection_registry {
+    static constexpr std::size_t _page_bits = 10;
+    static constexpr std::size_t _page_size = 1 << _page_bits;
+    static constexpr std::uint32_t _no_slot = ~std::uint32_t(0);
+
+    struct slot {
+        std::shared_ptr<Connection> con;  // Null in a free slot
+        Context context;
+        std::uint32_t generation = 0;
+        std::uint32_t next_free = _no_slot;
+    };
+
+    std::vector<std::unique_ptr<slot[]>> _pages;
+    std::uint32_t _capacity = 0;
+    std::uint32_t _free = _no_slot;  // Head of the free slot list
+    std::size_t _size = 0;
+
+    inline slot &at(const std::uint32_t index) const {
+        return _pages[index >> _page_bits][index & (_page_size - 1)];
+    }
+
+    void grow() {
+        _pages.push_back(std::make_unique<slot[]>(_page_size));
+        // Slots of the new page are pushed so the lowest index is taken first
+        for (std::uint32_t index = _capacity + _page_size; index-- > _capacity;) {
+            at(index).next_free = _free;
+            _free = index;
+        }
+        _capacity += _page_size;
+    }
+
+   public:
+    // Allocates pages for at least 'count' connections up front
+    void reserve(const std::size_t count) {
+        while (_capacity < count) grow();
+    }
+
+    connection_id add(std::shared_ptr<Connection> con) {
+        if (_free == _no_slot) grow();
+        const std::uint32_t index = _free;
+        slot &entry = at(index);
+        _free = entry.next_free;
+        entry.con = std::move(con);
+        ++_size;
+        return { index, entry.generation };
+    }
+
+    // Releases the connection and resets its context, stale ids are ignored
+    void remove(const connection_id id) {
+        if (not contains(id)) return;
+        slot &entry = at(id.index);
+        entry.con.reset();
+        entry.context = Context();
+        ++entry.generation;
+        entry.next_free = _free;
+        _free = id.index;
+        --_size;
+    }
+
+    inline bool contains(const connection_id id) const {
+        return id.index < _capacity and at(id.index).generation == id.generation and
+               at(id.index).con;
+    }
+    // Returns null if the connection was removed
+    inline std::shared_ptr<Connection> lock(const connection_id id) const {
+        return contains(id) ? at(id.index).con : nullptr;
+    }
+    // Following accessors require a valid id
+    inline Connection &connection(const connection_id id) const { return *at(id.index).con; }
+    inline Context &operator[](const connection_id id) { return at(id.index).context; }
+
+    inline std::size_t size() const { return _size; }
+};
+
+}  // namespace octopus_mq::mqtt
+
+#endif
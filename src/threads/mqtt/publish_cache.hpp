@@ -0,0 +1,81 @@
+#ifndef OCTOMQ_MQTT_PUBLISH_CACHE_H_
+#define OCTOMQ_MQTT_PUBLISH_CACHE_H_
+
+#include "network/network.hpp"
+
+#include "mqtt_server_cpp.hpp"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+namespace octopus_mq::mqtt {
+
+// QoS 0 PUBLISH packets of a single message, encoded once for each variant sent during
+// fan-out: protocol version of the subscriber and retain flag. Sending a cached packet writes
+// the shared header, properties and payload buffers to the socket, which must happen
+// synchronously, as packets reference buffers of the message. Broker writes every packet of
+// the connection synchronously on its thread, including publish acknowledgements, so the
+// endpoint never has an asynchronous write in flight that a cached packet could split.
+//
+// Deliveries that vary per subscriber are left to the endpoint: QoS 1 and 2, which need
+// a packet id and a copy in the session store for resending, subscription identifiers,
+// outbound topic aliases and packets over the client's Maximum Packet Size.
+class publish_cache {
+    static constexpr std::size_t _variants = 2;  // With and without retain
+
+    using v3_packet = mqtt_cpp::v3_1_1::basic_publish_message<2>;
+    using v5_packet = mqtt_cpp::v5::basic_publish_message<2>;
+
+    boost::asio::const_buffer _topic_name;
+    boost::asio::const_buffer _contents;
+    const mqtt_cpp::v5::properties &_props;
+    std::array<std::optional<v3_packet>, _variants> _v3;
+    std::array<std::optional<v5_packet>, _variants> _v5;
+
+    static inline std::size_t variant(const mqtt_cpp::publish_options pubopts) {
+        return pubopts.get_retain() == mqtt_cpp::retain::yes ? 1 : 0;
+    }
+
+    template <typename Connection, typename Packet>
+    static bool write(Connection &con, Packet &packet, const std::uint32_t max_packet_size) {
+        if (max_packet_size != 0 and packet.size() > max_packet_size) return false;
+        boost::system::error_code ec;
+        con.socket().write(packet.const_buffer_sequence(), ec);
+        // Packet could be written partially, so the stream is not usable anymore. Pending read
+        // of the connection fails then and closes it the usual way.
+        if (ec) con.socket().lowest_layer().close(ec);
+        return true;
+    }
+
+   public:
+    // Buffers and properties must outlive the cache
+    publish_cache(const mqtt_cpp::buffer &topic_name, const mqtt_cpp::buffer &contents,
+                  const mqtt_cpp::v5::properties &props)
+        : _topic_name(topic_name.data(), topic_name.size()),
+          _contents(contents.data(), contents.size()),
+          _props(props) {}
+    publish_cache(const publish_cache &) = delete;
+    publish_cache &operator=(const publish_cache &) = delete;
+
+    // Sends the message encoded for the protocol version of the connection. Returns false if
+    // it must be published through the endpoint instead. 'max_packet_size' of zero is
+    // unlimited. Properties are sent only to MQTT v5 connections.
+    template <typename Connection>
+    bool send(Connection &con, const mqtt::version version,
+              const mqtt_cpp::publish_options pubopts, const std::uint32_t max_packet_size) {
+        if (pubopts.get_qos() != mqtt_cpp::qos::at_most_once) return false;
+        if (version == mqtt::version::v3) {
+            auto &packet = _v3[variant(pubopts)];
+            if (not packet) packet.emplace(0, _topic_name, _contents, pubopts);
+            return write(con, *packet, max_packet_size);
+        }
+        auto &packet = _v5[variant(pubopts)];
+        if (not packet) packet.emplace(0, _topic_name, _contents, pubopts, _props);
+        return write(con, *packet, max_packet_size);
+    }
+};
+
+}  // namespace octopus_mq::mqtt
+
+#endif
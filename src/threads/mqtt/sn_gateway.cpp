@@ -0,0 +1,603 @@
+#include "threads/mqtt/sn_gateway.hpp"
+#include "core/log.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace octopus_mq::mqtt {
+
+static inline std::uint16_t read_uint16(const char *data) {
+    return static_cast<std::uint16_t>((static_cast<std::uint8_t>(data[0]) << 8) |
+                                      static_cast<std::uint8_t>(data[1]));
+}
+
+static inline std::uint8_t high_byte(const std::uint16_t value) { return value >> 8; }
+
+static inline std::uint8_t low_byte(const std::uint16_t value) { return value & 0xff; }
+
+sn_gateway::sn_gateway(const octopus_mq::adapter_settings_ptr adapter_settings,
+                       message_queue& global_queue)
+    : adapter_interface(adapter_settings, global_queue),
+      _socket(network::constants::null_socket),
+      _wakeup(network::constants::null_socket),
+      _should_stop(false),
+      _next_topic_id(1) {
+    mqtt::adapter_settings_ptr mqtt_settings =
+        std::static_pointer_cast<mqtt::adapter_settings>(_adapter_settings);
+    for (auto &predefined : mqtt_settings->predefined_topics()) {
+        _predefined_names[predefined.first] = predefined.second;
+        _predefined_ids[predefined.second] = predefined.first;
+    }
+
+    _socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_socket < 0)
+        throw std::runtime_error("cannot create udp socket: " + string(strerror(errno)));
+
+    sockaddr_in local_address;
+    memset(&local_address, 0, sizeof(local_address));
+    local_address.sin_family = AF_INET;
+    local_address.sin_addr.s_addr = (in_addr_t)_adapter_settings->phy().ip();
+    local_address.sin_port = htons(static_cast<std::uint16_t>(_adapter_settings->port()));
+    if (bind(_socket, (sockaddr *)&local_address, sizeof(local_address)) < 0) {
+        const string error = strerror(errno);
+        close(_socket);
+        throw std::runtime_error("cannot bind udp socket: " + error);
+    }
+
+    _wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeup < 0) {
+        const string error = strerror(errno);
+        close(_socket);
+        throw std::runtime_error("cannot create eventfd: " + error);
+    }
+}
+
+sn_gateway::~sn_gateway() {
+    stop();
+    if (_socket >= 0) close(_socket);
+    if (_wakeup >= 0) close(_wakeup);
+}
+
+std::uint64_t sn_gateway::client_key(const sockaddr_in &address) {
+    return (static_cast<std::uint64_t>(address.sin_addr.s_addr) << 16) | address.sin_port;
+}
+
+address sn_gateway::to_address(const sockaddr_in &address) {
+    return octopus_mq::address((ip_int)address.sin_addr.s_addr, ntohs(address.sin_port));
+}
+
+inline void sn_gateway::log_event(const sockaddr_in &address, const string &client_id,
+                                  const network_event_type event_type, const string &action) {
+    log::print_event(_adapter_settings->name(), to_address(address), client_id, event_type,
+                     action);
+}
+
+inline void sn_gateway::worker() {
+    const tuning_settings &tuning = _adapter_settings->tuning();
+    tuning.apply_to_thread(_adapter_settings->name());
+    // In latency mode poll() never blocks and the thread spins
+    const int timeout = tuning.busy_poll() ? 0 : sn::constants::poll_timeout;
+
+    pollfd fds[2] = { { _socket, POLLIN, 0 }, { _wakeup, POLLIN, 0 } };
+    while (not _should_stop) {
+        // Waiting for POLLOUT only when there are datagrams which could not be sent yet
+        fds[0].events = _outbox.empty() ? POLLIN : (POLLIN | POLLOUT);
+        if (poll(fds, 2, timeout) < 0) {
+            if (errno == EINTR) continue;
+            log::print(log_type::error,
+                       _adapter_settings->name() + ": poll failed: " + strerror(errno));
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            std::uint64_t counter;
+            if (read(_wakeup, &counter, sizeof(counter)) == sizeof(counter)) drain_inbox();
+        }
+        if (fds[0].revents & POLLIN) receive_batch();
+        send_batch();
+        sweep_clients();
+    }
+}
+
+inline void sn_gateway::sweep_clients() {
+    const auto now = std::chrono::steady_clock::now();
+    if (now < _next_sweep) return;
+    _next_sweep = now + sn::constants::sweep_interval;
+    for (auto iter = _clients.begin(); iter != _clients.end();)
+        if (now - iter->second.last_seen > iter->second.expiry) {
+            log::print(log_type::info, _adapter_settings->name() + ": client '" +
+                                           iter->second.client_id + "' expired.");
+            iter = _clients.erase(iter);
+        } else
+            ++iter;
+}
+
+inline void sn_gateway::receive_batch() {
+    std::array<mmsghdr, sn::constants::batch_size> headers;
+    std::array<iovec, sn::constants::batch_size> vectors;
+    std::array<sockaddr_in, sn::constants::batch_size> addresses;
+
+    for (;;) {
+        for (std::size_t i = 0; i < sn::constants::batch_size; ++i) {
+            vectors[i].iov_base = _rx_buffers[i].data();
+            vectors[i].iov_len = _rx_buffers[i].size();
+            memset(&headers[i], 0, sizeof(mmsghdr));
+            headers[i].msg_hdr.msg_name = &addresses[i];
+            headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+        const int received =
+            recvmmsg(_socket, headers.data(), sn::constants::batch_size, MSG_DONTWAIT, nullptr);
+        if (received < 0) {
+            if (errno != EAGAIN and errno != EWOULDBLOCK and errno != EINTR)
+                log::print(log_type::error,
+                           _adapter_settings->name() + ": recvmmsg failed: " + strerror(errno));
+            return;
+        }
+        for (int i = 0; i < received; ++i)
+            // Truncated datagrams could not be parsed anyway
+            if (not(headers[i].msg_hdr.msg_flags & MSG_TRUNC))
+                handle_datagram(addresses[i], _rx_buffers[i].data(), headers[i].msg_len);
+        if (static_cast<std::size_t>(received) < sn::constants::batch_size) return;
+    }
+}
+
+inline void sn_gateway::send_batch() {
+    std::array<mmsghdr, sn::constants::batch_size> headers;
+    std::array<iovec, sn::constants::batch_size> vectors;
+
+    while (not _outbox.empty()) {
+        const std::size_t count = std::min(_outbox.size(), sn::constants::batch_size);
+        for (std::size_t i = 0; i < count; ++i) {
+            vectors[i].iov_base = _outbox[i].data.data();
+            vectors[i].iov_len = _outbox[i].data.size();
+            memset(&headers[i], 0, sizeof(mmsghdr));
+            headers[i].msg_hdr.msg_name = &_outbox[i].address;
+            headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+        const int sent = sendmmsg(_socket, headers.data(), count, MSG_DONTWAIT);
+        if (sent < 0) {
+            // Socket buffer is full: the rest is sent when socket becomes writable again
+            if (errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR) return;
+            // Datagram which caused the error is dropped, otherwise the outbox would stall
+            log::print(log_type::error, _adapter_settings->name() + ": sendmmsg failed at " +
+                                            to_address(_outbox.front().address).to_string() +
+                                            ": " + strerror(errno));
+            _outbox.pop_front();
+            continue;
+        }
+        _outbox.erase(_outbox.begin(), _outbox.begin() + sent);
+    }
+}
+
+inline void sn_gateway::drain_inbox() {
+    std::deque<injected_message> inbox;
+    std::unique_lock<std::mutex> inbox_lock(_inbox_mutex);
+    inbox.swap(_inbox);
+    inbox_lock.unlock();
+    // Receipts are released with the inbox
+    for (auto &item : inbox) deliver(item.first);
+}
+
+inline void sn_gateway::send(const sockaddr_in &address, const sn::packet_type type,
+                             std::initializer_list<std::uint8_t> header, const char *body,
+                             std::size_t body_size) {
+    sn::datagram datagram;
+    datagram.address = address;
+    // Length field is one byte, or three bytes (0x01 + uint16) for packets over 255 bytes
+    std::size_t length = 2 + header.size() + body_size;
+    if (length > 0xff) length += 2;
+    if (length > 0xffff) return;
+    datagram.data.reserve(length);
+    if (length > 0xff) {
+        datagram.data.push_back(0x01);
+        datagram.data.push_back(high_byte(length));
+        datagram.data.push_back(low_byte(length));
+    } else
+        datagram.data.push_back(static_cast<char>(length));
+    datagram.data.push_back(static_cast<char>(type));
+    datagram.data.insert(datagram.data.end(), header.begin(), header.end());
+    if (body_size) datagram.data.insert(datagram.data.end(), body, body + body_size);
+    _outbox.push_back(std::move(datagram));
+}
+
+inline topic_id sn_gateway::register_topic(const string &topic_name) {
+    if (auto iter = _topic_ids.find(topic_name); iter != _topic_ids.end()) return iter->second;
+    // Normal topic ids must not collide with predefined ones
+    while (_next_topic_id <= sn::constants::max_topic_id and
+           _predefined_names.find(_next_topic_id) != _predefined_names.end())
+        ++_next_topic_id;
+    if (_next_topic_id > sn::constants::max_topic_id) return sn::constants::null_topic_id;
+    const topic_id id = _next_topic_id++;
+    _topic_ids[topic_name] = id;
+    _topic_names[id] = topic_name;
+    return id;
+}
+
+inline bool sn_gateway::resolve_topic(const sn::topic_id_type type, const char *data,
+                                      string &topic_name) {
+    switch (type) {
+        case sn::topic_id_type::normal:
+            if (auto iter = _topic_names.find(read_uint16(data)); iter != _topic_names.end()) {
+                topic_name = iter->second;
+                return true;
+            }
+            return false;
+        case sn::topic_id_type::predefined:
+            if (auto iter = _predefined_names.find(read_uint16(data));
+                iter != _predefined_names.end()) {
+                topic_name = iter->second;
+                return true;
+            }
+            return false;
+        case sn::topic_id_type::short_name:
+            topic_name.assign(data, 2);
+            return true;
+    }
+    return false;
+}
+
+inline void sn_gateway::handle_datagram(const sockaddr_in &address, const char *data,
+                                        std::size_t size) {
+    if (size < 2) return;
+    std::size_t length = static_cast<std::uint8_t>(data[0]);
+    std::size_t offset = 1;
+    if (length == 0x01) {
+        if (size < 4) return;
+        length = read_uint16(data + 1);
+        offset = 3;
+    }
+    if (length != size) return;  // Malformed or truncated packet
+
+    const sn::packet_type type = static_cast<sn::packet_type>(data[offset]);
+    const char *body = data + offset + 1;
+    const std::size_t body_size = size - offset - 1;
+
+    auto client_iter = _clients.find(client_key(address));
+    sn::client *client = (client_iter != _clients.end()) ? &client_iter->second : nullptr;
+
+    switch (type) {
+        case sn::packet_type::searchgw:
+            log_event(address, string(), network_event_type::receive, packet_names::searchgw);
+            send(address, sn::packet_type::gwinfo, { sn::constants::gateway_id });
+            log_event(address, string(), network_event_type::send, packet_names::gwinfo);
+            return;
+        case sn::packet_type::connect:
+            return handle_connect(address, body, body_size);
+        case sn::packet_type::publish:
+            // Client does not have to be connected to publish with QoS -1
+            return handle_publish(address, client, body, body_size);
+        default:
+            break;
+    }
+
+    // All other packets are accepted from connected clients only
+    if (client == nullptr) return;
+    client->last_seen = std::chrono::steady_clock::now();
+    switch (type) {
+        case sn::packet_type::reg:
+            return handle_register(*client, body, body_size);
+        case sn::packet_type::subscribe:
+            return handle_subscribe(*client, body, body_size);
+        case sn::packet_type::unsubscribe:
+            return handle_unsubscribe(*client, body, body_size);
+        case sn::packet_type::pubrel:
+            return handle_pubrel(*client, body, body_size);
+        case sn::packet_type::pingreq:
+            log_event(address, client->client_id, network_event_type::receive,
+                      packet_names::pingreq);
+            send(address, sn::packet_type::pingresp, {});
+            log_event(address, client->client_id, network_event_type::send,
+                      packet_names::pingresp);
+            return;
+        case sn::packet_type::disconnect:
+            log_event(address, client->client_id, network_event_type::receive,
+                      packet_names::disconnect);
+            send(address, sn::packet_type::disconnect, {});
+            _clients.erase(client_iter);
+            return;
+        case sn::packet_type::regack:
+            log_event(address, client->client_id, network_event_type::receive,
+                      packet_names::regack);
+            return;
+        default:
+            // Outbound messages are sent with QoS 0, so PUBACK, PUBREC and PUBCOMP
+            // are not expected. Will messages and sleeping clients are not supported.
+            return;
+    }
+}
+
+inline void sn_gateway::handle_connect(const sockaddr_in &address, const char *data,
+                                       std::size_t size) {
+    // Flags (1), protocol id (1), duration (2), client id
+    if (size < 4) return;
+    const std::uint8_t flags = data[0];
+    const std::uint16_t duration = read_uint16(data + 2);
+    const string client_id(data + 4, size - 4);
+    log_event(address, client_id, network_event_type::receive, packet_names::connect);
+
+    if (flags & sn::flags::will) {
+        send(address, sn::packet_type::connack,
+             { static_cast<std::uint8_t>(sn::return_code::not_supported) });
+        log_event(address, client_id, network_event_type::send, packet_names::connack);
+        return;
+    }
+
+    const std::uint64_t key = client_key(address);
+    if (_clients.size() >= sn::constants::max_clients and _clients.find(key) == _clients.end()) {
+        send(address, sn::packet_type::connack,
+             { static_cast<std::uint8_t>(sn::return_code::congestion) });
+        log_event(address, client_id, network_event_type::send, packet_names::connack);
+        return;
+    }
+
+    sn::client &client = _clients[key];
+    if ((flags & sn::flags::clean_session) or client.client_id != client_id) {
+        client.subscriptions.clear();
+        client.registered.clear();
+        client.pending.clear();
+    }
+    client.address = address;
+    client.client_id = client_id;
+    client.last_seen = std::chrono::steady_clock::now();
+    client.expiry = duration ? std::chrono::milliseconds(duration * 1500)
+                             : std::chrono::milliseconds(sn::constants::idle_timeout);
+    send(address, sn::packet_type::connack,
+         { static_cast<std::uint8_t>(sn::return_code::accepted) });
+    log_event(address, client_id, network_event_type::send, packet_names::connack);
+}
+
+inline void sn_gateway::handle_register(sn::client &client, const char *data, std::size_t size) {
+    // Topic id (2), message id (2), topic name
+    if (size < 5) return;
+    log_event(client.address, client.client_id, network_event_type::receive, packet_names::reg);
+    const string topic_name(data + 4, size - 4);
+    sn::return_code code = sn::return_code::accepted;
+    topic_id id = sn::constants::null_topic_id;
+    if (topic_name.find_first_of("#+") != string::npos)
+        code = sn::return_code::not_supported;
+    else if (id = register_topic(topic_name); id == sn::constants::null_topic_id)
+        code = sn::return_code::congestion;
+    else
+        client.registered.insert(id);
+    send(client.address, sn::packet_type::regack,
+         { high_byte(id), low_byte(id), std::uint8_t(data[2]), std::uint8_t(data[3]),
+           static_cast<std::uint8_t>(code) });
+    log_event(client.address, client.client_id, network_event_type::send, packet_names::regack);
+}
+
+inline void sn_gateway::handle_publish(const sockaddr_in &address, sn::client *client,
+                                       const char *data, std::size_t size) {
+    // Flags (1), topic id (2), message id (2), payload
+    if (size < 5) return;
+    const std::uint8_t flags = data[0];
+    const bool qos_minus_one = (flags & sn::flags::qos_mask) == sn::flags::qos_minus_one;
+    const std::uint8_t qos = qos_minus_one ? 0 : (flags & sn::flags::qos_mask) >> 5;
+    const sn::topic_id_type type =
+        static_cast<sn::topic_id_type>(flags & sn::flags::topic_id_type_mask);
+    const string client_id = client ? client->client_id : string();
+
+    // QoS -1 is fire-and-forget from unconnected clients, using predefined ids or short names
+    if (client == nullptr and (not qos_minus_one or type == sn::topic_id_type::normal)) return;
+    if (client) client->last_seen = std::chrono::steady_clock::now();
+
+    log_event(address, client_id, network_event_type::receive,
+              std::string(packet_names::publish) + " (" + log::size_to_string(size - 5) + ')');
+
+    string topic_name;
+    if (not resolve_topic(type, data + 1, topic_name)) {
+        if (qos > 0) {
+            send(address, sn::packet_type::puback,
+                 { std::uint8_t(data[1]), std::uint8_t(data[2]), std::uint8_t(data[3]),
+                   std::uint8_t(data[4]),
+                   static_cast<std::uint8_t>(sn::return_code::invalid_topic_id) });
+            log_event(address, client_id, network_event_type::send, packet_names::puback);
+        }
+        return;
+    }
+
+    // Publish options are stored in MQTT fixed header format: retain (bit 0), QoS (bits 1-2)
+    const std::uint8_t pubopts = (qos << 1) | ((flags & sn::flags::retain) ? 1 : 0);
+    message_ptr shared_message =
+        std::make_shared<message>(message_payload(), topic_table::intern(topic_name), pubopts);
+    shared_message->payload(data + 5, size - 5);
+    shared_message->origin(client_id);
+
+    if (qos == 2) {
+        // Message is forwarded once on PUBREL, a retransmitted PUBLISH only gets PUBREC again.
+        // Without room for it no PUBREC is sent, so the client retransmits later.
+        const std::uint16_t message_id = read_uint16(data + 3);
+        if (client->pending.find(message_id) == client->pending.end()) {
+            if (client->pending.size() >= sn::constants::max_pending) return;
+            client->pending.emplace(message_id, shared_message);
+        }
+        send(address, sn::packet_type::pubrec, { std::uint8_t(data[3]), std::uint8_t(data[4]) });
+        log_event(address, client_id, network_event_type::send, packet_names::pubrec);
+        return;
+    }
+    // Refused message is acknowledged as congestion, so the client sends it again later
+    const bool accepted = _global_queue.push(_adapter_settings, shared_message);
+    if (qos == 1) {
+        const sn::return_code code = accepted ? sn::return_code::accepted
+                                              : sn::return_code::congestion;
+        send(address, sn::packet_type::puback,
+             { std::uint8_t(data[1]), std::uint8_t(data[2]), std::uint8_t(data[3]),
+               std::uint8_t(data[4]), static_cast<std::uint8_t>(code) });
+        log_event(address, client_id, network_event_type::send, packet_names::puback);
+    }
+    if (accepted or qos == 0) deliver(shared_message);
+}
+
+inline void sn_gateway::handle_pubrel(sn::client &client, const char *data, std::size_t size) {
+    // Message id (2)
+    if (size < 2) return;
+    log_event(client.address, client.client_id, network_event_type::receive,
+              packet_names::pubrel);
+    // PUBREL of a message forwarded already is answered as well, its PUBCOMP could be lost
+    if (auto iter = client.pending.find(read_uint16(data)); iter != client.pending.end()) {
+        // Refused message stays pending without PUBCOMP, so the client sends PUBREL again
+        if (not _global_queue.push(_adapter_settings, iter->second)) return;
+        message_ptr shared_message = std::move(iter->second);
+        client.pending.erase(iter);
+        deliver(shared_message);
+    }
+    send(client.address, sn::packet_type::pubcomp,
+         { std::uint8_t(data[0]), std::uint8_t(data[1]) });
+    log_event(client.address, client.client_id, network_event_type::send, packet_names::pubcomp);
+}
+
+inline void sn_gateway::handle_subscribe(sn::client &client, const char *data, std::size_t size) {
+    // Flags (1), message id (2), topic name or topic id
+    if (size < 4) return;
+    log_event(client.address, client.client_id, network_event_type::receive,
+              packet_names::subscribe);
+    const std::uint8_t flags = data[0];
+    const sn::topic_id_type type =
+        static_cast<sn::topic_id_type>(flags & sn::flags::topic_id_type_mask);
+
+    string topic_filter;
+    topic_id id = sn::constants::null_topic_id;
+    sn::return_code code = sn::return_code::accepted;
+    if (type == sn::topic_id_type::normal) {
+        topic_filter.assign(data + 3, size - 3);
+        if (not scope::valid_topic_filter(topic_filter))
+            code = sn::return_code::not_supported;
+        else if (topic_filter.find_first_of("#+") == string::npos) {
+            // Client gets topic id of a plain topic right away in SUBACK
+            if (id = register_topic(topic_filter); id == sn::constants::null_topic_id)
+                code = sn::return_code::congestion;
+            else
+                client.registered.insert(id);
+        }
+    } else if (size < 5 or not resolve_topic(type, data + 3, topic_filter))
+        code = sn::return_code::invalid_topic_id;
+    else if (type == sn::topic_id_type::predefined)
+        id = read_uint16(data + 3);
+
+    if (code == sn::return_code::accepted) {
+        auto &subscriptions = client.subscriptions;
+        subscriptions.erase(std::remove_if(subscriptions.begin(), subscriptions.end(),
+                                           [&topic_filter](const sn::subscription &sub) {
+                                               return sub.topic_filter.name() == topic_filter;
+                                           }),
+                            subscriptions.end());
+        // Messages are forwarded to MQTT-SN clients with QoS 0
+        subscriptions.push_back({ topic_table::intern(topic_filter), 0 });
+    }
+    send(client.address, sn::packet_type::suback,
+         { 0x00, high_byte(id), low_byte(id), std::uint8_t(data[1]), std::uint8_t(data[2]),
+           static_cast<std::uint8_t>(code) });
+    log_event(client.address, client.client_id, network_event_type::send, packet_names::suback);
+}
+
+inline void sn_gateway::handle_unsubscribe(sn::client &client, const char *data,
+                                           std::size_t size) {
+    // Flags (1), message id (2), topic name or topic id
+    if (size < 4) return;
+    log_event(client.address, client.client_id, network_event_type::receive,
+              packet_names::unsubscribe);
+    const sn::topic_id_type type =
+        static_cast<sn::topic_id_type>(data[0] & sn::flags::topic_id_type_mask);
+    string topic_filter;
+    if (type == sn::topic_id_type::normal)
+        topic_filter.assign(data + 3, size - 3);
+    else if (size >= 5)
+        resolve_topic(type, data + 3, topic_filter);
+
+    auto &subscriptions = client.subscriptions;
+    subscriptions.erase(std::remove_if(subscriptions.begin(), subscriptions.end(),
+                                       [&topic_filter](const sn::subscription &sub) {
+                                           return sub.topic_filter.name() == topic_filter;
+                                       }),
+                        subscriptions.end());
+    send(client.address, sn::packet_type::unsuback,
+         { std::uint8_t(data[1]), std::uint8_t(data[2]) });
+    log_event(client.address, client.client_id, network_event_type::send,
+              packet_names::unsuback);
+}
+
+inline void sn_gateway::deliver(const message_ptr message) {
+    const topic_handle &topic = message->interned_topic();
+    const string &topic_name = topic.name();
+    const std::string_view payload = message->payload();
+    const std::uint8_t retain = (message->pubopts() & 0x01) ? sn::flags::retain : 0;
+
+    for (auto &client_item : _clients) {
+        sn::client &client = client_item.second;
+        const bool matches =
+            std::any_of(client.subscriptions.begin(), client.subscriptions.end(),
+                        [&topic](const sn::subscription &sub) {
+                            return scope::matches_filter(sub.topic_filter, topic);
+                        });
+        if (not matches) continue;
+
+        sn::topic_id_type type = sn::topic_id_type::normal;
+        std::uint8_t topic_bytes[2];
+        if (auto iter = _predefined_ids.find(topic_name); iter != _predefined_ids.end()) {
+            type = sn::topic_id_type::predefined;
+            topic_bytes[0] = high_byte(iter->second);
+            topic_bytes[1] = low_byte(iter->second);
+        } else if (topic_name.size() == 2) {
+            type = sn::topic_id_type::short_name;
+            topic_bytes[0] = topic_name[0];
+            topic_bytes[1] = topic_name[1];
+        } else {
+            const topic_id id = register_topic(topic_name);
+            if (id == sn::constants::null_topic_id) continue;
+            // Topic id has to be known by the client before the first PUBLISH
+            if (client.registered.insert(id).second) {
+                const std::uint16_t message_id = ++client.message_id;
+                send(client.address, sn::packet_type::reg,
+                     { high_byte(id), low_byte(id), high_byte(message_id), low_byte(message_id) },
+                     topic_name.data(), topic_name.size());
+                log_event(client.address, client.client_id, network_event_type::send,
+                          packet_names::reg);
+            }
+            topic_bytes[0] = high_byte(id);
+            topic_bytes[1] = low_byte(id);
+        }
+
+        send(client.address, sn::packet_type::publish,
+             { static_cast<std::uint8_t>(retain | static_cast<std::uint8_t>(type)), topic_bytes[0],
+               topic_bytes[1], 0x00, 0x00 },
+             payload.data(), payload.size());
+        log_event(client.address, client.client_id, network_event_type::send,
+                  std::string(packet_names::publish) + " (" +
+                      log::size_to_string(payload.size()) + ')');
+    }
+}
+
+void sn_gateway::run() { _thread = std::thread(&sn_gateway::worker, this); }
+
+void sn_gateway::stop() {
+    if (_thread.joinable()) {
+        _should_stop = true;
+        const std::uint64_t counter = 1;
+        // Worker wakes up by poll timeout anyway if eventfd could not be written
+        if (write(_wakeup, &counter, sizeof(counter)) < 0)
+            log::print(log_type::warning, _adapter_settings->name() + ": cannot wake up worker.");
+        _thread.join();
+    }
+}
+
+void sn_gateway::inject_publish(const message_ptr message) {
+    handoff_receipt receipt = _global_queue.receipt(message);
+    std::unique_lock<std::mutex> inbox_lock(_inbox_mutex);
+    _inbox.emplace_back(message, std::move(receipt));
+    inbox_lock.unlock();
+    const std::uint64_t counter = 1;
+    if (write(_wakeup, &counter, sizeof(counter)) < 0)
+        log::print(log_type::error, _adapter_settings->name() + ": cannot wake up worker.");
+}
+
+}  // namespace octopus_mq::mqtt
@@ -0,0 +1,184 @@
+#ifndef OCTOMQ_MQTT_SN_GATEWAY_H_
+#define OCTOMQ_MQTT_SN_GATEWAY_H_
+
+#include "network/adapter.hpp"
+#include "network/message.hpp"
+#include "network/mqtt/adapter.hpp"
+#include "network/network.hpp"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace octopus_mq::mqtt {
+
+namespace sn {
+
+    enum class packet_type : std::uint8_t {
+        advertise = 0x00,
+        searchgw = 0x01,
+        gwinfo = 0x02,
+        connect = 0x04,
+        connack = 0x05,
+        willtopicreq = 0x06,
+        willtopic = 0x07,
+        willmsgreq = 0x08,
+        willmsg = 0x09,
+        reg = 0x0a,
+        regack = 0x0b,
+        publish = 0x0c,
+        puback = 0x0d,
+        pubcomp = 0x0e,
+        pubrec = 0x0f,
+        pubrel = 0x10,
+        subscribe = 0x12,
+        suback = 0x13,
+        unsubscribe = 0x14,
+        unsuback = 0x15,
+        pingreq = 0x16,
+        pingresp = 0x17,
+        disconnect = 0x18
+    };
+
+    enum class return_code : std::uint8_t {
+        accepted = 0x00,
+        congestion = 0x01,
+        invalid_topic_id = 0x02,
+        not_supported = 0x03
+    };
+
+    enum class topic_id_type : std::uint8_t { normal = 0x00, predefined = 0x01, short_name = 0x02 };
+
+    namespace flags {
+
+        constexpr std::uint8_t dup = 0x80;
+        constexpr std::uint8_t qos_mask = 0x60;
+        constexpr std::uint8_t qos_minus_one = 0x60;
+        constexpr std::uint8_t retain = 0x10;
+        constexpr std::uint8_t will = 0x08;
+        constexpr std::uint8_t clean_session = 0x04;
+        constexpr std::uint8_t topic_id_type_mask = 0x03;
+
+    }  // namespace flags
+
+    namespace constants {
+
+        constexpr std::size_t batch_size = 32;           // datagrams per recvmmsg/sendmmsg call
+        constexpr std::size_t max_datagram_size = 1500;  // fits into a single ethernet frame
+        constexpr topic_id null_topic_id = 0x0000;
+        constexpr topic_id max_topic_id = 0xfffe;
+        constexpr std::uint8_t gateway_id = 0x01;
+        constexpr int poll_timeout = 100;  // milliseconds
+        constexpr std::size_t max_clients = 0x10000;
+        constexpr std::size_t max_pending = 64;  // QoS 2 messages per client waiting for PUBREL
+        // Clients are dropped after 1.5 keep-alive periods of silence,
+        // those without keep-alive after the idle timeout
+        constexpr std::chrono::seconds idle_timeout = std::chrono::hours(1);
+        constexpr std::chrono::seconds sweep_interval = std::chrono::seconds(1);
+
+    }  // namespace constants
+
+    struct datagram {
+        sockaddr_in address;
+        std::vector<char> data;
+    };
+
+    struct subscription {
+        topic_handle topic_filter;
+        std::uint8_t qos;
+    };
+
+    struct client {
+        sockaddr_in address;
+        string client_id;
+        std::vector<subscription> subscriptions;
+        std::set<topic_id> registered;  // normal topic ids already sent to client via REGISTER
+        std::uint16_t message_id = 0;
+        std::chrono::steady_clock::time_point last_seen;
+        std::chrono::milliseconds expiry;  // 1.5 keep-alive periods
+        // QoS 2 messages by message id, they are forwarded on PUBREL
+        std::unordered_map<std::uint16_t, message_ptr> pending;
+    };
+
+}  // namespace sn
+
+// MQTT-SN v1.2 gateway on a single non-blocking UDP socket.
+// All protocol state is owned by the worker thread. Datagrams are received and sent in batches
+// with recvmmsg/sendmmsg. Messages injected by other adapters are handed over to the worker
+// through a queue and an eventfd.
+class sn_gateway final : public adapter_interface {
+    int _socket;
+    int _wakeup;  // eventfd, signals the worker that _inbox is not empty
+    std::thread _thread;
+    std::atomic<bool> _should_stop;
+
+    std::deque<injected_message> _inbox;
+    std::mutex _inbox_mutex;
+
+    // Gateway-wide topic id registry. Predefined ids come from adapter settings,
+    // normal ids are assigned on REGISTER and SUBSCRIBE and are the same for all clients.
+    std::unordered_map<string, topic_id> _topic_ids;
+    std::unordered_map<topic_id, string> _topic_names;
+    std::unordered_map<topic_id, string> _predefined_names;
+    std::unordered_map<string, topic_id> _predefined_ids;
+    topic_id _next_topic_id;
+
+    std::unordered_map<std::uint64_t, sn::client> _clients;  // keyed by address
+    std::chrono::steady_clock::time_point _next_sweep;
+    std::deque<sn::datagram> _outbox;
+
+    std::array<std::array<char, sn::constants::max_datagram_size>, sn::constants::batch_size>
+        _rx_buffers;
+
+    static std::uint64_t client_key(const sockaddr_in &address);
+    static address to_address(const sockaddr_in &address);
+
+    inline void worker();
+    inline void receive_batch();
+    inline void send_batch();
+    inline void drain_inbox();
+    inline void sweep_clients();
+
+    inline void handle_datagram(const sockaddr_in &address, const char *data, std::size_t size);
+    inline void handle_connect(const sockaddr_in &address, const char *data, std::size_t size);
+    inline void handle_register(sn::client &client, const char *data, std::size_t size);
+    inline void handle_publish(const sockaddr_in &address, sn::client *client, const char *data,
+                               std::size_t size);
+    inline void handle_subscribe(sn::client &client, const char *data, std::size_t size);
+    inline void handle_unsubscribe(sn::client &client, const char *data, std::size_t size);
+    inline void handle_pubrel(sn::client &client, const char *data, std::size_t size);
+
+    inline topic_id register_topic(const string &topic_name);
+    inline bool resolve_topic(const sn::topic_id_type type, const char *data, string &topic_name);
+    inline void deliver(const message_ptr message);
+    inline void send(const sockaddr_in &address, const sn::packet_type type,
+                     std::initializer_list<std::uint8_t> header, const char *body = nullptr,
+                     std::size_t body_size = 0);
+    inline void log_event(const sockaddr_in &address, const string &client_id,
+                          const network_event_type event_type, const string &action);
+
+   public:
+    sn_gateway(const octopus_mq::adapter_settings_ptr adapter_settings,
+               message_queue& global_queue);
+    ~sn_gateway();
+
+    void run();
+    void stop();
+
+    void inject_publish(const message_ptr message);
+};
+
+}  // namespace octopus_mq::mqtt
+
+#endif
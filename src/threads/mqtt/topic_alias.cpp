@@ -0,0 +1,62 @@
+#include "threads/mqtt/topic_alias.hpp"
+
+namespace octopus_mq::mqtt {
+
+topic_alias_recv::topic_alias_recv(const topic_alias maximum) : _maximum(maximum) {}
+
+bool topic_alias_recv::resolve(const topic_alias alias, std::string &topic) {
+    if (alias == topic_alias_constants::null_alias or alias > _maximum) return false;
+    if (not topic.empty()) {
+        _topics[alias] = topic;
+        return true;
+    }
+    if (auto iter = _topics.find(alias); iter != _topics.end()) {
+        topic = iter->second;
+        return true;
+    }
+    return false;
+}
+
+void topic_alias_recv::clear() { _topics.clear(); }
+
+topic_alias_send::topic_alias_send(const topic_alias maximum) : _maximum(maximum) {}
+
+void topic_alias_send::maximum(const topic_alias maximum) {
+    _maximum = maximum;
+    clear();
+}
+
+const topic_alias &topic_alias_send::maximum() const { return _maximum; }
+
+topic_alias topic_alias_send::assign(const std::string &topic, bool &mapped) {
+    mapped = false;
+    if (_maximum == topic_alias_constants::null_alias or
+        topic.size() < topic_alias_constants::min_topic_size)
+        return topic_alias_constants::null_alias;
+
+    if (auto iter = _aliases.find(topic); iter != _aliases.end()) {
+        _lru.splice(_lru.begin(), _lru, iter->second);
+        mapped = true;
+        return iter->second->second;
+    }
+
+    topic_alias alias;
+    if (_lru.size() < _maximum)
+        alias = static_cast<topic_alias>(_lru.size() + 1);
+    else {
+        // Reassigning alias of the least recently used topic
+        alias = _lru.back().second;
+        _aliases.erase(_lru.back().first);
+        _lru.pop_back();
+    }
+    _lru.emplace_front(topic, alias);
+    _aliases.emplace(topic, _lru.begin());
+    return alias;
+}
+
+void topic_alias_send::clear() {
+    _aliases.clear();
+    _lru.clear();
+}
+
+}  // namespace octopus_mq::mqtt
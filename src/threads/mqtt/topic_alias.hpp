@@ -0,0 +1,62 @@
+#ifndef OCTOMQ_MQTT_TOPIC_ALIAS_H_
+#define OCTOMQ_MQTT_TOPIC_ALIAS_H_
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace octopus_mq::mqtt {
+
+using topic_alias = std::uint16_t;
+
+namespace topic_alias_constants {
+
+    constexpr topic_alias null_alias = 0;
+    constexpr topic_alias receive_maximum = 64;  // aliases accepted from each client
+    constexpr std::size_t property_size = 3;     // property identifier and two-byte value
+    // Shorter topics are always sent in full, alias would not save anything
+    constexpr std::size_t min_topic_size = property_size + 1;
+
+}  // namespace topic_alias_constants
+
+// Inbound MQTT v5 topic aliases of a single connection.
+class topic_alias_recv {
+    std::unordered_map<topic_alias, std::string> _topics;
+    topic_alias _maximum;
+
+   public:
+    explicit topic_alias_recv(const topic_alias maximum = topic_alias_constants::receive_maximum);
+
+    // Maps the alias to the topic if topic is not empty, otherwise replaces the empty topic
+    // with the mapped one. Returns false if alias is out of range or is not mapped yet.
+    bool resolve(const topic_alias alias, std::string &topic);
+    void clear();
+};
+
+// Outbound MQTT v5 topic aliases of a single connection.
+// Number of aliases is bounded by the Topic Alias Maximum sent by the client in CONNECT,
+// least recently used alias is reassigned when all of them are taken.
+class topic_alias_send {
+    using lru_list = std::list<std::pair<std::string, topic_alias>>;
+
+    lru_list _lru;  // Most recently used topic is at the front
+    std::unordered_map<std::string, lru_list::iterator> _aliases;
+    topic_alias _maximum;
+
+   public:
+    explicit topic_alias_send(const topic_alias maximum = topic_alias_constants::null_alias);
+
+    void maximum(const topic_alias maximum);
+    const topic_alias &maximum() const;
+
+    // Returns alias for the topic or null_alias if topic should be sent without alias.
+    // 'mapped' is set to true if client already knows the alias, so topic could be omitted.
+    topic_alias assign(const std::string &topic, bool &mapped);
+    void clear();
+};
+
+}  // namespace octopus_mq::mqtt
+
+#endif
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Two OctopusMQ nodes on loopback bridged by DDS peers of the same domain: a message published
+# to the MQTT broker of the first node must be delivered by the MQTT broker of the second one.
+# usage: run.sh <octopusmq binary>
+OCTOMQ_BIN="$1"
+OCTOMQ_DIR=$(dirname "$0")
+OCTOMQ_TMP=$(mktemp -d)
+OCTOMQ_RECEIVED="$OCTOMQ_TMP/received.txt"
+OCTOMQ_TIMEOUT=20  # Seconds until the message must be delivered
+
+"$OCTOMQ_BIN" "$OCTOMQ_DIR/peer_a.json" &
+OCTOMQ_PID_A=$!
+"$OCTOMQ_BIN" "$OCTOMQ_DIR/peer_b.json" &
+OCTOMQ_PID_B=$!
+trap 'kill $OCTOMQ_PID_A $OCTOMQ_PID_B $OCTOMQ_SUB_PID 2>/dev/null; rm -rf "$OCTOMQ_TMP"' EXIT
+
+# Waiting for the broker of the second node to accept connections
+elapsed=0
+until mosquitto_pub -p 18831 -t octomq/probe -n 2>/dev/null; do
+    if [ $elapsed -ge $OCTOMQ_TIMEOUT ]; then
+        echo "error: broker of the second node is not started in $OCTOMQ_TIMEOUT seconds"
+        exit 1
+    fi
+    sleep 1
+    elapsed=$((elapsed + 1))
+done
+
+mosquitto_sub -p 18831 -t octomq/loopback -C 1 -W $OCTOMQ_TIMEOUT > "$OCTOMQ_RECEIVED" &
+OCTOMQ_SUB_PID=$!
+
+# Message is published again every second until RTPS discovery of the peers is done
+# and the subscriber received it
+elapsed=0
+while [ ! -s "$OCTOMQ_RECEIVED" ] && [ $elapsed -lt $OCTOMQ_TIMEOUT ]; do
+    mosquitto_pub -p 18830 -t octomq/loopback -q 1 -m '{"loopback":true}' 2>/dev/null
+    sleep 1
+    elapsed=$((elapsed + 1))
+done
+
+if ! wait $OCTOMQ_SUB_PID; then
+    echo "error: message was not delivered between dds peers in $OCTOMQ_TIMEOUT seconds"
+    exit 1
+fi
+if [ "$(cat "$OCTOMQ_RECEIVED")" != '{"loopback":true}' ]; then
+    echo "error: unexpected payload $(cat "$OCTOMQ_RECEIVED")"
+    exit 1
+fi
+echo "-- Message delivered between dds peers"
@@ -0,0 +1,132 @@
+#include "threads/mqtt/broker.hpp"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include "check.hpp"
+
+using namespace octopus_mq;
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+
+// Resident memory a broker needs per idle connection and per subscription. Both ends of every
+// connection live in this process, so the figures are upper bounds of what the broker keeps.
+constexpr std::size_t client_count = 5000;     // Fewer if the descriptor limit is lower
+constexpr std::size_t warm_up_count = 100;     // Connected before the baseline is measured
+constexpr std::size_t max_connection_bytes = 16384;
+constexpr std::size_t max_subscription_bytes = 1024;
+constexpr unsigned broker_port = 18890;
+
+static std::size_t resident_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    std::size_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Returns how many clients could be connected with the raised descriptor limit
+static std::size_t raise_descriptor_limit(const std::size_t wanted) {
+    rlimit limit;
+    CHECK(getrlimit(RLIMIT_NOFILE, &limit) == 0);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    CHECK(getrlimit(RLIMIT_NOFILE, &limit) == 0);
+    const std::size_t spare = 64;  // Descriptors of the broker and the log
+    if (limit.rlim_cur == RLIM_INFINITY) return wanted;
+    CHECK(limit.rlim_cur > spare + 2 * warm_up_count);
+    return std::min(wanted, static_cast<std::size_t>(limit.rlim_cur - spare) / 2 - warm_up_count);
+}
+
+// MQTT 3.1.1 packets, remaining lengths stay below 128 bytes
+static std::string connect_packet(const std::string &client_id) {
+    std::string packet = { '\x10', static_cast<char>(12 + client_id.size()), 0, 4, 'M', 'Q', 'T',
+                           'T', 4, 2 /* clean session */, 0, 0 /* no keep alive */ };
+    packet += { 0, static_cast<char>(client_id.size()) };
+    return packet + client_id;
+}
+
+static std::string subscribe_packet(const std::string &filter) {
+    std::string packet = { '\x82', static_cast<char>(5 + filter.size()), 0, 1 /* packet id */,
+                           0, static_cast<char>(filter.size()) };
+    return packet + filter + '\0';  // QoS 0
+}
+
+static tcp::socket connect_client(asio::io_context &ioc, const std::size_t number) {
+    tcp::socket socket(ioc);
+    const tcp::endpoint endpoint(asio::ip::make_address("127.0.0.1"), broker_port);
+    // Broker starts listening on its own thread
+    boost::system::error_code ec;
+    for (int attempt = 0; attempt < 50; ++attempt) {
+        socket.connect(endpoint, ec);
+        if (not ec) break;
+        socket.close();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    CHECK(not ec);
+    asio::write(socket, asio::buffer(connect_packet("memory-" + std::to_string(number))));
+    char connack[4];
+    asio::read(socket, asio::buffer(connack));
+    CHECK(connack[0] == '\x20' and connack[3] == 0);
+    return socket;
+}
+
+static void subscribe_client(tcp::socket &socket, const std::size_t number) {
+    asio::write(socket, asio::buffer(subscribe_packet("memory/" + std::to_string(number))));
+    char suback[5];
+    asio::read(socket, asio::buffer(suback));
+    CHECK(suback[0] == '\x90' and suback[4] == 0);
+}
+
+int main() {
+    const std::size_t count = raise_descriptor_limit(client_count);
+    auto settings = std::make_shared<mqtt::adapter_settings>(
+        nlohmann::json{ { adapter::field_name::protocol, "mqtt" },
+                        { adapter::field_name::role, "broker" },
+                        { adapter::field_name::transport, "tcp" },
+                        { adapter::field_name::interface, "*" },
+                        { adapter::field_name::port, broker_port },
+                        { adapter::field_name::scope, "#" },
+                        { adapter::field_name::name, "memory" } });
+    message_queue queue;
+    mqtt::broker<mqtt_cpp::server<>> broker(settings, queue);
+    broker.run();
+
+    asio::io_context ioc;
+    std::vector<tcp::socket> clients;
+    clients.reserve(warm_up_count + count);
+    for (std::size_t i = 0; i < warm_up_count; ++i) clients.push_back(connect_client(ioc, i));
+    const std::size_t baseline = resident_bytes();
+
+    for (std::size_t i = warm_up_count; i < warm_up_count + count; ++i)
+        clients.push_back(connect_client(ioc, i));
+    const std::size_t connected = resident_bytes();
+
+    for (std::size_t i = warm_up_count; i < warm_up_count + count; ++i)
+        subscribe_client(clients[i], i);
+    const std::size_t subscribed = resident_bytes();
+
+    const std::size_t connection_bytes = (connected - std::min(connected, baseline)) / count;
+    const std::size_t subscription_bytes = (subscribed - std::min(subscribed, connected)) / count;
+    std::printf("%zu clients: %zu bytes per idle connection, %zu bytes per subscription\n", count,
+                connection_bytes, subscription_bytes);
+
+    clients.clear();
+    broker.stop();
+    CHECK(connection_bytes <= max_connection_bytes);
+    CHECK(subscription_bytes <= max_subscription_bytes);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef OCTOMQ_TESTS_CHECK_H_
+#define OCTOMQ_TESTS_CHECK_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#include <stdlib.h>
+
+// Unit tests are plain executables run by CTest, a failed check ends the test with an error
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (not(condition)) {                                                            \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+                         #condition);                                                    \
+            std::exit(EXIT_FAILURE);                                                     \
+        }                                                                                \
+    } while (false)
+
+namespace octopus_mq::test {
+
+// Directory removed with its contents when the test is done
+class temporary_directory {
+    std::string _path;
+
+   public:
+    temporary_directory() {
+        char path[] = "/tmp/octopusmq-test-XXXXXX";
+        CHECK(mkdtemp(path) != nullptr);
+        _path = path;
+    }
+    ~temporary_directory() {
+        std::error_code ec;
+        std::filesystem::remove_all(_path, ec);
+    }
+    temporary_directory(const temporary_directory &) = delete;
+    temporary_directory &operator=(const temporary_directory &) = delete;
+
+    const std::string &path() const { return _path; }
+};
+
+}  // namespace octopus_mq::test
+
+#endif
@@ -0,0 +1,85 @@
+#include "network/mesh.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+
+using namespace octopus_mq;
+
+// Hashes are stamped by node::next_hash(), so the tests use them the same way
+static std::vector<message_hash> next_hashes(const std::size_t count) {
+    std::vector<message_hash> hashes;
+    for (std::size_t i = 0; i < count; ++i) hashes.push_back(node::next_hash());
+    return hashes;
+}
+
+static void exact_membership() {
+    constexpr std::size_t capacity = 1000;
+    duplicate_filter filter(capacity, std::chrono::hours(1));
+    const std::vector<message_hash> inserted = next_hashes(capacity);
+    const std::vector<message_hash> other = next_hashes(10 * capacity);
+    for (const message_hash hash : inserted) {
+        CHECK(not filter.contains(hash));
+        filter.insert(hash);
+        CHECK(filter.contains(hash));
+    }
+    // A full generation still tells every hash apart, nothing is a false duplicate
+    for (const message_hash hash : inserted) CHECK(filter.contains(hash));
+    for (const message_hash hash : other) CHECK(not filter.contains(hash));
+
+    // Null hash is not a stamp
+    filter.insert(mesh::constants::null_hash);
+    CHECK(not filter.contains(mesh::constants::null_hash));
+}
+
+// Full generation becomes the previous one, which is dropped when the next one fills up
+static void rotation_when_full() {
+    constexpr std::size_t capacity = 4;
+    duplicate_filter filter(capacity, std::chrono::hours(1));
+    const std::vector<message_hash> first = next_hashes(capacity);
+    const std::vector<message_hash> second = next_hashes(capacity);
+    const message_hash third = node::next_hash();
+
+    for (const message_hash hash : first) filter.insert(hash);
+    for (const message_hash hash : second) filter.insert(hash);
+    for (const message_hash hash : first) CHECK(filter.contains(hash));
+    for (const message_hash hash : second) CHECK(filter.contains(hash));
+
+    filter.insert(third);
+    for (const message_hash hash : first) CHECK(not filter.contains(hash));
+    for (const message_hash hash : second) CHECK(filter.contains(hash));
+    CHECK(filter.contains(third));
+}
+
+// Hash is remembered for one to two windows
+static void rotation_when_expired() {
+    const auto window = std::chrono::seconds(1);
+    const auto past_window = window + std::chrono::milliseconds(100);
+    duplicate_filter filter(1000, window);
+    const message_hash first = node::next_hash(), second = node::next_hash();
+
+    filter.insert(first);
+    std::this_thread::sleep_for(past_window);
+    CHECK(filter.contains(first));
+    filter.insert(second);
+    std::this_thread::sleep_for(past_window);
+    CHECK(not filter.contains(first));
+    CHECK(filter.contains(second));
+
+    // Both generations expire when nothing was looked up for two windows
+    filter.insert(first);
+    std::this_thread::sleep_for(2 * past_window);
+    CHECK(not filter.contains(first));
+    CHECK(not filter.contains(second));
+}
+
+int main() {
+    node::id(mesh::constants::null_node);  // Random node id
+    exact_membership();
+    rotation_when_full();
+    rotation_when_expired();
+    return 0;
+}
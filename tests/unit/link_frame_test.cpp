@@ -0,0 +1,184 @@
+#include "threads/link/frame.hpp"
+
+#include <string>
+
+#include "core/error.hpp"
+#include "check.hpp"
+
+using namespace octopus_mq;
+using namespace octopus_mq::link;
+
+// Reader of the body of a whole frame, as the bridge gets it after the header
+static frame_reader read_frame(const frame_buffer &frame, const frame_type type) {
+    CHECK(frame.size() >= constants::header_size);
+    CHECK(frame_reader::frame_length(frame.data()) == frame.size() - sizeof(std::uint32_t));
+    CHECK(frame_reader::type(frame.data()) == type);
+    return frame_reader(frame.data() + constants::header_size,
+                        frame.size() - constants::header_size, frame_reader::flags(frame.data()));
+}
+
+template <typename Read>
+static bool throws_protocol_error(Read read) {
+    try {
+        read();
+    } catch (const link_protocol_error &) {
+        return true;
+    }
+    return false;
+}
+
+static message_ptr make_message(const std::string &payload, const std::string &origin) {
+    auto shared_message = std::make_shared<message>(message_payload(), std::uint8_t(0x05));
+    shared_message->payload(payload.data(), payload.size());
+    shared_message->origin(origin);
+    shared_message->stamp(0x0102030405060708, 0xfffefdfcfbfaf9f8);
+    return shared_message;
+}
+
+static frame_buffer make_batch(const compression compression = compression::none) {
+    frame_writer writer;
+    writer.topic(7, "sensors/temperature");
+    writer.message(7, *make_message(std::string("{\"t\": 21.5}\0\xff", 13), "client"));
+    writer.topic(0xffff, "");
+    writer.message(0xffff, *make_message(std::string(1000, 'x'), ""));
+    return writer.finish(frame_type::batch, compression);
+}
+
+static void check_batch(frame_reader reader) {
+    topic_id id = 0;
+    std::string topic_name;
+    CHECK(reader.next_record() == record_type::topic);
+    reader.topic(id, topic_name);
+    CHECK(id == 7 and topic_name == "sensors/temperature");
+
+    CHECK(reader.next_record() == record_type::message);
+    message_ptr first = reader.message(id);
+    CHECK(id == 7);
+    CHECK(first->payload() == std::string_view("{\"t\": 21.5}\0\xff", 13));
+    CHECK(first->origin() == "client");
+    CHECK(first->pubopts() == 0x05 and first->qos() == 2);
+    CHECK(first->origin_node() == 0x0102030405060708);
+    CHECK(first->hash() == 0xfffefdfcfbfaf9f8);
+
+    CHECK(reader.next_record() == record_type::topic);
+    reader.topic(id, topic_name);
+    CHECK(id == 0xffff and topic_name.empty());
+
+    CHECK(reader.next_record() == record_type::message);
+    message_ptr second = reader.message(id);
+    CHECK(second->payload() == std::string(1000, 'x'));
+    CHECK(second->origin().empty());
+    CHECK(reader.at_end());
+}
+
+static void round_trip() {
+    frame_writer writer;
+    CHECK(writer.empty());
+    writer.hello({ 0x1122334455667788, 1024 });
+    CHECK(writer.size() == sizeof(constants::magic) + 1 + 8 + 4);
+    frame_buffer frame = writer.finish(frame_type::hello);
+    CHECK(writer.empty());
+    frame_reader hello_reader = read_frame(frame, frame_type::hello);
+    const struct hello hello = hello_reader.hello();
+    CHECK(hello.id == 0x1122334455667788 and hello.window == 1024);
+    CHECK(hello_reader.at_end());
+
+    writer.credit(0xdeadbeef);
+    frame = writer.finish(frame_type::credit);
+    frame_reader credit_reader = read_frame(frame, frame_type::credit);
+    CHECK(credit_reader.credit() == 0xdeadbeef and credit_reader.at_end());
+
+    // Record sizes are used to close batches before they grow too large
+    const message_ptr sized = make_message("payload", "origin");
+    writer.message(1, *sized);
+    CHECK(writer.size() == frame_writer::message_size(*sized));
+    writer.finish(frame_type::batch);
+    writer.topic(1, "a/b");
+    CHECK(writer.size() == frame_writer::topic_size("a/b"));
+    writer.finish(frame_type::batch);
+
+    check_batch(read_frame(make_batch(), frame_type::batch));
+}
+
+static void compressed_round_trip() {
+    // Without the library the frame is sent uncompressed and stays readable
+    for (const compression compression : { compression::lz4, compression::zstd }) {
+        const frame_buffer frame = make_batch(compression);
+        const std::uint8_t flags = frame_reader::flags(frame.data());
+        CHECK(flags == 0 or frame.size() < make_batch().size());
+        check_batch(read_frame(frame, frame_type::batch));
+    }
+#ifdef OCTOMQ_ENABLE_LZ4
+    CHECK(frame_reader::flags(make_batch(compression::lz4).data()) == frame_flags::lz4);
+#endif
+#ifdef OCTOMQ_ENABLE_ZSTD
+    CHECK(frame_reader::flags(make_batch(compression::zstd).data()) == frame_flags::zstd);
+#endif
+
+    // Small bodies are not worth compressing
+    frame_writer writer;
+    writer.credit(1);
+    CHECK(frame_reader::flags(writer.finish(frame_type::credit, compression::lz4).data()) == 0);
+}
+
+static void truncated_frames() {
+    // Reading a body cut at any byte stops with an error instead of reading past the cut
+    const frame_buffer frame = make_batch();
+    const char *body = frame.data() + constants::header_size;
+    const std::size_t size = frame.size() - constants::header_size;
+    for (std::size_t cut = 0; cut < size; ++cut)
+        CHECK(throws_protocol_error([&] {
+            frame_reader reader(body, cut, 0);
+            topic_id id;
+            std::string topic_name;
+            while (true)
+                if (reader.next_record() == record_type::topic)
+                    reader.topic(id, topic_name);
+                else
+                    reader.message(id);
+        }));
+
+    frame_writer writer;
+    writer.hello({ 1, 1 });
+    const frame_buffer hello = writer.finish(frame_type::hello);
+    for (std::size_t cut = 0; cut < hello.size() - constants::header_size; ++cut)
+        CHECK(throws_protocol_error(
+            [&] { frame_reader(hello.data() + constants::header_size, cut, 0).hello(); }));
+    CHECK(throws_protocol_error([] { frame_reader(nullptr, 0, 0).credit(); }));
+}
+
+static void invalid_frames() {
+    frame_writer writer;
+    writer.hello({ 1, 1 });
+    frame_buffer hello = writer.finish(frame_type::hello);
+    char *body = hello.data() + constants::header_size;
+    const std::size_t size = hello.size() - constants::header_size;
+
+    body[sizeof(constants::magic)] = constants::version + 1;
+    CHECK(throws_protocol_error([&] { frame_reader(body, size, 0).hello(); }));
+    body[0] = 'X';
+    CHECK(throws_protocol_error([&] { frame_reader(body, size, 0).hello(); }));
+
+    // Compressed body claiming to expand beyond the accepted frame size
+    const std::uint32_t original_size = constants::max_accepted_frame_size + 1;
+    const char oversized[] = { static_cast<char>(original_size >> 24),
+                               static_cast<char>(original_size >> 16),
+                               static_cast<char>(original_size >> 8),
+                               static_cast<char>(original_size), 0, 0, 0, 0 };
+    CHECK(throws_protocol_error(
+        [&] { frame_reader(oversized, sizeof(oversized), frame_flags::lz4); }));
+
+    // Garbage after the uncompressed size is not a valid compressed body
+    const char garbage[] = { 0, 0, 1, 0, '\xff', '\xff', '\xff', '\xff', '\xff', '\xff' };
+    CHECK(throws_protocol_error([&] { frame_reader(garbage, sizeof(garbage), frame_flags::lz4); }));
+    CHECK(
+        throws_protocol_error([&] { frame_reader(garbage, sizeof(garbage), frame_flags::zstd); }));
+}
+
+int main() {
+    round_trip();
+    compressed_round_trip();
+    truncated_frames();
+    invalid_frames();
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include "network/adapter.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <vector>
+
+#include "check.hpp"
+
+using namespace octopus_mq;
+
+// Adapter keeping injected messages until it is stopped, like one whose peers are slow
+class queueing_adapter final : public adapter_interface {
+    std::vector<injected_message> _queued;
+
+   public:
+    using adapter_interface::adapter_interface;
+
+    void run() {}
+    void stop() { _queued.clear(); }
+    void inject_publish(const message_ptr message) {
+        _queued.emplace_back(message, _global_queue.receipt(message));
+    }
+    std::size_t queued() const { return _queued.size(); }
+};
+
+static adapter_settings_ptr make_settings(const char *name) {
+    return std::make_shared<adapter_settings>(
+        protocol_type::mqtt, nlohmann::json{ { adapter::field_name::protocol, "mqtt" },
+                                             { adapter::field_name::interface, "*" },
+                                             { adapter::field_name::port, 1883u },
+                                             { adapter::field_name::scope, "#" },
+                                             { adapter::field_name::name, name } });
+}
+
+static wal_sequence read_checkpoint(const std::string &directory) {
+    wal_sequence checkpoint = 0;
+    const std::string path =
+        (std::filesystem::path(directory) / wal_config::constants::checkpoint_file).string();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    CHECK(fd >= 0);
+    if (pread(fd, &checkpoint, sizeof(checkpoint), 0) != sizeof(checkpoint)) checkpoint = 0;
+    ::close(fd);
+    return checkpoint;
+}
+
+// Logged messages queued in an adapter hold the checkpoint back until the adapter is stopped
+static void stopped_adapter_releases_messages() {
+    test::temporary_directory directory;
+    wal_settings settings;
+    settings.directory = directory.path();
+    settings.segment_size = wal_config::constants::min_segment_size;
+    settings.fsync = fsync_policy::never;
+
+    message_queue queue;
+    queue.configure_wal(settings);
+    const adapter_settings_ptr source_settings = make_settings("source");
+    const adapter_settings_ptr sink_settings = make_settings("sink");
+    auto sink = std::make_shared<queueing_adapter>(sink_settings, queue);
+    adapter_pool pool{ { source_settings,
+                         std::make_shared<queueing_adapter>(source_settings, queue) },
+                       { sink_settings, sink } };
+
+    constexpr std::size_t count = 100;
+    for (std::size_t i = 0; i < count; ++i) {
+        auto shared_message = std::make_shared<message>(
+            message_payload{ 'x' }, topic_table::intern("sensors/" + std::to_string(i % 7)),
+            std::uint8_t(0x02));  // QoS 1
+        CHECK(queue.push(source_settings, shared_message));
+    }
+    CHECK(queue.wait_and_pop_all(std::chrono::milliseconds(100), pool) == count);
+    CHECK(sink->queued() == count);
+    CHECK(read_checkpoint(directory.path()) == 0);
+
+    sink->stop();
+    queue.wait_and_pop_all(std::chrono::milliseconds(0), pool);
+    CHECK(read_checkpoint(directory.path()) == count);
+
+    // Nothing is left for replay after a restart
+    queue.close_wal();
+    write_ahead_log log;
+    CHECK(log.open(settings).empty());
+}
+
+// Adapter destroyed without being stopped releases its messages as well
+static void destroyed_adapter_releases_messages() {
+    test::temporary_directory directory;
+    wal_settings settings;
+    settings.directory = directory.path();
+    settings.fsync = fsync_policy::never;
+
+    message_queue queue;
+    queue.configure_wal(settings);
+    const adapter_settings_ptr source_settings = make_settings("source");
+    const adapter_settings_ptr sink_settings = make_settings("sink");
+    adapter_pool pool{ { source_settings,
+                         std::make_shared<queueing_adapter>(source_settings, queue) },
+                       { sink_settings,
+                         std::make_shared<queueing_adapter>(sink_settings, queue) } };
+
+    auto shared_message = std::make_shared<message>(
+        message_payload{ 'x' }, topic_table::intern("sensors/a"), std::uint8_t(0x04));  // QoS 2
+    CHECK(queue.push(source_settings, shared_message));
+    CHECK(queue.wait_and_pop_all(std::chrono::milliseconds(100), pool) == 1);
+    CHECK(read_checkpoint(directory.path()) == 0);
+
+    pool.pop_back();
+    queue.wait_and_pop_all(std::chrono::milliseconds(0), pool);
+    CHECK(read_checkpoint(directory.path()) == 1);
+}
+
+int main() {
+    stopped_adapter_releases_messages();
+    destroyed_adapter_releases_messages();
+    return 0;
+}
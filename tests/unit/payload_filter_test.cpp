@@ -0,0 +1,182 @@
+#include "network/payload_filter.hpp"
+
+#include <string>
+
+#include "core/error.hpp"
+#include "check.hpp"
+
+using namespace octopus_mq;
+
+static bool rejected(const std::string &expression) {
+    try {
+        payload_filter filter(expression);
+    } catch (const filter_syntax_error &) {
+        return true;
+    }
+    return false;
+}
+
+static bool passes(const char *expression, const char *payload) {
+    return payload_filter(expression).evaluate(payload);
+}
+
+static void invalid_expressions_are_rejected() {
+    CHECK(rejected(""));
+    CHECK(rejected("   "));
+    CHECK(rejected("a =="));
+    CHECK(rejected("a == b"));
+    CHECK(rejected("a == \"text"));
+    CHECK(rejected("(a"));
+    CHECK(rejected("a)"));
+    CHECK(rejected("a b"));
+    CHECK(rejected("a &&"));
+    CHECK(rejected("|| a"));
+    CHECK(rejected("a. == 1"));
+    CHECK(rejected("a = 1"));
+    CHECK(rejected("!"));
+
+    // Limits of payload_filter_config
+    CHECK(rejected(std::string(payload_filter_config::constants::max_length + 1, 'a')));
+    CHECK(not rejected(std::string(payload_filter_config::constants::max_length, 'a')));
+    std::string fields = "f0";
+    for (std::size_t i = 1; i <= payload_filter_config::constants::max_fields; ++i)
+        fields += " && f" + std::to_string(i);
+    CHECK(rejected(fields));
+    std::string nested;
+    for (std::size_t i = 0; i <= payload_filter_config::constants::max_stack; ++i)
+        nested += "a || (";
+    nested += 'a' + std::string(payload_filter_config::constants::max_stack + 1, ')');
+    CHECK(rejected(nested));
+}
+
+static void valid_expressions_are_compiled() {
+    CHECK(not rejected("a"));
+    CHECK(not rejected("  a.b.c  "));
+    CHECK(not rejected("$meta-1.value_2 >= -1.5e3"));
+    CHECK(not rejected("!(a || b) && c != null"));
+    CHECK(not rejected("a == \"quoted \\\" text\""));
+    CHECK(not rejected("a == true || a == false"));
+    CHECK(payload_filter(" a > 1 ").expression() == " a > 1 ");
+}
+
+static void comparisons() {
+    const char *payload = R"({"n": 42, "s": "abc", "t": true, "f": false, "z": null})";
+    CHECK(passes("n == 42", payload));
+    CHECK(passes("n != 41", payload));
+    CHECK(passes("n < 42.5 && n <= 42 && n > -1 && n >= 42", payload));
+    CHECK(not passes("n > 42", payload));
+    CHECK(passes("s == \"abc\"", payload));
+    CHECK(passes("s < \"abd\" && s >= \"abc\"", payload));
+    CHECK(passes("t == true && f == false && f != true", payload));
+    CHECK(not passes("t < false", payload));
+    CHECK(passes("z == null", payload));
+    CHECK(not passes("z != null", payload));
+
+    // Values of different types differ
+    CHECK(not passes("n == \"42\"", payload));
+    CHECK(passes("n != \"42\"", payload));
+    CHECK(not passes("s > 0", payload));
+    CHECK(not passes("missing == null", payload));
+    CHECK(passes("missing != 1", payload));
+}
+
+static void presence() {
+    const char *payload = R"({"n": 0, "s": "", "t": true, "f": false, "z": null, "o": {}})";
+    CHECK(passes("n && s && t && o", payload));
+    CHECK(not passes("f", payload));
+    CHECK(not passes("z", payload));
+    CHECK(not passes("missing", payload));
+    CHECK(passes("!missing && !f && !z", payload));
+}
+
+static void precedence() {
+    const char *payload = R"({"a": true, "b": false, "c": false})";
+    CHECK(passes("a || b && c", payload));
+    CHECK(not passes("(a || b) && c", payload));
+    CHECK(passes("!b && a", payload));
+    CHECK(not passes("!(b || a)", payload));
+    CHECK(passes("!!a", payload));
+}
+
+static void nested_fields() {
+    const char *payload =
+        R"({"skip": {"sensor": {"t": 1}}, "sensor": {"id": "x1", "reading": {"t": 81.5}}})";
+    CHECK(passes("sensor.reading.t > 80", payload));
+    CHECK(passes("sensor.id == \"x1\" && sensor.reading.t < 90", payload));
+    CHECK(passes("sensor && sensor.reading", payload));
+    CHECK(not passes("sensor.reading.t.deeper", payload));
+    CHECK(not passes("sensor.missing", payload));
+    CHECK(passes("skip.sensor.t == 1", payload));
+}
+
+static void skipped_values() {
+    // Brackets and quotes inside skipped strings must not end the skipped containers
+    const char *payload =
+        R"({"a": ["}", {"x": "]\"{"}, [1, [2]]], "b": "\\", "c": {"d": "\"}"}, "v": 7})";
+    CHECK(passes("v == 7", payload));
+    CHECK(passes("b == \"\\\\\"", payload));
+    CHECK(passes("c.d == \"\\\"}\"", payload));
+    // Arrays are present but not comparable
+    CHECK(passes("a", payload));
+    CHECK(not passes("a == 1", payload));
+}
+
+static void invalid_payloads() {
+    CHECK(not passes("a", ""));
+    CHECK(not passes("a", "not json"));
+    CHECK(not passes("a", "[1, 2]"));
+    CHECK(not passes("a == 1", "{\"a\": "));
+    CHECK(not passes("a", "{\"a\": tru}"));
+    CHECK(not passes("a == 1", "{\"a\": \"1}"));
+    CHECK(passes("!a", "garbage"));
+
+    // Fields found before the payload breaks are not trusted
+    CHECK(not passes("a == 1 && b == 2", "{\"a\": 1, \"b\""));
+
+    // Objects nested deeper than max_depth are not scanned
+    const auto nested = [](const std::size_t depth) {
+        std::string path = "a", payload = "{\"a\": ";
+        for (std::size_t i = 0; i < depth; ++i) {
+            path += ".a";
+            payload += "{\"a\": ";
+        }
+        payload += '1' + std::string(depth + 1, '}');
+        return passes(path.c_str(), payload.c_str());
+    };
+    CHECK(nested(payload_filter_config::constants::max_depth));
+    CHECK(not nested(payload_filter_config::constants::max_depth + 1));
+}
+
+static void cache_shares_filters() {
+    payload_filter_cache cache;
+    payload_filter_ptr first = cache.get("a > 1");
+    CHECK(cache.get("a > 1") == first);
+    CHECK(cache.get("a > 2") != first);
+    bool thrown = false;
+    try {
+        cache.get("a >");
+    } catch (const filter_syntax_error &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    // Filters no subscriber uses are dropped and compiled again when needed
+    first.reset();
+    cache.collect();
+    payload_filter_ptr again = cache.get("a > 1");
+    CHECK(again and again->expression() == "a > 1");
+    CHECK(again->evaluate("{\"a\": 2}"));
+}
+
+int main() {
+    invalid_expressions_are_rejected();
+    valid_expressions_are_compiled();
+    comparisons();
+    presence();
+    precedence();
+    nested_fields();
+    skipped_values();
+    invalid_payloads();
+    cache_shares_filters();
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include "core/timer_wheel.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "check.hpp"
+
+using namespace octopus_mq;
+
+constexpr std::chrono::steady_clock::duration tick = std::chrono::seconds(1);
+
+// Wheel turned to whole ticks since its start, regardless of the time the test takes
+class test_wheel {
+    timer_wheel _wheel;
+    const std::chrono::steady_clock::time_point _start;
+
+   public:
+    test_wheel() : _wheel(tick), _start(std::chrono::steady_clock::now()) {}
+
+    timer_wheel *operator->() { return &_wheel; }
+    void advance_to(const std::uint64_t ticks) {
+        _wheel.advance(_start + static_cast<std::chrono::steady_clock::rep>(ticks) * tick);
+    }
+};
+
+static void expiry() {
+    test_wheel wheel;
+    wheel_timer timer;
+    int fired = 0;
+    wheel->schedule(timer, 5 * tick, [&fired] { ++fired; });
+    CHECK(timer.armed());
+    wheel.advance_to(4);
+    CHECK(fired == 0 and timer.armed());
+    wheel.advance_to(5);
+    CHECK(fired == 1 and not timer.armed());
+    wheel.advance_to(1000);
+    CHECK(fired == 1);
+
+    // Periods are rounded up to whole ticks, timers never expire early
+    wheel_timer rounded, immediate;
+    wheel->schedule(rounded, tick + tick / 2, [&fired] { ++fired; });
+    wheel->schedule(immediate, std::chrono::steady_clock::duration(0), [&fired] { fired += 10; });
+    wheel.advance_to(1001);
+    CHECK(fired == 11);
+    wheel.advance_to(1002);
+    CHECK(fired == 12);
+
+    // Time before the start does not turn the wheel
+    wheel->schedule(timer, tick, [&fired] { ++fired; });
+    wheel->advance(std::chrono::steady_clock::time_point());
+    CHECK(fired == 12 and timer.armed());
+}
+
+// Timers of every level fire exactly at their deadline after cascading down
+static void cascade() {
+    constexpr std::uint64_t level_1 = 64, level_2 = 64 * 64, level_3 = 64 * 64 * 64;
+    constexpr std::uint64_t span = level_3 * 64;
+    // Ascending, each one is checked while the wheel is turned to it
+    const std::vector<std::uint64_t> periods = { 1,           2,           63,
+                                                 level_1,     level_1 + 1, 2 * level_1 - 1,
+                                                 level_2 - 1, level_2,     level_2 + 1,
+                                                 3 * level_2 + 7,          level_3 - 1,
+                                                 level_3,     level_3 + 1, span - 1,
+                                                 span,        span + 1,    2 * span + 5 };
+    test_wheel wheel;
+    // Wheel is turned to a position where the lower levels are not aligned
+    wheel.advance_to(level_2 + 3 * level_1 + 5);
+    const std::uint64_t now = level_2 + 3 * level_1 + 5;
+
+    std::vector<std::unique_ptr<wheel_timer>> timers;
+    std::vector<std::uint64_t> fired_at(periods.size(), 0);
+    std::uint64_t current = now;
+    for (std::size_t i = 0; i < periods.size(); ++i) {
+        timers.push_back(std::make_unique<wheel_timer>());
+        wheel->schedule(*timers.back(),
+                        static_cast<std::chrono::steady_clock::rep>(periods[i]) * tick,
+                        [&fired_at, &current, i] { fired_at[i] = current; });
+    }
+
+    for (std::size_t i = 0; i < periods.size(); ++i) {
+        const std::uint64_t deadline = now + periods[i];
+        current = deadline - 1;
+        wheel.advance_to(current);
+        CHECK(fired_at[i] == 0 and timers[i]->armed());
+        current = deadline;
+        wheel.advance_to(current);
+        CHECK(fired_at[i] == deadline and not timers[i]->armed());
+    }
+}
+
+static void touch() {
+    test_wheel wheel;
+    wheel_timer near, far;
+    int near_fired = 0, far_fired = 0;
+    wheel->schedule(near, 10 * tick, [&near_fired] { ++near_fired; });
+    wheel->schedule(far, 200 * tick, [&far_fired] { ++far_fired; });
+
+    wheel.advance_to(5);
+    wheel->touch(near);  // Deadline 15
+    wheel.advance_to(14);
+    CHECK(near_fired == 0 and near.armed());
+    wheel.advance_to(15);
+    CHECK(near_fired == 1);
+
+    // Timer touched while waiting in an upper level is inserted again when it is reached
+    wheel.advance_to(190);
+    wheel->touch(far);  // Deadline 390
+    wheel.advance_to(389);
+    CHECK(far_fired == 0 and far.armed());
+    wheel.advance_to(390);
+    CHECK(far_fired == 1);
+}
+
+static void cancel_and_destroy() {
+    test_wheel wheel;
+    int fired = 0;
+    wheel_timer cancelled;
+    wheel->schedule(cancelled, 3 * tick, [&fired] { ++fired; });
+    cancelled.cancel();
+    CHECK(not cancelled.armed());
+    {
+        wheel_timer destroyed;
+        wheel->schedule(destroyed, 3 * tick, [&fired] { ++fired; });
+    }
+
+    // Moved-from and moved-to timers are disarmed
+    wheel_timer source, target;
+    wheel->schedule(source, 3 * tick, [&fired] { ++fired; });
+    wheel->schedule(target, 3 * tick, [&fired] { ++fired; });
+    wheel_timer moved(std::move(source));
+    CHECK(not moved.armed() and not source.armed());
+    wheel->schedule(source, 3 * tick, [&fired] { ++fired; });
+    target = std::move(source);
+    CHECK(not target.armed() and not source.armed());
+
+    wheel.advance_to(100);
+    CHECK(fired == 0);
+}
+
+static void handlers_change_timers() {
+    test_wheel wheel;
+    // Handler rearming its own timer
+    wheel_timer periodic;
+    int fired = 0;
+    std::function<void()> rearm = [&] {
+        if (++fired < 3) wheel->schedule(periodic, 3 * tick, rearm);
+    };
+    wheel->schedule(periodic, 3 * tick, rearm);
+    wheel.advance_to(8);
+    CHECK(fired == 2 and periodic.armed());
+    wheel.advance_to(9);
+    CHECK(fired == 3 and not periodic.armed());
+
+    // Handler destroying a timer expiring in the same slot
+    auto first = std::make_unique<wheel_timer>();
+    auto second = std::make_unique<wheel_timer>();
+    int second_fired = 0;
+    wheel->schedule(*first, 5 * tick, [&second] { second.reset(); });
+    wheel->schedule(*second, 5 * tick, [&second_fired] { ++second_fired; });
+    wheel.advance_to(20);
+    CHECK(not second and second_fired == 0);
+}
+
+int main() {
+    expiry();
+    cascade();
+    touch();
+    cancel_and_destroy();
+    handlers_change_timers();
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include "network/wal.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+
+using namespace octopus_mq;
+
+constexpr std::size_t entry_count = 10;
+constexpr std::size_t entry_header_size = 16;  // Size, CRC-32 and sequence of the entry
+
+static wal_settings make_settings(const test::temporary_directory &directory) {
+    wal_settings settings;
+    settings.directory = directory.path();
+    settings.segment_size = wal_config::constants::min_segment_size;
+    settings.fsync = fsync_policy::never;
+    return settings;
+}
+
+static message_ptr make_message(const std::size_t number) {
+    const std::string payload = "payload " + std::to_string(number);
+    auto shared_message = std::make_shared<message>(
+        message_payload(), topic_table::intern("sensors/" + std::to_string(number)),
+        std::uint8_t(0x02), mqtt::version::v5);
+    shared_message->payload(payload.data(), payload.size());
+    shared_message->origin("client " + std::to_string(number));
+    shared_message->props(std::make_shared<const std::string>("properties"));
+    shared_message->stamp(1000 + number, 2000 + number);
+    return shared_message;
+}
+
+static void check_entries(const std::vector<wal_entry> &entries, const std::size_t count) {
+    CHECK(entries.size() == count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::size_t number = i + 1;
+        const message &recovered = *entries[i].second;
+        CHECK(entries[i].first == "adapter");
+        CHECK(recovered.wal_sequence() == number);
+        CHECK(recovered.topic() == "sensors/" + std::to_string(number));
+        CHECK(recovered.payload() == "payload " + std::to_string(number));
+        CHECK(recovered.origin() == "client " + std::to_string(number));
+        CHECK(recovered.raw_props() and *recovered.raw_props() == "properties");
+        CHECK(recovered.pubopts() == 0x02 and recovered.mqtt_version() == mqtt::version::v5);
+        CHECK(recovered.origin_node() == 1000 + number and recovered.hash() == 2000 + number);
+    }
+}
+
+// Appends entries and closes the log without releasing them, as if the process stopped
+static void write_entries(const wal_settings &settings) {
+    write_ahead_log log;
+    CHECK(log.open(settings).empty());
+    for (std::size_t number = 1; number <= entry_count; ++number)
+        CHECK(log.append("adapter", *make_message(number)) == number);
+    log.close();
+}
+
+// Segment holding the entries, the other one is an empty spare if there is any
+static std::string written_segment(const wal_settings &settings) {
+    for (auto &file : std::filesystem::directory_iterator(settings.directory)) {
+        if (file.path().extension() != wal_config::constants::segment_extension) continue;
+        std::ifstream stream(file.path(), std::ios::binary);
+        std::uint32_t size = 0;
+        stream.read(reinterpret_cast<char *>(&size), sizeof(size));
+        if (size != 0) return file.path().string();
+    }
+    CHECK(false);
+    return std::string();
+}
+
+// Offset of the entry with the sequence in the segment
+static std::size_t entry_offset(const std::string &path, const wal_sequence sequence) {
+    std::ifstream stream(path, std::ios::binary);
+    std::size_t offset = 0;
+    for (wal_sequence current = 1; current < sequence; ++current) {
+        std::uint32_t size = 0;
+        stream.seekg(offset);
+        stream.read(reinterpret_cast<char *>(&size), sizeof(size));
+        CHECK(stream and size != 0);
+        offset += entry_header_size + size;
+    }
+    return offset;
+}
+
+static void overwrite(const std::string &path, const std::size_t offset, const void *data,
+                      const std::size_t size) {
+    std::fstream stream(path, std::ios::in | std::ios::out | std::ios::binary);
+    stream.seekp(offset);
+    stream.write(static_cast<const char *>(data), size);
+    CHECK(stream);
+}
+
+static void entries_are_replayed() {
+    test::temporary_directory directory;
+    const wal_settings settings = make_settings(directory);
+    write_entries(settings);
+    write_ahead_log log;
+    check_entries(log.open(settings), entry_count);
+
+    // Checkpoint passes released entries, the rest is replayed again
+    for (wal_sequence sequence = 1; sequence <= 4; ++sequence) log.release(sequence);
+    log.release(6);  // Checkpoint stops at the first entry still held
+    log.checkpoint();
+    log.close();
+    const std::vector<wal_entry> entries = log.open(settings);
+    CHECK(entries.size() == entry_count - 4);
+    CHECK(entries.front().second->wal_sequence() == 5);
+    CHECK(entries.back().second->wal_sequence() == entry_count);
+}
+
+// Entry interrupted by a crash before its size was written ends the segment
+static void torn_entry_ends_segment() {
+    test::temporary_directory directory;
+    const wal_settings settings = make_settings(directory);
+    write_entries(settings);
+    const std::string path = written_segment(settings);
+    const std::uint32_t zero = 0;
+    overwrite(path, entry_offset(path, 7), &zero, sizeof(zero));
+
+    write_ahead_log log;
+    check_entries(log.open(settings), 6);
+    // Appends continue after the last recovered entry
+    CHECK(log.append("adapter", *make_message(7)) == 7);
+    log.close();
+    check_entries(log.open(settings), 7);
+}
+
+// Entry whose body does not match its checksum is a torn write, it and the rest are dropped
+static void corrupted_body_ends_segment() {
+    test::temporary_directory directory;
+    const wal_settings settings = make_settings(directory);
+    write_entries(settings);
+    const std::string path = written_segment(settings);
+    const std::size_t offset = entry_offset(path, 4) + entry_header_size + 5;
+    char byte = 0;
+    {
+        std::ifstream stream(path, std::ios::binary);
+        stream.seekg(offset);
+        stream.read(&byte, 1);
+    }
+    byte ^= 0x40;
+    overwrite(path, offset, &byte, 1);
+
+    write_ahead_log log;
+    check_entries(log.open(settings), 3);
+}
+
+static void corrupted_checksum_ends_segment() {
+    test::temporary_directory directory;
+    const wal_settings settings = make_settings(directory);
+    write_entries(settings);
+    const std::string path = written_segment(settings);
+    const std::uint32_t checksum = 0xdeadbeef;
+    overwrite(path, entry_offset(path, 9) + sizeof(std::uint32_t), &checksum, sizeof(checksum));
+
+    write_ahead_log log;
+    check_entries(log.open(settings), 8);
+}
+
+// Segment cut in the middle of an entry, e.g. copied from a failing disk
+static void truncated_segment() {
+    test::temporary_directory directory;
+    const wal_settings settings = make_settings(directory);
+    write_entries(settings);
+    const std::string path = written_segment(settings);
+    std::filesystem::resize_file(path, entry_offset(path, 5) + entry_header_size + 3);
+
+    write_ahead_log log;
+    check_entries(log.open(settings), 4);
+    log.close();
+    std::filesystem::resize_file(path, entry_offset(path, 3) + 7);
+    check_entries(log.open(settings), 2);
+}
+
+int main() {
+    entries_are_replayed();
+    torn_entry_ends_segment();
+    corrupted_body_ends_segment();
+    corrupted_checksum_ends_segment();
+    truncated_segment();
+    return 0;
+}